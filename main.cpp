@@ -6,6 +6,40 @@
 #include <limits>
 #include <stdexcept>
 #include <algorithm>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <charconv>
+#include <cmath>
+#include <cctype>
+#include <set>
+#include <list>
+#include <chrono>
+#include <mutex>
+#include <future>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 /**
  * @brief Represents the size of a beer container.
@@ -93,20 +127,20 @@ public:
 class Barcode
 {
 private:
-    int value;
+    long long value; // 12-digit UPC values do not fit in an int
 
 public:
     /**
      * @brief Constructor for Barcode.
      * @param barcodeValue The barcode value.
      */
-    Barcode(int barcodeValue) : value(barcodeValue) {}
+    Barcode(long long barcodeValue) : value(barcodeValue) {}
 
     /**
      * @brief Get the barcode value.
      * @return The barcode value.
      */
-    int getValue() const
+    long long getValue() const
     {
         return value;
     }
@@ -115,7 +149,7 @@ public:
      * @brief Set the barcode value.
      * @param newValue The new barcode value.
      */
-    void setValue(int newValue)
+    void setValue(long long newValue)
     {
         value = newValue;
     }
@@ -147,7 +181,7 @@ public:
      * @param barcodeValue The barcode value associated with the beer.
      * @param id The auto incrementing id of each entry of beer.
      */
-    Beer(const std::string &style, const std::string &name, double alcoholContent, const ContainerSize &containerSize, int quantity, int barcodeValue)
+    Beer(const std::string &style, const std::string &name, double alcoholContent, const ContainerSize &containerSize, int quantity, long long barcodeValue)
         : style(style), name(name), alcoholContent(alcoholContent), containerSize(containerSize), quantity(quantity), barcode(barcodeValue), id(-1)
     {
         // Initialize the updated date with the current date and time
@@ -290,6 +324,15 @@ public:
         std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&currentTime));
         updatedDate = buffer;
     }
+
+    /**
+     * @brief Set the updated date explicitly (used when loading stored records).
+     * @param newDate The stored date string.
+     */
+    void setUpdatedDate(const std::string &newDate)
+    {
+        updatedDate = newDate;
+    }
 };
 
 /**
@@ -335,262 +378,12744 @@ public:
 };
 
 /**
- * @brief Represents a beer inventory management application.
+ * @brief Append the raw bytes of a plain value to a buffer.
+ * @param out The buffer to append to.
+ * @param value The value to append.
  */
-class BottleApp
+template <typename T>
+void appendPod(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/**
+ * @brief Read a plain value from a buffer and advance the cursor.
+ * @param cursor The read position, advanced past the value.
+ * @param end One past the last readable byte.
+ * @param value Receives the value.
+ * @return True if enough bytes were available.
+ */
+template <typename T>
+bool readPod(const char *&cursor, const char *end, T &value)
+{
+    if (end - cursor < static_cast<std::ptrdiff_t>(sizeof(T)))
+    {
+        return false;
+    }
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return true;
+}
+
+/**
+ * @brief Append a length-prefixed string to a buffer.
+ * @param out The buffer to append to.
+ * @param value The string to append (truncated to 65535 bytes).
+ */
+void appendString(std::string &out, const std::string &value)
+{
+    uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+    appendPod(out, length);
+    out.append(value.data(), length);
+}
+
+/**
+ * @brief Read a length-prefixed string from a buffer and advance the cursor.
+ * @param cursor The read position, advanced past the string.
+ * @param end One past the last readable byte.
+ * @param value Receives the string.
+ * @return True if the string was complete.
+ */
+bool readString(const char *&cursor, const char *end, std::string &value)
+{
+    uint16_t length;
+    if (!readPod(cursor, end, length) || end - cursor < length)
+    {
+        return false;
+    }
+    value.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+
+/**
+ * @brief Serialize a beer into a compact binary record.
+ * @param beer The beer to serialize.
+ * @param out The buffer the record is appended to.
+ */
+void serializeBeer(const Beer &beer, std::string &out)
+{
+    appendPod<int32_t>(out, beer.getId());
+    appendPod<int32_t>(out, beer.getQuantity());
+    appendPod<double>(out, beer.getAlcoholContent());
+    appendPod<int64_t>(out, beer.getBarcode().getValue());
+    appendPod<uint8_t>(out, beer.getContainerSize().getIsMetric() ? 1 : 0);
+    appendPod<int32_t>(out, beer.getContainerSize().getSize());
+    appendString(out, beer.getStyle());
+    appendString(out, beer.getName());
+    appendString(out, beer.getUpdatedDate());
+}
+
+/**
+ * @brief Rebuild a beer from a record written by serializeBeer.
+ * @param data The record bytes.
+ * @param length The record length.
+ * @return The beer, or nothing if the record is truncated.
+ */
+std::optional<Beer> deserializeBeer(const char *data, size_t length)
+{
+    const char *cursor = data;
+    const char *end = data + length;
+    int32_t id, quantity, size;
+    double alcoholContent;
+    int64_t barcode;
+    uint8_t isMetric;
+    std::string style, name, updatedDate;
+    if (!readPod(cursor, end, id) || !readPod(cursor, end, quantity) || !readPod(cursor, end, alcoholContent) ||
+        !readPod(cursor, end, barcode) || !readPod(cursor, end, isMetric) || !readPod(cursor, end, size) ||
+        !readString(cursor, end, style) || !readString(cursor, end, name) || !readString(cursor, end, updatedDate))
+    {
+        return std::nullopt;
+    }
+    Beer beer(style, name, alcoholContent, ContainerSize(isMetric != 0, size), quantity, barcode);
+    beer.setId(id);
+    beer.setUpdatedDate(updatedDate);
+    return beer;
+}
+
+/**
+ * @brief Hash a string with 64-bit FNV-1a (used to key name indexes).
+ * @param value The string to hash.
+ * @return The hash value.
+ */
+uint64_t hashString(const std::string &value)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : value)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Scramble a 64-bit integer (the splitmix64 finalizer), for hashing integer keys.
+ * @param value The value to hash.
+ * @return The hash value.
+ */
+uint64_t mixHash(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Storage interface for the beer records of a BottleApp.
+ *
+ * BottleApp keeps its counters and breakage state itself and delegates
+ * record storage to a BeerStore, so the in-memory vector can be swapped
+ * for a disk-backed engine.
+ */
+class BeerStore
+{
+public:
+    virtual ~BeerStore() {}
+
+    /**
+     * @brief Insert a beer; its id must already be assigned.
+     * @param beer The beer to insert.
+     */
+    virtual void insert(const Beer &beer) = 0;
+
+    /**
+     * @brief Replace the stored beer that has the same id.
+     * @param beer The updated beer.
+     * @return True if a beer with that id was found.
+     */
+    virtual bool update(const Beer &beer) = 0;
+
+    /**
+     * @brief Remove the beer with the given id.
+     * @param id The id of the beer to remove.
+     * @return True if the beer was found and removed.
+     */
+    virtual bool remove(int id) = 0;
+
+    /**
+     * @brief Look up a beer by id.
+     * @param id The id to look up.
+     * @return A copy of the beer, or nothing if it is not stored.
+     */
+    virtual std::optional<Beer> find(int id) const = 0;
+
+    /**
+     * @brief Look up a beer by name.
+     * @param name The name to look up.
+     * @return A copy of the first beer with that name, or nothing.
+     */
+    virtual std::optional<Beer> findByName(const std::string &name) const = 0;
+
+    /**
+     * @brief Get the ids of all beers with the given barcode.
+     * @param barcode The barcode value to look up.
+     * @return The matching ids.
+     */
+    virtual std::vector<int> findByBarcode(long long barcode) const = 0;
+
+    /**
+     * @brief Visit the beers whose ids lie in [fromId, toId], in id order.
+     * @param fromId The first id of the range.
+     * @param toId The last id of the range.
+     * @param visitor Called for each beer in the range.
+     */
+    virtual void scanRange(int fromId, int toId, const std::function<void(const Beer &)> &visitor) const = 0;
+
+    /**
+     * @brief Get the number of stored beers.
+     * @return The number of stored beers.
+     */
+    virtual size_t size() const = 0;
+
+    /**
+     * @brief Write any buffered changes to durable storage.
+     */
+    virtual void flush() {}
+
+    /**
+     * @brief Check whether const methods may run on several threads at once.
+     * @return False unless the store's reads leave no state behind.
+     */
+    virtual bool allowsConcurrentReads() const
+    {
+        return false;
+    }
+
+    /**
+     * @brief Visit one of several disjoint slices of the store, in id order.
+     *
+     * Slice i holds lower ids than slice i + 1, and the slices together
+     * hold every beer. Stores that cannot split cheaply put everything in
+     * slice 0.
+     *
+     * @param slice The slice to visit, in [0, slices).
+     * @param slices The number of slices.
+     * @param visitor Called for each beer in the slice.
+     */
+    virtual void scanSlice(size_t slice, size_t slices, const std::function<void(const Beer &)> &visitor) const
+    {
+        (void)slices;
+        if (slice == 0)
+        {
+            forEach(visitor);
+        }
+    }
+
+    /**
+     * @brief Visit every stored beer in id order.
+     * @param visitor Called for each beer.
+     */
+    void forEach(const std::function<void(const Beer &)> &visitor) const
+    {
+        scanRange(INT_MIN, INT_MAX, visitor);
+    }
+
+    /**
+     * @brief Check whether the store holds no beers.
+     * @return True if the store is empty.
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+};
+
+/**
+ * @brief The default in-memory store backed by a std::vector.
+ */
+class VectorBeerStore : public BeerStore
 {
 private:
-private:
-    bool isBreakageFlagged;
-    std::vector<Beer> beers;
-    std::map<std::string, int> beerCounts;
-    std::vector<std::pair<std::string, int>> flaggedBeers;
-    Breakage breakage;
-    int nextBeerId;
+    std::vector<Beer> beers; // sorted by id; new ids are appended at the end
+
+    std::vector<Beer>::iterator position(int id)
+    {
+        return std::lower_bound(beers.begin(), beers.end(), id, [](const Beer &beer, int key)
+                                { return beer.getId() < key; });
+    }
+
+    std::vector<Beer>::const_iterator position(int id) const
+    {
+        return std::lower_bound(beers.begin(), beers.end(), id, [](const Beer &beer, int key)
+                                { return beer.getId() < key; });
+    }
 
 public:
-    BottleApp() : isBreakageFlagged(false), nextBeerId(1) {}
+    void insert(const Beer &beer) override
+    {
+        if (beers.empty() || beers.back().getId() < beer.getId())
+        {
+            beers.push_back(beer);
+        }
+        else
+        {
+            beers.insert(position(beer.getId()), beer);
+        }
+    }
 
-    void addBeer(Beer &beer)
+    bool update(const Beer &beer) override
     {
-        if (beer.getQuantity() <= 0)
+        auto it = position(beer.getId());
+        if (it == beers.end() || it->getId() != beer.getId())
         {
-            std::cout << "Invalid quantity. Please enter a positive value." << std::endl;
-            return;
+            return false;
         }
-        beer.setId(nextBeerId++);
-        std::string beerName = beer.getName();
-        int quantity = beer.getQuantity();
+        *it = beer;
+        return true;
+    }
 
-        if (beerExists(beerName))
+    bool remove(int id) override
+    {
+        auto it = position(id);
+        if (it == beers.end() || it->getId() != id)
         {
-            std::cout << "Beer with the same name already exists. Please edit the existing entry." << std::endl;
-            return;
+            return false;
         }
+        beers.erase(it);
+        return true;
+    }
 
-        beerCounts[beerName] += quantity;
-        beerCounts["Total"] += quantity;
+    std::optional<Beer> find(int id) const override
+    {
+        auto it = position(id);
+        if (it == beers.end() || it->getId() != id)
+        {
+            return std::nullopt;
+        }
+        return *it;
+    }
 
-        std::cout << quantity << " bottles of " << beerName << " added to stock." << std::endl;
-        beers.push_back(beer);
-        beers.back().updateDate();
+    std::optional<Beer> findByName(const std::string &name) const override
+    {
+        for (const Beer &beer : beers)
+        {
+            if (beer.getName() == name)
+            {
+                return beer;
+            }
+        }
+        return std::nullopt;
+    }
 
-        if (isBreakageFlagged)
+    std::vector<int> findByBarcode(long long barcode) const override
+    {
+        std::vector<int> ids;
+        for (const Beer &beer : beers)
         {
-            std::cout << "Breakage has been flagged while adding beer." << std::endl;
-            flaggedBeers.push_back(std::make_pair(beerName, quantity));
-            breakage.incrementTotalBreakage(quantity);
+            if (beer.getBarcode().getValue() == barcode)
+            {
+                ids.push_back(beer.getId());
+            }
+        }
+        return ids;
+    }
+
+    void scanRange(int fromId, int toId, const std::function<void(const Beer &)> &visitor) const override
+    {
+        for (auto it = position(fromId); it != beers.end() && it->getId() <= toId; ++it)
+        {
+            visitor(*it);
+        }
+    }
+
+    size_t size() const override
+    {
+        return beers.size();
+    }
+
+    bool allowsConcurrentReads() const override
+    {
+        return true;
+    }
+
+    void scanSlice(size_t slice, size_t slices, const std::function<void(const Beer &)> &visitor) const override
+    {
+        size_t end = beers.size() * (slice + 1) / slices;
+        for (size_t i = beers.size() * slice / slices; i < end; ++i)
+        {
+            visitor(beers[i]);
         }
     }
+};
+
+const size_t PAGE_SIZE = 4096;
+
+/**
+ * @brief A file of fixed-size pages addressed by page number.
+ */
+class PageFile
+{
+private:
+    std::fstream file;
 
+public:
     /**
-     * @brief Get a valid 12-digit barcode from the user.
-     * @return The valid barcode.
+     * @brief Open (or create) a page file.
+     * @param path The path of the file.
      */
-    long long getValidBarcode()
+    explicit PageFile(const std::string &path)
     {
-        std::string barcodeStr;
-        while (true)
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open())
         {
-            std::cout << "Enter the barcode value (12 digits): ";
-            std::cin >> barcodeStr;
-            if (barcodeStr.length() == 12 && std::all_of(barcodeStr.begin(), barcodeStr.end(), ::isdigit))
+            std::ofstream create(path, std::ios::binary);
+            create.close();
+            file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        }
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Unable to open storage file " + path);
+        }
+    }
+
+    /**
+     * @brief Get the number of pages currently in the file.
+     * @return The page count.
+     */
+    uint32_t pageCount()
+    {
+        file.clear();
+        file.seekg(0, std::ios::end);
+        return static_cast<uint32_t>(static_cast<size_t>(file.tellg()) / PAGE_SIZE);
+    }
+
+    /**
+     * @brief Read a page; pages past the end of the file read as zeros.
+     * @param pageId The page number.
+     * @param buffer Receives PAGE_SIZE bytes.
+     */
+    void readPage(uint32_t pageId, char *buffer)
+    {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(pageId) * PAGE_SIZE);
+        file.read(buffer, PAGE_SIZE);
+        std::streamsize got = file.gcount();
+        if (got < static_cast<std::streamsize>(PAGE_SIZE))
+        {
+            std::memset(buffer + got, 0, PAGE_SIZE - got);
+        }
+    }
+
+    /**
+     * @brief Write a page.
+     * @param pageId The page number.
+     * @param buffer PAGE_SIZE bytes to write.
+     */
+    void writePage(uint32_t pageId, const char *buffer)
+    {
+        file.clear();
+        file.seekp(static_cast<std::streamoff>(pageId) * PAGE_SIZE);
+        file.write(buffer, PAGE_SIZE);
+    }
+
+    /**
+     * @brief Flush written pages to the operating system.
+     */
+    void sync()
+    {
+        file.flush();
+    }
+};
+
+/**
+ * @brief A fixed-size cache of pages with CLOCK (second chance) eviction.
+ */
+class BufferPool
+{
+private:
+    struct Frame
+    {
+        uint32_t pageId = 0;
+        int pinCount = 0;
+        bool referenced = false;
+        bool dirty = false;
+        bool valid = false;
+        std::unique_ptr<char[]> data;
+    };
+
+    PageFile &file;
+    std::vector<Frame> frames;
+    std::unordered_map<uint32_t, size_t> pageTable;
+    size_t clockHand;
+    uint32_t nextPageId;
+    size_t hits;
+    size_t misses;
+
+    /**
+     * @brief Choose a frame to reuse, writing it back if it is dirty.
+     * @return The index of the free frame.
+     */
+    size_t evict()
+    {
+        // Two full sweeps clear every reference bit, so a third finding
+        // nothing means every frame is pinned.
+        for (size_t step = 0; step < frames.size() * 3; ++step)
+        {
+            Frame &frame = frames[clockHand];
+            size_t index = clockHand;
+            clockHand = (clockHand + 1) % frames.size();
+            if (!frame.valid)
+            {
+                return index;
+            }
+            if (frame.pinCount > 0)
+            {
+                continue;
+            }
+            if (frame.referenced)
+            {
+                frame.referenced = false;
+                continue;
+            }
+            if (frame.dirty)
+            {
+                file.writePage(frame.pageId, frame.data.get());
+            }
+            pageTable.erase(frame.pageId);
+            frame.valid = false;
+            frame.dirty = false;
+            return index;
+        }
+        throw std::runtime_error("Buffer pool exhausted: every page is pinned");
+    }
+
+    /**
+     * @brief Make a page resident and return its frame.
+     * @param pageId The page number.
+     * @param load True to read the page from disk, false to zero it.
+     * @return The index of the frame holding the page.
+     */
+    size_t residentFrame(uint32_t pageId, bool load)
+    {
+        auto it = pageTable.find(pageId);
+        if (it != pageTable.end())
+        {
+            ++hits;
+            return it->second;
+        }
+        ++misses;
+        size_t index = evict();
+        Frame &frame = frames[index];
+        if (load)
+        {
+            file.readPage(pageId, frame.data.get());
+        }
+        else
+        {
+            std::memset(frame.data.get(), 0, PAGE_SIZE);
+        }
+        frame.pageId = pageId;
+        frame.pinCount = 0;
+        frame.dirty = !load;
+        frame.valid = true;
+        pageTable[pageId] = index;
+        return index;
+    }
+
+public:
+    /**
+     * @brief Constructor for BufferPool.
+     * @param file The page file to cache.
+     * @param capacity The number of page frames (at least 16).
+     */
+    BufferPool(PageFile &file, size_t capacity)
+        : file(file), frames(std::max<size_t>(capacity, 16)), clockHand(0), nextPageId(file.pageCount()), hits(0), misses(0)
+    {
+        for (Frame &frame : frames)
+        {
+            frame.data.reset(new char[PAGE_SIZE]);
+        }
+    }
+
+    ~BufferPool()
+    {
+        flushAll();
+    }
+
+    /**
+     * @brief Pin a page in memory.
+     * @param pageId The page number.
+     * @return A pointer to the page bytes, valid until unpin.
+     */
+    char *pin(uint32_t pageId)
+    {
+        Frame &frame = frames[residentFrame(pageId, true)];
+        ++frame.pinCount;
+        frame.referenced = true;
+        return frame.data.get();
+    }
+
+    /**
+     * @brief Release a pin taken by pin.
+     * @param pageId The page number.
+     * @param dirty True if the page was modified.
+     */
+    void unpin(uint32_t pageId, bool dirty)
+    {
+        Frame &frame = frames[pageTable.at(pageId)];
+        --frame.pinCount;
+        frame.dirty = frame.dirty || dirty;
+    }
+
+    /**
+     * @brief Allocate a new zeroed page at the end of the file.
+     * @return The new page number; pin it before use.
+     */
+    uint32_t allocate()
+    {
+        uint32_t pageId = nextPageId++;
+        frames[residentFrame(pageId, false)].referenced = true;
+        return pageId;
+    }
+
+    /**
+     * @brief Read a page into the pool ahead of use without pinning it.
+     * @param pageId The page number.
+     */
+    void prefetch(uint32_t pageId)
+    {
+        if (pageId < nextPageId)
+        {
+            frames[residentFrame(pageId, true)].referenced = true;
+        }
+    }
+
+    /**
+     * @brief Write every dirty page back to the file.
+     * @param last A page to write only after all the others, such as a meta page that points at them.
+     */
+    void flushAll(std::optional<uint32_t> last = std::nullopt)
+    {
+        Frame *lastFrame = nullptr;
+        for (Frame &frame : frames)
+        {
+            if (frame.valid && frame.dirty && last && frame.pageId == *last)
+            {
+                lastFrame = &frame;
+            }
+            else if (frame.valid && frame.dirty)
+            {
+                file.writePage(frame.pageId, frame.data.get());
+                frame.dirty = false;
+            }
+        }
+        file.sync();
+        if (lastFrame)
+        {
+            file.writePage(lastFrame->pageId, lastFrame->data.get());
+            lastFrame->dirty = false;
+            file.sync();
+        }
+    }
+
+    /**
+     * @brief Get the number of frames in the pool.
+     * @return The capacity in pages.
+     */
+    size_t capacity() const
+    {
+        return frames.size();
+    }
+
+    /**
+     * @brief Get the number of page requests served from memory.
+     * @return The hit count.
+     */
+    size_t getHits() const
+    {
+        return hits;
+    }
+
+    /**
+     * @brief Get the number of page requests that went to the file.
+     * @return The miss count.
+     */
+    size_t getMisses() const
+    {
+        return misses;
+    }
+};
+
+/**
+ * @brief Scoped pin on a buffer pool page.
+ */
+class PageGuard
+{
+private:
+    BufferPool &pool;
+    uint32_t pageId;
+    char *data;
+    bool dirty;
+
+public:
+    PageGuard(BufferPool &pool, uint32_t pageId) : pool(pool), pageId(pageId), data(pool.pin(pageId)), dirty(false) {}
+
+    PageGuard(const PageGuard &) = delete;
+    PageGuard &operator=(const PageGuard &) = delete;
+
+    ~PageGuard()
+    {
+        pool.unpin(pageId, dirty);
+    }
+
+    /**
+     * @brief Get the page bytes for reading.
+     * @return The page bytes.
+     */
+    const char *get() const
+    {
+        return data;
+    }
+
+    /**
+     * @brief Get the page bytes for writing and mark the page dirty.
+     * @return The page bytes.
+     */
+    char *getMutable()
+    {
+        dirty = true;
+        return data;
+    }
+
+    /**
+     * @brief Get the page number.
+     * @return The page number.
+     */
+    uint32_t getPageId() const
+    {
+        return pageId;
+    }
+};
+
+/**
+ * @brief A B+tree over unique (key, value) pairs of 64-bit integers.
+ *
+ * Duplicate keys are supported by ordering on the whole pair, which lets the
+ * same tree serve as a primary index (id -> record id) and as a secondary
+ * index (barcode -> id). Deletes do not rebalance: underfull leaves stay in
+ * the leaf chain and are refilled by later inserts.
+ */
+class BPlusTree
+{
+public:
+    struct Entry
+    {
+        int64_t key;
+        int64_t value;
+    };
+
+private:
+    struct NodeHeader
+    {
+        uint16_t type; // LEAF or INTERNAL
+        uint16_t reserved;
+        uint32_t count;
+        uint32_t next;       // right sibling of a leaf, 0 if none
+        uint32_t firstChild; // leftmost child of an internal node
+    };
+
+    struct InternalEntry
+    {
+        Entry separator; // smallest pair in child
+        uint64_t child;
+    };
+
+    static const uint16_t LEAF = 1;
+    static const uint16_t INTERNAL = 2;
+    static const uint32_t LEAF_CAPACITY = (PAGE_SIZE - sizeof(NodeHeader)) / sizeof(Entry);
+    static const uint32_t INTERNAL_CAPACITY = (PAGE_SIZE - sizeof(NodeHeader)) / sizeof(InternalEntry);
+
+    BufferPool &pool;
+    uint32_t root;
+
+    static NodeHeader *header(char *page)
+    {
+        return reinterpret_cast<NodeHeader *>(page);
+    }
+
+    static const NodeHeader *header(const char *page)
+    {
+        return reinterpret_cast<const NodeHeader *>(page);
+    }
+
+    static Entry *leafEntries(char *page)
+    {
+        return reinterpret_cast<Entry *>(page + sizeof(NodeHeader));
+    }
+
+    static const Entry *leafEntries(const char *page)
+    {
+        return reinterpret_cast<const Entry *>(page + sizeof(NodeHeader));
+    }
+
+    static InternalEntry *internalEntries(char *page)
+    {
+        return reinterpret_cast<InternalEntry *>(page + sizeof(NodeHeader));
+    }
+
+    static const InternalEntry *internalEntries(const char *page)
+    {
+        return reinterpret_cast<const InternalEntry *>(page + sizeof(NodeHeader));
+    }
+
+    static bool less(const Entry &a, const Entry &b)
+    {
+        return a.key < b.key || (a.key == b.key && a.value < b.value);
+    }
+
+    /**
+     * @brief Pick the child of an internal node that covers a pair.
+     */
+    static uint32_t childFor(const char *page, const Entry &target)
+    {
+        const NodeHeader *node = header(page);
+        const InternalEntry *entries = internalEntries(page);
+        uint32_t lo = 0, hi = node->count;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (less(target, entries[mid].separator))
+            {
+                hi = mid;
+            }
+            else
+            {
+                lo = mid + 1;
+            }
+        }
+        return lo == 0 ? node->firstChild : static_cast<uint32_t>(entries[lo - 1].child);
+    }
+
+    /**
+     * @brief Find the position of the first leaf entry not less than a pair.
+     */
+    static uint32_t leafLowerBound(const char *page, const Entry &target)
+    {
+        const Entry *entries = leafEntries(page);
+        uint32_t lo = 0, hi = header(page)->count;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (less(entries[mid], target))
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /**
+     * @brief Descend to the leaf that would contain a pair.
+     */
+    uint32_t findLeaf(const Entry &target) const
+    {
+        uint32_t pageId = root;
+        while (true)
+        {
+            PageGuard guard(pool, pageId);
+            if (header(guard.get())->type == LEAF)
+            {
+                return pageId;
+            }
+            pageId = childFor(guard.get(), target);
+        }
+    }
+
+    /**
+     * @brief Insert into a subtree, reporting a split to the caller.
+     * @param pageId The subtree root.
+     * @param entry The pair to insert.
+     * @param splitKey Receives the separator if the node split.
+     * @param splitPage Receives the new right node if the node split.
+     * @return True if the node split.
+     */
+    bool insertInto(uint32_t pageId, const Entry &entry, Entry &splitKey, uint32_t &splitPage)
+    {
+        PageGuard guard(pool, pageId);
+        if (header(guard.get())->type == LEAF)
+        {
+            uint32_t position = leafLowerBound(guard.get(), entry);
+            const Entry *existing = leafEntries(guard.get());
+            if (position < header(guard.get())->count && !less(entry, existing[position]))
+            {
+                return false; // pair already present
+            }
+            char *page = guard.getMutable();
+            NodeHeader *node = header(page);
+            Entry *entries = leafEntries(page);
+            std::memmove(entries + position + 1, entries + position, (node->count - position) * sizeof(Entry));
+            entries[position] = entry;
+            ++node->count;
+            if (node->count < LEAF_CAPACITY)
+            {
+                return false;
+            }
+            uint32_t rightId = pool.allocate();
+            PageGuard right(pool, rightId);
+            char *rightPage = right.getMutable();
+            NodeHeader *rightNode = header(rightPage);
+            uint32_t keep = node->count / 2;
+            rightNode->type = LEAF;
+            rightNode->count = node->count - keep;
+            std::memcpy(leafEntries(rightPage), entries + keep, rightNode->count * sizeof(Entry));
+            rightNode->next = node->next;
+            node->next = rightId;
+            node->count = keep;
+            splitKey = leafEntries(rightPage)[0];
+            splitPage = rightId;
+            return true;
+        }
+
+        uint32_t child = childFor(guard.get(), entry);
+        Entry childSplitKey;
+        uint32_t childSplitPage;
+        if (!insertInto(child, entry, childSplitKey, childSplitPage))
+        {
+            return false;
+        }
+        char *page = guard.getMutable();
+        NodeHeader *node = header(page);
+        InternalEntry *entries = internalEntries(page);
+        uint32_t position = 0;
+        while (position < node->count && !less(childSplitKey, entries[position].separator))
+        {
+            ++position;
+        }
+        std::memmove(entries + position + 1, entries + position, (node->count - position) * sizeof(InternalEntry));
+        entries[position].separator = childSplitKey;
+        entries[position].child = childSplitPage;
+        ++node->count;
+        if (node->count < INTERNAL_CAPACITY)
+        {
+            return false;
+        }
+        uint32_t rightId = pool.allocate();
+        PageGuard right(pool, rightId);
+        char *rightPage = right.getMutable();
+        NodeHeader *rightNode = header(rightPage);
+        uint32_t middle = node->count / 2;
+        rightNode->type = INTERNAL;
+        rightNode->firstChild = static_cast<uint32_t>(entries[middle].child);
+        rightNode->count = node->count - middle - 1;
+        std::memcpy(internalEntries(rightPage), entries + middle + 1, rightNode->count * sizeof(InternalEntry));
+        splitKey = entries[middle].separator;
+        splitPage = rightId;
+        node->count = middle;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Attach to an existing tree.
+     * @param pool The buffer pool holding the tree pages.
+     * @param root The root page number.
+     */
+    BPlusTree(BufferPool &pool, uint32_t root) : pool(pool), root(root) {}
+
+    /**
+     * @brief Create an empty tree and return its root page number.
+     * @param pool The buffer pool to allocate from.
+     * @return The root page number of the new tree.
+     */
+    static uint32_t create(BufferPool &pool)
+    {
+        uint32_t pageId = pool.allocate();
+        PageGuard guard(pool, pageId);
+        header(guard.getMutable())->type = LEAF;
+        return pageId;
+    }
+
+    /**
+     * @brief Get the current root page number (changes when the root splits).
+     * @return The root page number.
+     */
+    uint32_t getRoot() const
+    {
+        return root;
+    }
+
+    /**
+     * @brief Insert a (key, value) pair; inserting an existing pair is a no-op.
+     * @param key The key.
+     * @param value The value.
+     */
+    void insert(int64_t key, int64_t value)
+    {
+        Entry splitKey;
+        uint32_t splitPage;
+        if (!insertInto(root, Entry{key, value}, splitKey, splitPage))
+        {
+            return;
+        }
+        uint32_t newRoot = pool.allocate();
+        PageGuard guard(pool, newRoot);
+        char *page = guard.getMutable();
+        header(page)->type = INTERNAL;
+        header(page)->firstChild = root;
+        header(page)->count = 1;
+        internalEntries(page)[0].separator = splitKey;
+        internalEntries(page)[0].child = splitPage;
+        root = newRoot;
+    }
+
+    /**
+     * @brief Remove a (key, value) pair.
+     * @param key The key.
+     * @param value The value.
+     * @return True if the pair was present.
+     */
+    bool erase(int64_t key, int64_t value)
+    {
+        Entry target{key, value};
+        PageGuard guard(pool, findLeaf(target));
+        uint32_t position = leafLowerBound(guard.get(), target);
+        const Entry *existing = leafEntries(guard.get());
+        if (position >= header(guard.get())->count || less(target, existing[position]))
+        {
+            return false;
+        }
+        char *page = guard.getMutable();
+        NodeHeader *node = header(page);
+        Entry *entries = leafEntries(page);
+        std::memmove(entries + position, entries + position + 1, (node->count - position - 1) * sizeof(Entry));
+        --node->count;
+        return true;
+    }
+
+    /**
+     * @brief Visit the pairs with keys in [fromKey, toKey] one leaf at a time.
+     *
+     * The next leaf is prefetched before the current batch is handed out, so
+     * the visitor's own reads overlap with walking the leaf chain.
+     *
+     * @param fromKey The first key of the range.
+     * @param toKey The last key of the range.
+     * @param visitor Called with each leaf's matching pairs; return false to stop.
+     */
+    void scanLeaves(int64_t fromKey, int64_t toKey, const std::function<bool(const std::vector<Entry> &)> &visitor) const
+    {
+        Entry start{fromKey, INT64_MIN};
+        uint32_t pageId = findLeaf(start);
+        std::vector<Entry> batch;
+        bool first = true;
+        while (pageId != 0)
+        {
+            uint32_t next;
+            bool done = false;
+            batch.clear();
+            {
+                PageGuard guard(pool, pageId);
+                const NodeHeader *node = header(guard.get());
+                const Entry *entries = leafEntries(guard.get());
+                uint32_t position = first ? leafLowerBound(guard.get(), start) : 0;
+                for (; position < node->count; ++position)
+                {
+                    if (entries[position].key > toKey)
+                    {
+                        done = true;
+                        break;
+                    }
+                    batch.push_back(entries[position]);
+                }
+                next = node->next;
+            }
+            first = false;
+            if (!done && next != 0)
+            {
+                pool.prefetch(next);
+            }
+            if ((!batch.empty() && !visitor(batch)) || done)
+            {
+                return;
+            }
+            pageId = next;
+        }
+    }
+
+    /**
+     * @brief Get every value stored under a key.
+     * @param key The key.
+     * @return The values in ascending order.
+     */
+    std::vector<int64_t> findAll(int64_t key) const
+    {
+        std::vector<int64_t> values;
+        scanLeaves(key, key, [&values](const std::vector<Entry> &batch)
+                   {
+                       for (const Entry &entry : batch)
+                       {
+                           values.push_back(entry.value);
+                       }
+                       return true; });
+        return values;
+    }
+};
+
+/**
+ * @brief A disk-backed store: records in slotted heap pages, a B+tree on id,
+ * and secondary B+trees on barcode and name hash, all cached by one
+ * BufferPool so the catalogue can be larger than memory.
+ *
+ * Page 0 is a meta page holding the tree roots and the heap tail. An
+ * updated record is rewritten in its slot when it still fits and moved
+ * otherwise. Removed and moved records free their slot and bytes; pages
+ * with freed space are remembered (since the store was opened) and
+ * compacted to take new records before the heap grows.
+ */
+class BTreeBeerStore : public BeerStore
+{
+private:
+    struct MetaPage
+    {
+        uint64_t magic;
+        uint32_t primaryRoot;
+        uint32_t barcodeRoot;
+        uint32_t nameRoot;
+        uint32_t heapTail;
+        uint64_t recordCount;
+    };
+
+    struct HeapHeader
+    {
+        uint32_t slotCount;
+        uint32_t freeEnd; // records are packed downwards from the page end
+    };
+
+    struct Slot
+    {
+        uint16_t offset;
+        uint16_t length; // 0 marks a removed record
+    };
+
+    static const uint64_t MAGIC = 0x31544545524254ULL; // "BTREET1"
+
+    std::unique_ptr<PageFile> file;
+    std::unique_ptr<BufferPool> pool;
+    std::unique_ptr<BPlusTree> primary; // id -> record id
+    std::unique_ptr<BPlusTree> byBarcode; // barcode -> id
+    std::unique_ptr<BPlusTree> byName;    // name hash -> id
+    uint32_t heapTail;
+    uint64_t recordCount;
+    std::set<uint32_t> pagesWithSpace; // heap pages with freed bytes
+
+    static int64_t makeRid(uint32_t pageId, uint32_t slot)
+    {
+        return (static_cast<int64_t>(pageId) << 16) | slot;
+    }
+
+    static uint32_t ridPage(int64_t rid)
+    {
+        return static_cast<uint32_t>(rid >> 16);
+    }
+
+    static uint32_t ridSlot(int64_t rid)
+    {
+        return static_cast<uint32_t>(rid & 0xFFFF);
+    }
+
+    static HeapHeader *heapHeader(char *page)
+    {
+        return reinterpret_cast<HeapHeader *>(page);
+    }
+
+    static const HeapHeader *heapHeader(const char *page)
+    {
+        return reinterpret_cast<const HeapHeader *>(page);
+    }
+
+    static Slot *heapSlots(char *page)
+    {
+        return reinterpret_cast<Slot *>(page + sizeof(HeapHeader));
+    }
+
+    static const Slot *heapSlots(const char *page)
+    {
+        return reinterpret_cast<const Slot *>(page + sizeof(HeapHeader));
+    }
+
+    /**
+     * @brief Get the slot a new record would take: the first removed one, or a new one at the end.
+     */
+    static uint32_t freeSlot(const char *page)
+    {
+        const HeapHeader *heap = heapHeader(page);
+        const Slot *slots = heapSlots(page);
+        for (uint32_t i = 0; i < heap->slotCount; ++i)
+        {
+            if (slots[i].length == 0)
+            {
+                return i;
+            }
+        }
+        return heap->slotCount;
+    }
+
+    /**
+     * @brief Check whether a record fits in the gap between a page's slots and its records.
+     */
+    static bool fits(const char *page, size_t size)
+    {
+        const HeapHeader *heap = heapHeader(page);
+        uint32_t slot = freeSlot(page);
+        size_t slotsEnd = sizeof(HeapHeader) + std::max(heap->slotCount, slot + 1) * sizeof(Slot);
+        return slot < 0xFFFF && slotsEnd + size <= heap->freeEnd;
+    }
+
+    /**
+     * @brief Pack the live records of a heap page against its end, so the
+     * bytes of removed and shrunk records join the free gap.
+     */
+    static void compact(char *page)
+    {
+        HeapHeader *heap = heapHeader(page);
+        Slot *slots = heapSlots(page);
+        std::vector<char> copy(page, page + PAGE_SIZE);
+        uint32_t freeEnd = PAGE_SIZE;
+        for (uint32_t i = 0; i < heap->slotCount; ++i)
+        {
+            if (slots[i].length != 0)
+            {
+                freeEnd -= slots[i].length;
+                std::memcpy(page + freeEnd, copy.data() + slots[i].offset, slots[i].length);
+                slots[i].offset = static_cast<uint16_t>(freeEnd);
+            }
+        }
+        heap->freeEnd = freeEnd;
+        while (heap->slotCount > 0 && slots[heap->slotCount - 1].length == 0)
+        {
+            --heap->slotCount;
+        }
+    }
+
+    /**
+     * @brief Store a record in the heap: in the tail page, else in a page
+     * with freed space, else in a new tail page.
+     * @return The record id.
+     */
+    int64_t writeRecord(const std::string &record)
+    {
+        if (record.size() > PAGE_SIZE - sizeof(HeapHeader) - sizeof(Slot))
+        {
+            throw std::length_error("Beer record does not fit in a storage page");
+        }
+        if (heapTail != 0)
+        {
+            PageGuard guard(*pool, heapTail);
+            if (fits(guard.get(), record.size()))
+            {
+                return placeRecord(guard, record);
+            }
+        }
+        for (auto it = pagesWithSpace.begin(); it != pagesWithSpace.end();)
+        {
+            PageGuard guard(*pool, *it);
+            if (!fits(guard.get(), record.size()))
+            {
+                compact(guard.getMutable());
+            }
+            if (fits(guard.get(), record.size()))
+            {
+                return placeRecord(guard, record);
+            }
+            it = pagesWithSpace.erase(it); // what is left is too small to use
+        }
+        heapTail = pool->allocate();
+        PageGuard guard(*pool, heapTail);
+        heapHeader(guard.getMutable())->freeEnd = PAGE_SIZE;
+        return placeRecord(guard, record);
+    }
+
+    int64_t placeRecord(PageGuard &guard, const std::string &record)
+    {
+        char *page = guard.getMutable();
+        HeapHeader *heap = heapHeader(page);
+        Slot *slots = heapSlots(page);
+        uint32_t slot = freeSlot(page);
+        heap->freeEnd -= static_cast<uint32_t>(record.size());
+        std::memcpy(page + heap->freeEnd, record.data(), record.size());
+        slots[slot].offset = static_cast<uint16_t>(heap->freeEnd);
+        slots[slot].length = static_cast<uint16_t>(record.size());
+        heap->slotCount = std::max(heap->slotCount, slot + 1);
+        return makeRid(guard.getPageId(), slot);
+    }
+
+    std::optional<Beer> readRecord(int64_t rid) const
+    {
+        PageGuard guard(*pool, ridPage(rid));
+        if (ridSlot(rid) >= heapHeader(guard.get())->slotCount)
+        {
+            return std::nullopt;
+        }
+        const Slot &slot = heapSlots(guard.get())[ridSlot(rid)];
+        if (slot.length == 0 || slot.offset < sizeof(HeapHeader) || slot.offset + slot.length > PAGE_SIZE)
+        {
+            return std::nullopt;
+        }
+        return deserializeBeer(guard.get() + slot.offset, slot.length);
+    }
+
+    void clearRecord(int64_t rid)
+    {
+        PageGuard guard(*pool, ridPage(rid));
+        if (ridSlot(rid) < heapHeader(guard.get())->slotCount)
+        {
+            heapSlots(guard.getMutable())[ridSlot(rid)].length = 0;
+            pagesWithSpace.insert(ridPage(rid));
+        }
+    }
+
+    /**
+     * @brief Overwrite a record in its slot if the new one is no longer.
+     * @return True if it was rewritten in place.
+     */
+    bool rewriteRecord(int64_t rid, const std::string &record)
+    {
+        PageGuard guard(*pool, ridPage(rid));
+        if (ridSlot(rid) >= heapHeader(guard.get())->slotCount || record.size() > heapSlots(guard.get())[ridSlot(rid)].length)
+        {
+            return false;
+        }
+        char *page = guard.getMutable();
+        Slot &slot = heapSlots(page)[ridSlot(rid)];
+        std::memcpy(page + slot.offset, record.data(), record.size());
+        if (record.size() < slot.length)
+        {
+            slot.length = static_cast<uint16_t>(record.size());
+            pagesWithSpace.insert(ridPage(rid));
+        }
+        return true;
+    }
+
+    std::optional<int64_t> ridFor(int id) const
+    {
+        std::vector<int64_t> rids = primary->findAll(id);
+        if (rids.empty())
+        {
+            return std::nullopt;
+        }
+        return rids.front();
+    }
+
+    void writeMeta()
+    {
+        PageGuard guard(*pool, 0);
+        MetaPage *meta = reinterpret_cast<MetaPage *>(guard.getMutable());
+        meta->magic = MAGIC;
+        meta->primaryRoot = primary->getRoot();
+        meta->barcodeRoot = byBarcode->getRoot();
+        meta->nameRoot = byName->getRoot();
+        meta->heapTail = heapTail;
+        meta->recordCount = recordCount;
+    }
+
+public:
+    /**
+     * @brief Open (or create) a B+tree store.
+     * @param path The path of the storage file.
+     * @param poolPages The number of 4 KiB pages the buffer pool may cache.
+     */
+    BTreeBeerStore(const std::string &path, size_t poolPages)
+        : file(new PageFile(path)), heapTail(0), recordCount(0)
+    {
+        bool fresh = file->pageCount() == 0;
+        pool.reset(new BufferPool(*file, poolPages));
+        if (fresh)
+        {
+            pool->allocate(); // page 0 holds the meta page
+            primary.reset(new BPlusTree(*pool, BPlusTree::create(*pool)));
+            byBarcode.reset(new BPlusTree(*pool, BPlusTree::create(*pool)));
+            byName.reset(new BPlusTree(*pool, BPlusTree::create(*pool)));
+            writeMeta();
+            return;
+        }
+        PageGuard guard(*pool, 0);
+        const MetaPage *meta = reinterpret_cast<const MetaPage *>(guard.get());
+        if (meta->magic != MAGIC)
+        {
+            throw std::runtime_error("Not a beer storage file: " + path);
+        }
+        primary.reset(new BPlusTree(*pool, meta->primaryRoot));
+        byBarcode.reset(new BPlusTree(*pool, meta->barcodeRoot));
+        byName.reset(new BPlusTree(*pool, meta->nameRoot));
+        heapTail = meta->heapTail;
+        recordCount = meta->recordCount;
+    }
+
+    ~BTreeBeerStore()
+    {
+        flush();
+    }
+
+    void insert(const Beer &beer) override
+    {
+        std::string record;
+        serializeBeer(beer, record);
+        int64_t rid = writeRecord(record);
+        primary->insert(beer.getId(), rid);
+        byBarcode->insert(beer.getBarcode().getValue(), beer.getId());
+        byName->insert(static_cast<int64_t>(hashString(beer.getName())), beer.getId());
+        ++recordCount;
+    }
+
+    bool update(const Beer &beer) override
+    {
+        std::optional<int64_t> rid = ridFor(beer.getId());
+        if (!rid)
+        {
+            return false;
+        }
+        std::optional<Beer> old = readRecord(*rid);
+        std::string record;
+        serializeBeer(beer, record);
+        if (!rewriteRecord(*rid, record))
+        {
+            clearRecord(*rid);
+            int64_t moved = writeRecord(record);
+            primary->erase(beer.getId(), *rid);
+            primary->insert(beer.getId(), moved);
+        }
+        if (old && old->getBarcode().getValue() != beer.getBarcode().getValue())
+        {
+            byBarcode->erase(old->getBarcode().getValue(), beer.getId());
+            byBarcode->insert(beer.getBarcode().getValue(), beer.getId());
+        }
+        if (old && old->getName() != beer.getName())
+        {
+            byName->erase(static_cast<int64_t>(hashString(old->getName())), beer.getId());
+            byName->insert(static_cast<int64_t>(hashString(beer.getName())), beer.getId());
+        }
+        return true;
+    }
+
+    bool remove(int id) override
+    {
+        std::optional<int64_t> rid = ridFor(id);
+        if (!rid)
+        {
+            return false;
+        }
+        std::optional<Beer> old = readRecord(*rid);
+        if (old)
+        {
+            byBarcode->erase(old->getBarcode().getValue(), id);
+            byName->erase(static_cast<int64_t>(hashString(old->getName())), id);
+        }
+        primary->erase(id, *rid);
+        clearRecord(*rid);
+        --recordCount;
+        return true;
+    }
+
+    std::optional<Beer> find(int id) const override
+    {
+        std::optional<int64_t> rid = ridFor(id);
+        if (!rid)
+        {
+            return std::nullopt;
+        }
+        return readRecord(*rid);
+    }
+
+    std::optional<Beer> findByName(const std::string &name) const override
+    {
+        for (int64_t id : byName->findAll(static_cast<int64_t>(hashString(name))))
+        {
+            std::optional<Beer> beer = find(static_cast<int>(id));
+            if (beer && beer->getName() == name)
+            {
+                return beer;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::vector<int> findByBarcode(long long barcode) const override
+    {
+        std::vector<int> ids;
+        for (int64_t id : byBarcode->findAll(barcode))
+        {
+            ids.push_back(static_cast<int>(id));
+        }
+        return ids;
+    }
+
+    void scanRange(int fromId, int toId, const std::function<void(const Beer &)> &visitor) const override
+    {
+        size_t readAhead = pool->capacity() / 4;
+        primary->scanLeaves(fromId, toId, [&](const std::vector<BPlusTree::Entry> &batch)
+                            {
+                                // Read the heap pages behind this leaf in file order
+                                // before decoding, bounded so they cannot evict each other.
+                                std::vector<uint32_t> pages;
+                                for (const BPlusTree::Entry &entry : batch)
+                                {
+                                    pages.push_back(ridPage(entry.value));
+                                }
+                                std::sort(pages.begin(), pages.end());
+                                pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+                                for (size_t i = 0; i < pages.size() && i < readAhead; ++i)
+                                {
+                                    pool->prefetch(pages[i]);
+                                }
+                                for (const BPlusTree::Entry &entry : batch)
+                                {
+                                    std::optional<Beer> beer = readRecord(entry.value);
+                                    if (beer)
+                                    {
+                                        visitor(*beer);
+                                    }
+                                }
+                                return true; });
+    }
+
+    size_t size() const override
+    {
+        return static_cast<size_t>(recordCount);
+    }
+
+    void flush() override
+    {
+        writeMeta();
+        pool->flushAll(0); // the meta page last, so it never points at pages not yet written
+    }
+
+    /**
+     * @brief Get the buffer pool, e.g. to report its hit rate.
+     * @return The buffer pool.
+     */
+    const BufferPool &getBufferPool() const
+    {
+        return *pool;
+    }
+};
+
+/**
+ * @brief A store that splits each beer into a hot and a cold tier.
+ *
+ * The hot tier (id, barcode, quantity, ABV, size and a name hash) stays in
+ * memory in id order. The cold tier (style, name, updated date) is kept in
+ * memory only while it is being used: once more than maxResidentCold cold
+ * records are resident, the least recently used ones are written to a spill
+ * file and reloaded lazily the next time the full beer is needed. Delisted
+ * SKUs (quantity 0) are evicted before anything that is still in stock.
+ */
+class TieredBeerStore : public BeerStore
+{
+public:
+    /**
+     * @brief The always-resident part of a beer.
+     */
+    struct HotRecord
+    {
+        int id;
+        int quantity;
+        long long barcode;
+        double alcoholContent;
+        int size;
+        bool isMetric;
+        uint64_t nameHash;
+        int64_t coldOffset;   // position in the spill file, -1 if never written
+        uint32_t coldLength;  // length of the spilled cold record
+    };
+
+private:
+    struct ColdRecord
+    {
+        std::string style;
+        std::string name;
+        std::string updatedDate;
+        bool dirty; // changed since it was last written to the spill file
+        std::list<int> *queue = nullptr; // idleCold or activeCold
+        std::list<int>::iterator position;
+    };
+
+    static const uint32_t SPILL_GRAIN = 32; // extents are whole grains, so a freed one fits later records
+
+    mutable std::vector<HotRecord> hot; // sorted by id; eviction bookkeeping changes on reads
+    mutable std::unordered_map<int, ColdRecord> cold; // resident cold records
+    mutable std::list<int> idleCold;   // ids of resident cold records of delisted beers, least recently used first
+    mutable std::list<int> activeCold; // the same for beers in stock
+    mutable std::map<uint32_t, std::vector<int64_t>> freeExtents; // extent size -> offsets of unused spill extents
+    mutable std::fstream spill;
+    mutable int64_t spillEnd;
+    mutable size_t coldLoads;
+    size_t maxResidentCold;
+
+    static uint32_t extentSize(uint32_t length)
+    {
+        return (length + SPILL_GRAIN - 1) / SPILL_GRAIN * SPILL_GRAIN;
+    }
+
+    /**
+     * @brief Hand a record's spill extent back for reuse.
+     */
+    void releaseExtent(const HotRecord &record) const
+    {
+        if (record.coldOffset >= 0)
+        {
+            freeExtents[extentSize(record.coldLength)].push_back(record.coldOffset);
+        }
+    }
+
+    /**
+     * @brief Make a cold record resident as the most recently used of its queue.
+     */
+    ColdRecord &makeResident(int id, ColdRecord record, bool inStock) const
+    {
+        dropResident(id);
+        std::list<int> &queue = inStock ? activeCold : idleCold;
+        record.queue = &queue;
+        record.position = queue.insert(queue.end(), id);
+        return cold.emplace(id, std::move(record)).first->second;
+    }
+
+    void dropResident(int id) const
+    {
+        auto it = cold.find(id);
+        if (it != cold.end())
+        {
+            it->second.queue->erase(it->second.position);
+            cold.erase(it);
+        }
+    }
+
+    std::vector<HotRecord>::iterator hotFor(int id) const
+    {
+        auto it = std::lower_bound(hot.begin(), hot.end(), id, [](const HotRecord &record, int key)
+                                   { return record.id < key; });
+        return (it != hot.end() && it->id == id) ? it : hot.end();
+    }
+
+    /**
+     * @brief Get the cold record of a beer, reading it from the spill file if needed.
+     */
+    ColdRecord &coldFor(const HotRecord &record) const
+    {
+        auto it = cold.find(record.id);
+        if (it != cold.end())
+        {
+            ColdRecord &resident = it->second;
+            resident.queue->splice(resident.queue->end(), *resident.queue, resident.position);
+            return resident;
+        }
+        std::string bytes(record.coldLength, '\0');
+        spill.clear();
+        spill.seekg(record.coldOffset);
+        spill.read(&bytes[0], record.coldLength);
+        const char *cursor = bytes.data();
+        const char *end = cursor + bytes.size();
+        ColdRecord loaded{"", "", "", false, nullptr, {}};
+        if (!readString(cursor, end, loaded.style) || !readString(cursor, end, loaded.name) ||
+            !readString(cursor, end, loaded.updatedDate))
+        {
+            throw std::runtime_error("Corrupt cold record for beer " + std::to_string(record.id));
+        }
+        ++coldLoads;
+        return makeResident(record.id, std::move(loaded), record.quantity > 0);
+    }
+
+    Beer assemble(HotRecord &record) const
+    {
+        const ColdRecord &coldRecord = coldFor(record);
+        Beer beer(coldRecord.style, coldRecord.name, record.alcoholContent, ContainerSize(record.isMetric, record.size),
+                  record.quantity, record.barcode);
+        beer.setId(record.id);
+        beer.setUpdatedDate(coldRecord.updatedDate);
+        return beer;
+    }
+
+    static HotRecord makeHot(const Beer &beer)
+    {
+        return HotRecord{beer.getId(), beer.getQuantity(), beer.getBarcode().getValue(), beer.getAlcoholContent(),
+                         beer.getContainerSize().getSize(), beer.getContainerSize().getIsMetric(),
+                         hashString(beer.getName()), -1, 0};
+    }
+
+    /**
+     * @brief Evict cold records once the resident budget is exceeded.
+     */
+    void enforceBudget() const
+    {
+        if (cold.size() > maxResidentCold)
+        {
+            // Evict down to 3/4 of the budget so the spill writes are batched.
+            evictCold(maxResidentCold - maxResidentCold / 4);
+        }
+    }
+
+public:
+    /**
+     * @brief Constructor for TieredBeerStore.
+     * @param spillPath The file evicted cold records are written to (truncated on open).
+     * @param maxResidentCold The number of cold records kept in memory.
+     */
+    TieredBeerStore(const std::string &spillPath, size_t maxResidentCold)
+        : spillEnd(0), coldLoads(0), maxResidentCold(std::max<size_t>(maxResidentCold, 1))
+    {
+        spill.open(spillPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!spill.is_open())
+        {
+            throw std::runtime_error("Unable to open spill file " + spillPath);
+        }
+    }
+
+    void insert(const Beer &beer) override
+    {
+        HotRecord record = makeHot(beer);
+        auto position = std::lower_bound(hot.begin(), hot.end(), record.id, [](const HotRecord &existing, int key)
+                                         { return existing.id < key; });
+        hot.insert(position, record);
+        makeResident(beer.getId(), ColdRecord{beer.getStyle(), beer.getName(), beer.getUpdatedDate(), true, nullptr, {}},
+                     beer.getQuantity() > 0);
+        enforceBudget();
+    }
+
+    bool update(const Beer &beer) override
+    {
+        auto it = hotFor(beer.getId());
+        if (it == hot.end())
+        {
+            return false;
+        }
+        HotRecord record = makeHot(beer);
+        record.coldOffset = it->coldOffset;
+        record.coldLength = it->coldLength;
+        *it = record;
+        makeResident(beer.getId(), ColdRecord{beer.getStyle(), beer.getName(), beer.getUpdatedDate(), true, nullptr, {}},
+                     beer.getQuantity() > 0);
+        enforceBudget();
+        return true;
+    }
+
+    bool remove(int id) override
+    {
+        auto it = hotFor(id);
+        if (it == hot.end())
+        {
+            return false;
+        }
+        releaseExtent(*it);
+        hot.erase(it);
+        dropResident(id);
+        return true;
+    }
+
+    std::optional<Beer> find(int id) const override
+    {
+        auto it = hotFor(id);
+        if (it == hot.end())
+        {
+            return std::nullopt;
+        }
+        Beer beer = assemble(*it);
+        enforceBudget();
+        return beer;
+    }
+
+    std::optional<Beer> findByName(const std::string &name) const override
+    {
+        uint64_t nameHash = hashString(name);
+        for (HotRecord &record : hot)
+        {
+            if (record.nameHash == nameHash)
+            {
+                Beer beer = assemble(record);
+                enforceBudget();
+                if (beer.getName() == name)
+                {
+                    return beer;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::vector<int> findByBarcode(long long barcode) const override
+    {
+        std::vector<int> ids;
+        for (const HotRecord &record : hot)
+        {
+            if (record.barcode == barcode)
+            {
+                ids.push_back(record.id);
+            }
+        }
+        return ids;
+    }
+
+    void scanRange(int fromId, int toId, const std::function<void(const Beer &)> &visitor) const override
+    {
+        auto it = std::lower_bound(hot.begin(), hot.end(), fromId, [](const HotRecord &record, int key)
+                                   { return record.id < key; });
+        for (; it != hot.end() && it->id <= toId; ++it)
+        {
+            visitor(assemble(*it));
+            enforceBudget();
+        }
+    }
+
+    size_t size() const override
+    {
+        return hot.size();
+    }
+
+    void flush() override
+    {
+        spill.flush();
+    }
+
+    /**
+     * @brief Visit the hot tier only, without touching any cold record.
+     * @param visitor Called for each hot record in id order.
+     */
+    void forEachHot(const std::function<void(const HotRecord &)> &visitor) const
+    {
+        for (const HotRecord &record : hot)
+        {
+            visitor(record);
+        }
+    }
+
+    /**
+     * @brief Write cold records to the spill file until at most keepResident remain.
+     *
+     * Delisted SKUs (quantity 0) go first, then the least recently used; each
+     * comes off the front of its queue, so an eviction costs no scan. A
+     * rewritten record stays in its extent if it still fits, and otherwise
+     * takes a freed extent of its size before the file grows.
+     *
+     * @param keepResident The number of cold records to keep in memory.
+     * @return The number of records evicted.
+     */
+    size_t evictCold(size_t keepResident) const
+    {
+        if (cold.size() <= keepResident)
+        {
+            return 0;
+        }
+        size_t toEvict = cold.size() - keepResident;
+        spill.clear();
+        for (size_t n = 0; n < toEvict; ++n)
+        {
+            int id = idleCold.empty() ? activeCold.front() : idleCold.front();
+            HotRecord &record = *hotFor(id);
+            const ColdRecord &coldRecord = cold.at(id);
+            if (coldRecord.dirty || record.coldOffset < 0)
+            {
+                std::string bytes;
+                appendString(bytes, coldRecord.style);
+                appendString(bytes, coldRecord.name);
+                appendString(bytes, coldRecord.updatedDate);
+                uint32_t length = static_cast<uint32_t>(bytes.size());
+                if (record.coldOffset < 0 || extentSize(length) != extentSize(record.coldLength))
+                {
+                    releaseExtent(record);
+                    std::vector<int64_t> &reusable = freeExtents[extentSize(length)];
+                    if (reusable.empty())
+                    {
+                        record.coldOffset = spillEnd;
+                        spillEnd += extentSize(length);
+                    }
+                    else
+                    {
+                        record.coldOffset = reusable.back();
+                        reusable.pop_back();
+                    }
+                }
+                record.coldLength = length;
+                spill.seekp(record.coldOffset);
+                spill.write(bytes.data(), bytes.size());
+            }
+            dropResident(id);
+        }
+        spill.flush();
+        return toEvict;
+    }
+
+    /**
+     * @brief Get the number of cold records currently held in memory.
+     * @return The resident cold record count.
+     */
+    size_t getResidentColdCount() const
+    {
+        return cold.size();
+    }
+
+    /**
+     * @brief Get the number of cold records read back from the spill file.
+     * @return The cold load count.
+     */
+    size_t getColdLoads() const
+    {
+        return coldLoads;
+    }
+};
+
+/**
+ * @brief Append an unsigned LEB128 varint to a buffer.
+ * @param out The buffer to append to.
+ * @param value The value to append.
+ */
+void appendVarint(std::string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint and advance the cursor.
+ * @param cursor The read position, advanced past the varint.
+ * @param end One past the last readable byte.
+ * @param value Receives the value.
+ * @return True if the varint was complete.
+ */
+bool readVarint(const char *&cursor, const char *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; cursor < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*cursor++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Map a signed value to an unsigned one so small magnitudes stay small.
+ */
+uint64_t zigzagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+/**
+ * @brief Undo zigzagEncode.
+ */
+int64_t zigzagDecode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/**
+ * @brief Append values bit-packed at the width of the largest one.
+ * @param out The buffer to append to (a width byte, then the packed bits).
+ * @param values The values to pack.
+ */
+void appendBitPacked(std::string &out, const std::vector<uint64_t> &values)
+{
+    uint64_t all = 0;
+    for (uint64_t value : values)
+    {
+        all |= value;
+    }
+    int width = 0;
+    while (width < 64 && (all >> width) != 0)
+    {
+        ++width;
+    }
+    out.push_back(static_cast<char>(width));
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for (uint64_t value : values)
+    {
+        for (int bit = 0; bit < width;)
+        {
+            int take = std::min(width - bit, 64 - buffered);
+            uint64_t mask = take == 64 ? ~0ULL : ((1ULL << take) - 1);
+            buffer |= ((value >> bit) & mask) << buffered;
+            buffered += take;
+            bit += take;
+            if (buffered == 64)
+            {
+                appendPod(out, buffer);
+                buffer = 0;
+                buffered = 0;
+            }
+        }
+    }
+    for (; buffered > 0; buffered -= 8)
+    {
+        out.push_back(static_cast<char>(buffer & 0xFF));
+        buffer >>= 8;
+    }
+}
+
+/**
+ * @brief Read values written by appendBitPacked.
+ * @param cursor The read position, advanced past the packed values.
+ * @param end One past the last readable byte.
+ * @param count The number of values to read.
+ * @param values Receives the values.
+ * @return True if enough bytes were available.
+ */
+bool readBitPacked(const char *&cursor, const char *end, size_t count, std::vector<uint64_t> &values)
+{
+    if (cursor >= end)
+    {
+        return false;
+    }
+    int width = static_cast<uint8_t>(*cursor++);
+    size_t bytes = (count * width + 7) / 8;
+    if (width > 64 || static_cast<size_t>(end - cursor) < bytes)
+    {
+        return false;
+    }
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(cursor);
+    uint64_t mask = width == 64 ? ~0ULL : ((1ULL << width) - 1);
+    values.resize(count);
+    size_t bitPosition = 0;
+    for (size_t i = 0; i < count; ++i, bitPosition += width)
+    {
+        size_t byte = bitPosition >> 3;
+        int offset = static_cast<int>(bitPosition & 7);
+        uint64_t word = 0;
+        std::memcpy(&word, data + byte, std::min<size_t>(8, bytes - byte));
+        uint64_t value = word >> offset;
+        if (width + offset > 64)
+        {
+            value |= static_cast<uint64_t>(data[byte + 8]) << (64 - offset);
+        }
+        values[i] = value & mask;
+    }
+    cursor += bytes;
+    return true;
+}
+
+/**
+ * @brief Compress a buffer with the built-in LZ77 block codec.
+ *
+ * The format follows LZ4's sequence layout: a token byte holding the literal
+ * and match lengths (15 meaning "more length bytes follow"), the literals, a
+ * 16-bit match offset and any extra match length. The final sequence has
+ * literals only.
+ *
+ * @param input The bytes to compress (at most 4 GiB).
+ * @return The compressed bytes.
+ */
+std::string lzCompress(const std::string &input)
+{
+    const size_t MIN_MATCH = 4;
+    const int HASH_BITS = 14;
+    std::string out;
+    out.reserve(input.size() / 2 + 16);
+    std::vector<uint32_t> table(1u << HASH_BITS, UINT32_MAX);
+    const char *base = input.data();
+    size_t length = input.size();
+    size_t anchor = 0;
+    size_t position = 0;
+
+    auto appendLength = [&out](size_t value)
+    {
+        for (; value >= 255; value -= 255)
+        {
+            out.push_back(static_cast<char>(255));
+        }
+        out.push_back(static_cast<char>(value));
+    };
+    auto emit = [&](size_t literalEnd, size_t offset, size_t matchLength)
+    {
+        size_t literals = literalEnd - anchor;
+        uint8_t token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+        if (matchLength > 0)
+        {
+            token |= static_cast<uint8_t>(std::min<size_t>(matchLength - MIN_MATCH, 15));
+        }
+        out.push_back(static_cast<char>(token));
+        if (literals >= 15)
+        {
+            appendLength(literals - 15);
+        }
+        out.append(base + anchor, literals);
+        if (matchLength > 0)
+        {
+            appendPod<uint16_t>(out, static_cast<uint16_t>(offset));
+            if (matchLength - MIN_MATCH >= 15)
+            {
+                appendLength(matchLength - MIN_MATCH - 15);
+            }
+        }
+    };
+
+    while (length >= MIN_MATCH && position + MIN_MATCH <= length)
+    {
+        uint32_t sequence;
+        std::memcpy(&sequence, base + position, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(position);
+        uint32_t found;
+        if (candidate != UINT32_MAX && position - candidate <= 0xFFFF &&
+            (std::memcpy(&found, base + candidate, sizeof(found)), found == sequence))
+        {
+            size_t matchLength = MIN_MATCH;
+            while (position + matchLength < length && base[candidate + matchLength] == base[position + matchLength])
+            {
+                ++matchLength;
+            }
+            emit(position, position - candidate, matchLength);
+            position += matchLength;
+            anchor = position;
+        }
+        else
+        {
+            ++position;
+        }
+    }
+    emit(length, 0, 0);
+    return out;
+}
+
+/**
+ * @brief Decompress a buffer written by lzCompress.
+ * @param data The compressed bytes.
+ * @param length The compressed length.
+ * @param rawSize The exact decompressed length.
+ * @param out Receives the decompressed bytes.
+ * @return True if the input was well formed.
+ */
+bool lzDecompress(const char *data, size_t length, size_t rawSize, std::string &out)
+{
+    out.resize(rawSize);
+    char *dest = &out[0];
+    size_t written = 0;
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = in + length;
+    auto readLength = [&](size_t &value) -> bool
+    {
+        uint8_t byte;
+        do
+        {
+            if (in >= end)
+            {
+                return false;
+            }
+            byte = *in++;
+            value += byte;
+        } while (byte == 255);
+        return true;
+    };
+    while (in < end)
+    {
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals))
+        {
+            return false;
+        }
+        if (static_cast<size_t>(end - in) < literals || rawSize - written < literals)
+        {
+            return false;
+        }
+        std::memcpy(dest + written, in, literals);
+        in += literals;
+        written += literals;
+        if (in == end)
+        {
+            break; // final literal-only sequence
+        }
+        if (end - in < 2)
+        {
+            return false;
+        }
+        uint16_t offset;
+        std::memcpy(&offset, in, sizeof(offset));
+        in += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !readLength(matchLength))
+        {
+            return false;
+        }
+        matchLength += 4;
+        if (offset == 0 || offset > written || rawSize - written < matchLength)
+        {
+            return false;
+        }
+        const char *source = dest + written - offset;
+        if (offset >= matchLength)
+        {
+            std::memcpy(dest + written, source, matchLength);
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                dest[written + i] = source[i];
+            }
+        }
+        written += matchLength;
+    }
+    return written == rawSize;
+}
+
+/**
+ * @brief Run a function over the indexes [0, count) on all hardware threads.
+ * @param count The number of work items.
+ * @param work Called once per index; must be safe to run concurrently.
+ */
+void parallelFor(size_t count, const std::function<void(size_t)> &work)
+{
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            work(i);
+        }
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 for (size_t i = next++; i < count; i = next++)
+                                 {
+                                     work(i);
+                                 } });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Stable-sort a vector on all hardware threads.
+ *
+ * One run per thread is sorted concurrently, then neighbouring runs are
+ * merged in rounds, the merges of a round running concurrently.
+ *
+ * @param items The vector to sort.
+ * @param before The strict weak ordering.
+ */
+template <typename T, typename Compare>
+void parallelSort(std::vector<T> &items, Compare before)
+{
+    const size_t MIN_RUN = 1 << 14;
+    size_t runs = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), items.size() / MIN_RUN);
+    if (runs <= 1)
+    {
+        std::stable_sort(items.begin(), items.end(), before);
+        return;
+    }
+    std::vector<size_t> bounds(runs + 1);
+    for (size_t r = 0; r <= runs; ++r)
+    {
+        bounds[r] = items.size() * r / runs;
+    }
+    parallelFor(runs, [&](size_t r)
+                { std::stable_sort(items.begin() + bounds[r], items.begin() + bounds[r + 1], before); });
+
+    std::vector<T> scratch(items.size());
+    while (bounds.size() > 2)
+    {
+        size_t pairs = (bounds.size() - 1) / 2;
+        parallelFor(pairs, [&](size_t p)
+                    {
+                        auto first = std::make_move_iterator(items.begin());
+                        std::merge(first + bounds[2 * p], first + bounds[2 * p + 1], first + bounds[2 * p + 1], first + bounds[2 * p + 2],
+                                   scratch.begin() + bounds[2 * p], before); });
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < bounds.size(); i += 2)
+        {
+            merged.push_back(bounds[i]);
+        }
+        if ((bounds.size() - 1) % 2 == 1)
+        {
+            // An odd run out is carried over to the next round as it is.
+            std::move(items.begin() + bounds[bounds.size() - 2], items.end(), scratch.begin() + bounds[bounds.size() - 2]);
+            merged.push_back(bounds.back());
+        }
+        items.swap(scratch);
+        bounds.swap(merged);
+    }
+}
+
+/**
+ * @brief Format rows on all hardware threads and write them out in order.
+ *
+ * Rows are formatted in chunks, each into its own buffer, a window of
+ * chunks at a time. While one window is written the next is formatted, so
+ * output is limited by the stream rather than one core, and memory stays
+ * bounded however many rows there are.
+ *
+ * @param out The stream to write.
+ * @param count The number of rows.
+ * @param format Appends rows [begin, end) to a buffer; must be safe to run concurrently.
+ */
+void writeInOrder(std::ostream &out, size_t count, const std::function<void(size_t, size_t, std::string &)> &format)
+{
+    const size_t CHUNK_ROWS = 2048;
+    const size_t window = 4 * std::max(1u, std::thread::hardware_concurrency());
+    const size_t span = window * CHUNK_ROWS;
+    auto formatWindow = [&](std::vector<std::string> &buffers, size_t first)
+    {
+        size_t chunks = std::min(window, (count - first + CHUNK_ROWS - 1) / CHUNK_ROWS);
+        parallelFor(chunks, [&](size_t c)
+                    {
+                        size_t begin = first + c * CHUNK_ROWS;
+                        buffers[c].clear();
+                        format(begin, std::min(count, begin + CHUNK_ROWS), buffers[c]); });
+        return chunks;
+    };
+
+    std::vector<std::string> current(window), next(window);
+    size_t chunks = count > 0 ? formatWindow(current, 0) : 0;
+    for (size_t first = 0; first < count; first += span)
+    {
+        std::future<size_t> pending;
+        if (first + span < count)
+        {
+            pending = std::async(std::launch::async, formatWindow, std::ref(next), first + span);
+        }
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            out.write(current[c].data(), static_cast<std::streamsize>(current[c].size()));
+        }
+        if (pending.valid())
+        {
+            chunks = pending.get();
+            current.swap(next);
+        }
+    }
+    out.flush();
+}
+
+/**
+ * @brief Column-aware encoding of beers for compressed snapshots.
+ *
+ * Beers are cut into blocks of BLOCK_ROWS. Within a block each attribute is
+ * stored as its own column: ids and barcodes as zigzag delta varints,
+ * quantities and sizes bit-packed, styles and dates dictionary encoded, and
+ * names length-prefixed. The block is then compressed with lzCompress, so
+ * blocks can be compressed and decompressed independently and in parallel.
+ */
+class BeerSnapshotCodec
+{
+private:
+    static void appendDictionary(std::string &out, const std::vector<std::string> &values)
+    {
+        std::unordered_map<std::string, uint64_t> codes;
+        std::vector<const std::string *> dictionary;
+        std::vector<uint64_t> encoded;
+        encoded.reserve(values.size());
+        for (const std::string &value : values)
+        {
+            auto inserted = codes.emplace(value, dictionary.size());
+            if (inserted.second)
+            {
+                dictionary.push_back(&value);
+            }
+            encoded.push_back(inserted.first->second);
+        }
+        appendVarint(out, dictionary.size());
+        for (const std::string *entry : dictionary)
+        {
+            appendVarint(out, entry->size());
+            out.append(*entry);
+        }
+        appendBitPacked(out, encoded);
+    }
+
+    static bool readDictionary(const char *&cursor, const char *end, size_t rows, std::vector<std::string> &values)
+    {
+        uint64_t entries;
+        if (!readVarint(cursor, end, entries))
+        {
+            return false;
+        }
+        std::vector<std::string> dictionary;
+        for (uint64_t i = 0; i < entries; ++i)
+        {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length)
+            {
+                return false;
+            }
+            dictionary.emplace_back(cursor, length);
+            cursor += length;
+        }
+        std::vector<uint64_t> codes;
+        if (!readBitPacked(cursor, end, rows, codes))
+        {
+            return false;
+        }
+        values.resize(rows);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            if (codes[i] >= dictionary.size())
+            {
+                return false;
+            }
+            values[i] = dictionary[codes[i]];
+        }
+        return true;
+    }
+
+public:
+    static constexpr size_t BLOCK_ROWS = 16384;
+
+    /**
+     * @brief Encode a block of beers column by column (before compression).
+     * @param beers The beers of the block.
+     * @return The encoded block.
+     */
+    static std::string encodeBlock(const std::vector<Beer> &beers)
+    {
+        std::string out;
+        appendVarint(out, beers.size());
+        int64_t previousId = 0, previousBarcode = 0;
+        std::vector<uint64_t> quantities, sizes;
+        std::vector<std::string> styles, dates;
+        for (const Beer &beer : beers)
+        {
+            appendVarint(out, zigzagEncode(beer.getId() - previousId));
+            previousId = beer.getId();
+        }
+        for (const Beer &beer : beers)
+        {
+            appendVarint(out, zigzagEncode(beer.getBarcode().getValue() - previousBarcode));
+            previousBarcode = beer.getBarcode().getValue();
+            quantities.push_back(zigzagEncode(beer.getQuantity()));
+            sizes.push_back(zigzagEncode(beer.getContainerSize().getSize()) << 1 | (beer.getContainerSize().getIsMetric() ? 1 : 0));
+            styles.push_back(beer.getStyle());
+            dates.push_back(beer.getUpdatedDate());
+        }
+        appendBitPacked(out, quantities);
+        for (const Beer &beer : beers)
+        {
+            appendPod<double>(out, beer.getAlcoholContent());
+        }
+        appendBitPacked(out, sizes);
+        appendDictionary(out, styles);
+        for (const Beer &beer : beers)
+        {
+            appendVarint(out, beer.getName().size());
+            out.append(beer.getName());
+        }
+        appendDictionary(out, dates);
+        return out;
+    }
+
+    /**
+     * @brief Decode a block written by encodeBlock.
+     * @param block The encoded block.
+     * @param beers Receives the beers.
+     * @return True if the block was well formed.
+     */
+    static bool decodeBlock(const std::string &block, std::vector<Beer> &beers)
+    {
+        const char *cursor = block.data();
+        const char *end = cursor + block.size();
+        uint64_t rows;
+        if (!readVarint(cursor, end, rows) || rows > block.size())
+        {
+            return false;
+        }
+        std::vector<int64_t> ids(rows), barcodes(rows);
+        std::vector<double> alcohol(rows);
+        std::vector<uint64_t> quantities, sizes;
+        std::vector<std::string> styles, names(rows), dates;
+        int64_t previous = 0;
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            uint64_t delta;
+            if (!readVarint(cursor, end, delta))
+            {
+                return false;
+            }
+            ids[i] = previous += zigzagDecode(delta);
+        }
+        previous = 0;
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            uint64_t delta;
+            if (!readVarint(cursor, end, delta))
+            {
+                return false;
+            }
+            barcodes[i] = previous += zigzagDecode(delta);
+        }
+        if (!readBitPacked(cursor, end, rows, quantities))
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            if (!readPod(cursor, end, alcohol[i]))
+            {
+                return false;
+            }
+        }
+        if (!readBitPacked(cursor, end, rows, sizes) || !readDictionary(cursor, end, rows, styles))
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length)
+            {
+                return false;
+            }
+            names[i].assign(cursor, length);
+            cursor += length;
+        }
+        if (!readDictionary(cursor, end, rows, dates))
+        {
+            return false;
+        }
+        beers.reserve(beers.size() + rows);
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            ContainerSize size((sizes[i] & 1) != 0, static_cast<int>(zigzagDecode(sizes[i] >> 1)));
+            Beer beer(styles[i], names[i], alcohol[i], size, static_cast<int>(zigzagDecode(quantities[i])), barcodes[i]);
+            beer.setId(static_cast<int>(ids[i]));
+            beer.setUpdatedDate(dates[i]);
+            beers.push_back(beer);
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief The value type of a column in a columnar export.
+ */
+enum class ColumnType : uint8_t
+{
+    INT64 = 0,
+    DOUBLE = 1,
+    STRING = 2
+};
+
+/**
+ * @brief The values of one column, in the member matching its type.
+ */
+struct ColumnValues
+{
+    ColumnType type = ColumnType::INT64;
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<std::string> strings;
+};
+
+/**
+ * @brief Min/max statistics of one column chunk, used to skip chunks.
+ */
+struct ColumnChunkStats
+{
+    int64_t minInt = 0, maxInt = 0;
+    double minDouble = 0, maxDouble = 0;
+    std::string minString, maxString;
+};
+
+/**
+ * @brief Location and statistics of one column chunk in a columnar file.
+ */
+struct ColumnChunkMeta
+{
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    ColumnChunkStats stats;
+};
+
+/**
+ * @brief A columnar file format for analytics dumps of the inventory.
+ *
+ * Rows are cut into row groups of ROWS_PER_GROUP; each column of a row group
+ * is stored as its own chunk. Integer chunks use run-length encoding or
+ * frame-of-reference bit-packing, whichever is smaller; double chunks use
+ * run-length or plain encoding; string chunks are dictionary encoded (with
+ * the codes encoded like an integer chunk) unless most values are distinct.
+ * A footer at the end of the file holds the schema and, for every chunk, its
+ * offset and min/max statistics, so readers fetch only the chunks they need.
+ */
+class ColumnarFormat
+{
+public:
+    static constexpr size_t ROWS_PER_GROUP = 65536;
+
+    enum Encoding : uint8_t
+    {
+        PLAIN = 0,
+        RLE = 1,
+        BIT_PACKED = 2,
+        DICTIONARY = 3
+    };
+
+    /**
+     * @brief The export schema: one column per Beer attribute.
+     */
+    static const std::vector<std::pair<std::string, ColumnType>> &schema()
+    {
+        static const std::vector<std::pair<std::string, ColumnType>> columns = {
+            {"id", ColumnType::INT64},
+            {"name", ColumnType::STRING},
+            {"style", ColumnType::STRING},
+            {"alcohol_content", ColumnType::DOUBLE},
+            {"container_size", ColumnType::INT64},
+            {"is_metric", ColumnType::INT64},
+            {"quantity", ColumnType::INT64},
+            {"barcode", ColumnType::INT64},
+            {"updated_date", ColumnType::STRING}};
+        return columns;
+    }
+
+    /**
+     * @brief Split beers into the schema's columns.
+     * @param store The store to read.
+     * @return One ColumnValues per schema column.
+     */
+    static std::vector<ColumnValues> columnsOf(const BeerStore &store)
+    {
+        std::vector<ColumnValues> columns(schema().size());
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            columns[i].type = schema()[i].second;
+        }
+        store.forEach([&columns](const Beer &beer)
+                      {
+                          columns[0].ints.push_back(beer.getId());
+                          columns[1].strings.push_back(beer.getName());
+                          columns[2].strings.push_back(beer.getStyle());
+                          columns[3].doubles.push_back(beer.getAlcoholContent());
+                          columns[4].ints.push_back(beer.getContainerSize().getSize());
+                          columns[5].ints.push_back(beer.getContainerSize().getIsMetric() ? 1 : 0);
+                          columns[6].ints.push_back(beer.getQuantity());
+                          columns[7].ints.push_back(beer.getBarcode().getValue());
+                          columns[8].strings.push_back(beer.getUpdatedDate()); });
+        return columns;
+    }
+
+    /**
+     * @brief Encode integers with whichever of RLE and bit-packing is smaller.
+     */
+    static void encodeInts(std::string &out, const int64_t *values, size_t count)
+    {
+        std::string rle;
+        size_t runs = 0;
+        for (size_t i = 0; i < count;)
+        {
+            size_t run = 1;
+            while (i + run < count && values[i + run] == values[i])
+            {
+                ++run;
+            }
+            appendVarint(rle, zigzagEncode(values[i]));
+            appendVarint(rle, run);
+            ++runs;
+            i += run;
+        }
+        std::string packed;
+        int64_t minimum = count ? *std::min_element(values, values + count) : 0;
+        std::vector<uint64_t> offsets(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            offsets[i] = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(minimum);
+        }
+        appendVarint(packed, zigzagEncode(minimum));
+        appendBitPacked(packed, offsets);
+
+        std::string runHeader;
+        appendVarint(runHeader, runs);
+        if (runHeader.size() + rle.size() < packed.size())
+        {
+            out.push_back(static_cast<char>(RLE));
+            out += runHeader;
+            out += rle;
+        }
+        else
+        {
+            out.push_back(static_cast<char>(BIT_PACKED));
+            out += packed;
+        }
+    }
+
+    /**
+     * @brief Decode integers written by encodeInts.
+     */
+    static bool decodeInts(const char *&cursor, const char *end, size_t count, std::vector<int64_t> &values)
+    {
+        if (cursor >= end)
+        {
+            return false;
+        }
+        uint8_t encoding = static_cast<uint8_t>(*cursor++);
+        values.clear();
+        values.reserve(count);
+        if (encoding == RLE)
+        {
+            uint64_t runs, value, run;
+            if (!readVarint(cursor, end, runs))
+            {
+                return false;
+            }
+            for (uint64_t i = 0; i < runs; ++i)
+            {
+                if (!readVarint(cursor, end, value) || !readVarint(cursor, end, run) || values.size() + run > count)
+                {
+                    return false;
+                }
+                values.insert(values.end(), run, zigzagDecode(value));
+            }
+            return values.size() == count;
+        }
+        uint64_t minimum;
+        std::vector<uint64_t> offsets;
+        if (encoding != BIT_PACKED || !readVarint(cursor, end, minimum) || !readBitPacked(cursor, end, count, offsets))
+        {
+            return false;
+        }
+        for (uint64_t offset : offsets)
+        {
+            values.push_back(static_cast<int64_t>(static_cast<uint64_t>(zigzagDecode(minimum)) + offset));
+        }
+        return true;
+    }
+
+    /**
+     * @brief Encode one column chunk and compute its statistics.
+     * @param column The column values.
+     * @param begin The first row of the chunk.
+     * @param count The number of rows in the chunk.
+     * @param stats Receives the chunk statistics.
+     * @return The encoded chunk.
+     */
+    static std::string encodeChunk(const ColumnValues &column, size_t begin, size_t count, ColumnChunkStats &stats)
+    {
+        std::string out;
+        if (column.type == ColumnType::INT64)
+        {
+            const int64_t *values = column.ints.data() + begin;
+            auto bounds = std::minmax_element(values, values + count);
+            stats.minInt = count ? *bounds.first : 0;
+            stats.maxInt = count ? *bounds.second : 0;
+            encodeInts(out, values, count);
+        }
+        else if (column.type == ColumnType::DOUBLE)
+        {
+            const double *values = column.doubles.data() + begin;
+            auto bounds = std::minmax_element(values, values + count);
+            stats.minDouble = count ? *bounds.first : 0;
+            stats.maxDouble = count ? *bounds.second : 0;
+            std::vector<int64_t> bits(count);
+            std::memcpy(bits.data(), values, count * sizeof(double));
+            encodeInts(out, bits.data(), count); // repeated ABVs collapse into runs
+        }
+        else
+        {
+            const std::string *values = column.strings.data() + begin;
+            auto bounds = std::minmax_element(values, values + count);
+            stats.minString = count ? *bounds.first : "";
+            stats.maxString = count ? *bounds.second : "";
+            std::unordered_map<std::string, int64_t> codes;
+            std::vector<const std::string *> dictionary;
+            std::vector<int64_t> encoded(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto inserted = codes.emplace(values[i], static_cast<int64_t>(dictionary.size()));
+                if (inserted.second)
+                {
+                    dictionary.push_back(&values[i]);
+                }
+                encoded[i] = inserted.first->second;
+            }
+            bool useDictionary = dictionary.size() * 2 <= count;
+            out.push_back(static_cast<char>(useDictionary ? DICTIONARY : PLAIN));
+            const std::string *const *strings = useDictionary ? dictionary.data() : nullptr;
+            size_t stringCount = useDictionary ? dictionary.size() : count;
+            if (useDictionary)
+            {
+                appendVarint(out, dictionary.size());
+            }
+            for (size_t i = 0; i < stringCount; ++i)
+            {
+                const std::string &value = strings ? *strings[i] : values[i];
+                appendVarint(out, value.size());
+                out += value;
+            }
+            if (useDictionary)
+            {
+                encodeInts(out, encoded.data(), count);
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Decode one column chunk into a ColumnValues of the right type.
+     */
+    static bool decodeChunk(const std::string &chunk, ColumnType type, size_t count, ColumnValues &column)
+    {
+        const char *cursor = chunk.data();
+        const char *end = cursor + chunk.size();
+        column.type = type;
+        if (type == ColumnType::INT64)
+        {
+            return decodeInts(cursor, end, count, column.ints);
+        }
+        if (type == ColumnType::DOUBLE)
+        {
+            std::vector<int64_t> bits;
+            if (!decodeInts(cursor, end, count, bits))
+            {
+                return false;
+            }
+            column.doubles.resize(count);
+            std::memcpy(column.doubles.data(), bits.data(), count * sizeof(double));
+            return true;
+        }
+        if (cursor >= end)
+        {
+            return false;
+        }
+        uint8_t encoding = static_cast<uint8_t>(*cursor++);
+        uint64_t stringCount = count;
+        if (encoding == DICTIONARY && !readVarint(cursor, end, stringCount))
+        {
+            return false;
+        }
+        std::vector<std::string> strings;
+        for (uint64_t i = 0; i < stringCount; ++i)
+        {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length)
+            {
+                return false;
+            }
+            strings.emplace_back(cursor, length);
+            cursor += length;
+        }
+        if (encoding != DICTIONARY)
+        {
+            column.strings = std::move(strings);
+            return true;
+        }
+        std::vector<int64_t> codes;
+        if (!decodeInts(cursor, end, count, codes))
+        {
+            return false;
+        }
+        column.strings.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (codes[i] < 0 || static_cast<uint64_t>(codes[i]) >= strings.size())
+            {
+                return false;
+            }
+            column.strings[i] = strings[codes[i]];
+        }
+        return true;
+    }
+};
+
+const char COLUMNAR_MAGIC[8] = {'B', 'C', 'O', 'L', '0', '0', '0', '1'};
+
+/**
+ * @brief Write the inventory as a columnar file.
+ * @param store The store to export.
+ * @param path The file to write.
+ * @return True if the file was written.
+ */
+bool writeColumnarFile(const BeerStore &store, const std::string &path)
+{
+    const auto &schema = ColumnarFormat::schema();
+    std::vector<ColumnValues> columns = ColumnarFormat::columnsOf(store);
+    size_t rows = store.size();
+    size_t groups = (rows + ColumnarFormat::ROWS_PER_GROUP - 1) / ColumnarFormat::ROWS_PER_GROUP;
+    std::vector<std::string> chunks(groups * schema.size());
+    std::vector<ColumnChunkMeta> metas(chunks.size());
+    parallelFor(chunks.size(), [&](size_t i)
+                {
+                    size_t group = i / schema.size();
+                    size_t column = i % schema.size();
+                    size_t begin = group * ColumnarFormat::ROWS_PER_GROUP;
+                    size_t count = std::min(ColumnarFormat::ROWS_PER_GROUP, rows - begin);
+                    chunks[i] = ColumnarFormat::encodeChunk(columns[column], begin, count, metas[i].stats); });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    uint64_t offset = sizeof(COLUMNAR_MAGIC);
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        metas[i].offset = offset;
+        metas[i].length = chunks[i].size();
+        out.write(chunks[i].data(), chunks[i].size());
+        offset += chunks[i].size();
+    }
+
+    std::string footer;
+    appendVarint(footer, rows);
+    appendVarint(footer, schema.size());
+    for (const auto &column : schema)
+    {
+        appendString(footer, column.first);
+        footer.push_back(static_cast<char>(column.second));
+    }
+    for (size_t i = 0; i < metas.size(); ++i)
+    {
+        const ColumnChunkMeta &meta = metas[i];
+        appendVarint(footer, meta.offset);
+        appendVarint(footer, meta.length);
+        switch (schema[i % schema.size()].second)
+        {
+        case ColumnType::INT64:
+            appendVarint(footer, zigzagEncode(meta.stats.minInt));
+            appendVarint(footer, zigzagEncode(meta.stats.maxInt));
+            break;
+        case ColumnType::DOUBLE:
+            appendPod(footer, meta.stats.minDouble);
+            appendPod(footer, meta.stats.maxDouble);
+            break;
+        case ColumnType::STRING:
+            appendString(footer, meta.stats.minString);
+            appendString(footer, meta.stats.maxString);
+            break;
+        }
+    }
+    appendPod<uint64_t>(footer, footer.size());
+    footer.append(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    out.write(footer.data(), footer.size());
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief Reads columnar files chunk by chunk, skipping chunks by statistics.
+ *
+ * The footer is checked before anything is allocated from it: the column
+ * count and chunk table must fit in the footer, and every chunk must lie
+ * in the data between the header and the footer.
+ */
+class ColumnarReader
+{
+private:
+    std::ifstream file;
+    std::vector<std::pair<std::string, ColumnType>> columns;
+    std::vector<ColumnChunkMeta> chunks; // row group major
+    uint64_t rowCount;
+    uint64_t bytesRead;
+    bool valid;
+
+public:
+    /**
+     * @brief Open a columnar file and read its footer.
+     * @param path The file to read.
+     */
+    explicit ColumnarReader(const std::string &path) : file(path, std::ios::binary), rowCount(0), bytesRead(0), valid(false)
+    {
+        char tail[16];
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        if (!file || size < static_cast<std::streamoff>(sizeof(COLUMNAR_MAGIC) + sizeof(tail)))
+        {
+            return;
+        }
+        file.seekg(size - static_cast<std::streamoff>(sizeof(tail)));
+        file.read(tail, sizeof(tail));
+        uint64_t footerLength;
+        std::memcpy(&footerLength, tail, sizeof(footerLength));
+        if (std::memcmp(tail + 8, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 ||
+            footerLength > static_cast<uint64_t>(size) - sizeof(tail))
+        {
+            return;
+        }
+        std::string footer(footerLength, '\0');
+        file.seekg(size - static_cast<std::streamoff>(sizeof(tail) + footerLength));
+        file.read(&footer[0], footerLength);
+        bytesRead += sizeof(tail) + footerLength;
+
+        const char *cursor = footer.data();
+        const char *end = cursor + footer.size();
+        uint64_t columnCount;
+        // Each column takes at least three footer bytes and each chunk at least four.
+        if (!readVarint(cursor, end, rowCount) || !readVarint(cursor, end, columnCount) || columnCount == 0 ||
+            columnCount > footerLength / 3)
+        {
+            return;
+        }
+        for (uint64_t i = 0; i < columnCount; ++i)
+        {
+            std::string name;
+            uint8_t type;
+            if (!readString(cursor, end, name) || !readPod(cursor, end, type) || type > static_cast<uint8_t>(ColumnType::STRING))
+            {
+                return;
+            }
+            columns.push_back(std::make_pair(name, static_cast<ColumnType>(type)));
+        }
+        uint64_t groups = rowCount / ColumnarFormat::ROWS_PER_GROUP + (rowCount % ColumnarFormat::ROWS_PER_GROUP != 0);
+        if (groups > footerLength / 4 / columnCount)
+        {
+            return;
+        }
+        uint64_t dataEnd = static_cast<uint64_t>(size) - sizeof(tail) - footerLength;
+        for (size_t i = 0; i < groups * columnCount; ++i)
+        {
+            ColumnChunkMeta meta;
+            uint64_t minimum, maximum;
+            bool ok = readVarint(cursor, end, meta.offset) && readVarint(cursor, end, meta.length);
+            switch (columns[i % columnCount].second)
+            {
+            case ColumnType::INT64:
+                ok = ok && readVarint(cursor, end, minimum) && readVarint(cursor, end, maximum);
+                meta.stats.minInt = zigzagDecode(minimum);
+                meta.stats.maxInt = zigzagDecode(maximum);
+                break;
+            case ColumnType::DOUBLE:
+                ok = ok && readPod(cursor, end, meta.stats.minDouble) && readPod(cursor, end, meta.stats.maxDouble);
+                break;
+            case ColumnType::STRING:
+                ok = ok && readString(cursor, end, meta.stats.minString) && readString(cursor, end, meta.stats.maxString);
+                break;
+            }
+            if (!ok || meta.offset < sizeof(COLUMNAR_MAGIC) || meta.offset > dataEnd || meta.length > dataEnd - meta.offset)
+            {
+                return;
+            }
+            chunks.push_back(meta);
+        }
+        valid = true;
+    }
+
+    /**
+     * @brief Check whether the file was opened and its footer parsed.
+     * @return True if the reader is usable.
+     */
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /**
+     * @brief Get the number of rows in the file.
+     * @return The row count.
+     */
+    uint64_t getRowCount() const
+    {
+        return rowCount;
+    }
+
+    /**
+     * @brief Get the number of row groups in the file.
+     * @return The row group count.
+     */
+    size_t getRowGroupCount() const
+    {
+        return columns.empty() ? 0 : chunks.size() / columns.size();
+    }
+
+    /**
+     * @brief Get the number of file bytes read so far (footer and chunks).
+     * @return The bytes read.
+     */
+    uint64_t getBytesRead() const
+    {
+        return bytesRead;
+    }
+
+    /**
+     * @brief Find a column by name.
+     * @param name The column name.
+     * @return The column index, or -1 if there is no such column.
+     */
+    int columnIndex(const std::string &name) const
+    {
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            if (columns[i].first == name)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Get the statistics of a column chunk.
+     * @param rowGroup The row group.
+     * @param column The column index.
+     * @return The chunk statistics.
+     */
+    const ColumnChunkStats &chunkStats(size_t rowGroup, int column) const
+    {
+        return chunks[rowGroup * columns.size() + column].stats;
+    }
+
+    /**
+     * @brief Get the row groups whose integer column may hold values in [low, high].
+     * @param column The column index (an INT64 column).
+     * @param low The lowest wanted value.
+     * @param high The highest wanted value.
+     * @return The row groups that cannot be skipped.
+     */
+    std::vector<size_t> rowGroupsInRange(int column, int64_t low, int64_t high) const
+    {
+        std::vector<size_t> groups;
+        for (size_t group = 0; group < getRowGroupCount(); ++group)
+        {
+            const ColumnChunkStats &stats = chunkStats(group, column);
+            if (stats.maxInt >= low && stats.minInt <= high)
+            {
+                groups.push_back(group);
+            }
+        }
+        return groups;
+    }
+
+    /**
+     * @brief Read and decode one column chunk.
+     * @param rowGroup The row group.
+     * @param column The column index.
+     * @param values Receives the decoded values.
+     * @return True if the chunk was read and decoded.
+     */
+    bool readChunk(size_t rowGroup, int column, ColumnValues &values)
+    {
+        const ColumnChunkMeta &meta = chunks[rowGroup * columns.size() + column];
+        std::string bytes(meta.length, '\0');
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(meta.offset));
+        file.read(&bytes[0], meta.length);
+        if (!file)
+        {
+            return false;
+        }
+        bytesRead += meta.length;
+        size_t rows = std::min<uint64_t>(ColumnarFormat::ROWS_PER_GROUP, rowCount - rowGroup * ColumnarFormat::ROWS_PER_GROUP);
+        return ColumnarFormat::decodeChunk(bytes, columns[column].second, rows, values);
+    }
+};
+
+/**
+ * @brief A minimal FlatBuffers builder, enough to write Arrow IPC metadata.
+ *
+ * Like the reference builder it fills the buffer back to front, so every
+ * object is written before anything that refers to it. References are byte
+ * distances from the end of the buffer.
+ */
+class FlatBufferBuilder
+{
+private:
+    std::vector<uint8_t> buffer; // the used bytes are the last `used` ones
+    size_t used;
+    size_t maxAlign;
+    size_t tableStart;
+    std::vector<std::pair<uint16_t, uint32_t>> fields; // (slot, position) of the open table
+
+    void reserve(size_t bytes)
+    {
+        if (used + bytes > buffer.size())
+        {
+            std::vector<uint8_t> grown(std::max(buffer.size() * 2, used + bytes + 64));
+            if (used > 0)
+            {
+                std::memcpy(grown.data() + grown.size() - used, buffer.data() + buffer.size() - used, used);
+            }
+            buffer.swap(grown);
+        }
+    }
+
+    uint8_t *at(size_t position)
+    {
+        return buffer.data() + buffer.size() - position;
+    }
+
+    void pad(size_t bytes)
+    {
+        if (bytes == 0)
+        {
+            return;
+        }
+        reserve(bytes);
+        used += bytes;
+        std::memset(at(used), 0, bytes);
+    }
+
+    /**
+     * @brief Pad so that `alignment` divides the position after `following` more bytes.
+     */
+    void align(size_t alignment, size_t following = 0)
+    {
+        maxAlign = std::max(maxAlign, alignment);
+        pad((alignment - (used + following) % alignment) % alignment);
+    }
+
+    void prependBytes(const void *data, size_t length)
+    {
+        reserve(length);
+        used += length;
+        if (length > 0)
+        {
+            std::memcpy(at(used), data, length);
+        }
+    }
+
+public:
+    FlatBufferBuilder() : used(0), maxAlign(1), tableStart(0) {}
+
+    /**
+     * @brief Prepend an aligned scalar.
+     */
+    template <typename T>
+    uint32_t push(T value)
+    {
+        align(sizeof(T));
+        prependBytes(&value, sizeof(T));
+        return static_cast<uint32_t>(used);
+    }
+
+    /**
+     * @brief Prepend a reference to an object written earlier.
+     */
+    uint32_t pushOffset(uint32_t target)
+    {
+        align(4);
+        return push<uint32_t>(static_cast<uint32_t>(used + 4 - target));
+    }
+
+    /**
+     * @brief Write a string and return a reference to it.
+     */
+    uint32_t createString(const std::string &value)
+    {
+        align(4, value.size() + 1);
+        pad(1);
+        prependBytes(value.data(), value.size());
+        return push<uint32_t>(static_cast<uint32_t>(value.size()));
+    }
+
+    /**
+     * @brief Write a vector of structs (raw bytes) and return a reference to it.
+     */
+    uint32_t createStructVector(const void *data, size_t elementSize, size_t count, size_t alignment)
+    {
+        align(std::max<size_t>(alignment, 4), elementSize * count);
+        prependBytes(data, elementSize * count);
+        return push<uint32_t>(static_cast<uint32_t>(count));
+    }
+
+    /**
+     * @brief Write a vector of references and return a reference to it.
+     */
+    uint32_t createOffsetVector(const std::vector<uint32_t> &targets)
+    {
+        align(4, targets.size() * 4);
+        for (auto it = targets.rbegin(); it != targets.rend(); ++it)
+        {
+            pushOffset(*it);
+        }
+        return push<uint32_t>(static_cast<uint32_t>(targets.size()));
+    }
+
+    /**
+     * @brief Begin a table; add its fields, then call endTable.
+     */
+    void startTable()
+    {
+        fields.clear();
+        tableStart = used;
+    }
+
+    template <typename T>
+    void addScalar(uint16_t slot, T value)
+    {
+        fields.push_back(std::make_pair(slot, push(value)));
+    }
+
+    void addOffset(uint16_t slot, uint32_t target)
+    {
+        fields.push_back(std::make_pair(slot, pushOffset(target)));
+    }
+
+    /**
+     * @brief Finish the open table by writing it and its vtable.
+     * @return A reference to the table.
+     */
+    uint32_t endTable()
+    {
+        uint32_t table = push<int32_t>(0);
+        uint16_t slots = 0;
+        for (const auto &field : fields)
+        {
+            slots = std::max<uint16_t>(slots, field.first + 1);
+        }
+        std::vector<uint16_t> vtable(slots, 0);
+        for (const auto &field : fields)
+        {
+            vtable[field.first] = static_cast<uint16_t>(table - field.second);
+        }
+        for (auto it = vtable.rbegin(); it != vtable.rend(); ++it)
+        {
+            push<uint16_t>(*it);
+        }
+        push<uint16_t>(static_cast<uint16_t>(table - tableStart));
+        uint32_t vtablePosition = push<uint16_t>(static_cast<uint16_t>((slots + 2) * 2));
+        int32_t distance = static_cast<int32_t>(vtablePosition - table);
+        std::memcpy(at(table), &distance, sizeof(distance));
+        return table;
+    }
+
+    /**
+     * @brief Write the root reference and return the finished buffer.
+     * @param root The root table.
+     * @return The flatbuffer bytes.
+     */
+    std::string finish(uint32_t root)
+    {
+        align(std::max<size_t>(maxAlign, 8), 4);
+        pushOffset(root);
+        return std::string(reinterpret_cast<const char *>(at(used)), used);
+    }
+};
+
+/**
+ * @brief Writes the inventory in the Arrow IPC streaming format.
+ *
+ * The stream holds a Schema message, one DictionaryBatch with the distinct
+ * styles, record batches of BATCH_ROWS rows and the end-of-stream marker.
+ * Columns are id, name, style (dictionary encoded), alcohol_content,
+ * container_size, is_metric, quantity, barcode and updated_date, none of
+ * them nullable. Body buffers are 8-byte aligned, so a reader that maps the
+ * file can use the column buffers in place.
+ */
+class ArrowStreamWriter
+{
+private:
+    enum ArrowType : uint8_t
+    {
+        INT = 2,
+        FLOATING_POINT = 3,
+        UTF8 = 5,
+        BOOL = 6
+    };
+
+    struct ArrowColumn
+    {
+        const char *name;
+        ArrowType type;
+        int bitWidth;    // for INT columns
+        bool dictionary; // dictionary encoded with int32 indices
+    };
+
+    struct FieldNode
+    {
+        int64_t length;
+        int64_t nullCount;
+    };
+
+    struct BufferSpec
+    {
+        int64_t offset;
+        int64_t length;
+    };
+
+    static const int64_t STYLE_DICTIONARY_ID = 0;
+    static const short METADATA_V5 = 4;
+
+    /**
+     * @brief The Arrow columns, in the order of ColumnarFormat::schema().
+     */
+    static const std::vector<ArrowColumn> &columns()
+    {
+        static const std::vector<ArrowColumn> arrowColumns = {
+            {"id", INT, 32, false},
+            {"name", UTF8, 0, false},
+            {"style", UTF8, 0, true},
+            {"alcohol_content", FLOATING_POINT, 0, false},
+            {"container_size", INT, 32, false},
+            {"is_metric", BOOL, 0, false},
+            {"quantity", INT, 32, false},
+            {"barcode", INT, 64, false},
+            {"updated_date", UTF8, 0, false}};
+        return arrowColumns;
+    }
+
+    static uint32_t intType(FlatBufferBuilder &builder, int bitWidth)
+    {
+        builder.startTable();
+        builder.addScalar<int32_t>(0, bitWidth);
+        builder.addScalar<uint8_t>(1, 1); // is_signed
+        return builder.endTable();
+    }
+
+    static uint32_t field(FlatBufferBuilder &builder, const ArrowColumn &column)
+    {
+        uint32_t name = builder.createString(column.name);
+        uint32_t children = builder.createOffsetVector({});
+        uint32_t type;
+        builder.startTable();
+        if (column.type == INT)
+        {
+            builder.addScalar<int32_t>(0, column.bitWidth);
+            builder.addScalar<uint8_t>(1, 1);
+        }
+        else if (column.type == FLOATING_POINT)
+        {
+            builder.addScalar<int16_t>(0, 2); // DOUBLE
+        }
+        type = builder.endTable();
+        uint32_t dictionary = 0;
+        if (column.dictionary)
+        {
+            uint32_t indexType = intType(builder, 32);
+            builder.startTable();
+            builder.addScalar<int64_t>(0, STYLE_DICTIONARY_ID);
+            builder.addOffset(1, indexType);
+            builder.addScalar<uint8_t>(2, 0); // isOrdered
+            dictionary = builder.endTable();
+        }
+        builder.startTable();
+        builder.addOffset(0, name);
+        builder.addScalar<uint8_t>(1, 0); // nullable
+        builder.addScalar<uint8_t>(2, column.type);
+        builder.addOffset(3, type);
+        if (column.dictionary)
+        {
+            builder.addOffset(4, dictionary);
+        }
+        builder.addOffset(5, children);
+        return builder.endTable();
+    }
+
+    /**
+     * @brief Wrap a header table in a Message and frame it with its body.
+     */
+    static std::string message(FlatBufferBuilder &builder, uint8_t headerType, uint32_t header, const std::string &body)
+    {
+        builder.startTable();
+        builder.addScalar<int64_t>(3, static_cast<int64_t>(body.size()));
+        builder.addOffset(2, header);
+        builder.addScalar<int16_t>(0, METADATA_V5);
+        builder.addScalar<uint8_t>(1, headerType);
+        std::string metadata = builder.finish(builder.endTable());
+        metadata.resize((metadata.size() + 7) / 8 * 8, '\0');
+        std::string framed;
+        appendPod<uint32_t>(framed, 0xFFFFFFFF);
+        appendPod<int32_t>(framed, static_cast<int32_t>(metadata.size()));
+        return framed + metadata + body;
+    }
+
+    /**
+     * @brief Append a buffer to a message body, 8-byte aligned.
+     */
+    static void addBuffer(std::string &body, std::vector<BufferSpec> &buffers, const void *data, size_t length)
+    {
+        buffers.push_back(BufferSpec{static_cast<int64_t>(body.size()), static_cast<int64_t>(length)});
+        if (length > 0)
+        {
+            body.append(static_cast<const char *>(data), length);
+        }
+        body.resize((body.size() + 7) / 8 * 8, '\0');
+    }
+
+    static void addStrings(std::string &body, std::vector<BufferSpec> &buffers, const std::string *values, size_t count)
+    {
+        std::vector<int32_t> offsets(count + 1, 0);
+        std::string data;
+        for (size_t i = 0; i < count; ++i)
+        {
+            data += values[i];
+            offsets[i + 1] = static_cast<int32_t>(data.size());
+        }
+        addBuffer(body, buffers, nullptr, 0); // validity: all valid
+        addBuffer(body, buffers, offsets.data(), offsets.size() * sizeof(int32_t));
+        addBuffer(body, buffers, data.data(), data.size());
+    }
+
+    static uint32_t recordBatch(FlatBufferBuilder &builder, size_t rows, const std::vector<FieldNode> &nodes,
+                                const std::vector<BufferSpec> &buffers)
+    {
+        uint32_t nodeVector = builder.createStructVector(nodes.data(), sizeof(FieldNode), nodes.size(), 8);
+        uint32_t bufferVector = builder.createStructVector(buffers.data(), sizeof(BufferSpec), buffers.size(), 8);
+        builder.startTable();
+        builder.addScalar<int64_t>(0, static_cast<int64_t>(rows));
+        builder.addOffset(1, nodeVector);
+        builder.addOffset(2, bufferVector);
+        return builder.endTable();
+    }
+
+public:
+    static constexpr size_t BATCH_ROWS = 65536;
+
+    /**
+     * @brief Encode the whole stream.
+     * @param store The store to export.
+     * @return The stream bytes.
+     */
+    static std::string encode(const BeerStore &store)
+    {
+        std::vector<ColumnValues> values = ColumnarFormat::columnsOf(store);
+        size_t rows = store.size();
+        std::string stream;
+
+        FlatBufferBuilder schemaBuilder;
+        std::vector<uint32_t> fields;
+        for (const ArrowColumn &column : columns())
+        {
+            fields.push_back(field(schemaBuilder, column));
+        }
+        uint32_t fieldVector = schemaBuilder.createOffsetVector(fields);
+        schemaBuilder.startTable();
+        schemaBuilder.addOffset(1, fieldVector);
+        schemaBuilder.addScalar<int16_t>(0, 0); // little endian
+        stream += message(schemaBuilder, 1, schemaBuilder.endTable(), "");
+
+        std::vector<std::string> dictionary;
+        std::unordered_map<std::string, int32_t> codes;
+        std::vector<int32_t> styleCodes;
+        styleCodes.reserve(rows);
+        for (const std::string &style : values[2].strings)
+        {
+            auto inserted = codes.emplace(style, static_cast<int32_t>(dictionary.size()));
+            if (inserted.second)
+            {
+                dictionary.push_back(style);
+            }
+            styleCodes.push_back(inserted.first->second);
+        }
+        {
+            std::string body;
+            std::vector<BufferSpec> buffers;
+            addStrings(body, buffers, dictionary.data(), dictionary.size());
+            std::vector<FieldNode> nodes = {FieldNode{static_cast<int64_t>(dictionary.size()), 0}};
+            FlatBufferBuilder builder;
+            uint32_t data = recordBatch(builder, dictionary.size(), nodes, buffers);
+            builder.startTable();
+            builder.addScalar<int64_t>(0, STYLE_DICTIONARY_ID);
+            builder.addOffset(1, data);
+            builder.addScalar<uint8_t>(2, 0); // isDelta
+            stream += message(builder, 2, builder.endTable(), body);
+        }
+
+        for (size_t begin = 0; begin < rows; begin += BATCH_ROWS)
+        {
+            size_t count = std::min(BATCH_ROWS, rows - begin);
+            std::string body;
+            std::vector<BufferSpec> buffers;
+            std::vector<FieldNode> nodes;
+            for (size_t c = 0; c < columns().size(); ++c)
+            {
+                const ArrowColumn &column = columns()[c];
+                nodes.push_back(FieldNode{static_cast<int64_t>(count), 0});
+                if (column.type == UTF8 && !column.dictionary)
+                {
+                    addStrings(body, buffers, values[c].strings.data() + begin, count);
+                    continue;
+                }
+                addBuffer(body, buffers, nullptr, 0); // validity: all valid
+                if (column.dictionary)
+                {
+                    addBuffer(body, buffers, styleCodes.data() + begin, count * sizeof(int32_t));
+                }
+                else if (column.type == FLOATING_POINT)
+                {
+                    addBuffer(body, buffers, values[c].doubles.data() + begin, count * sizeof(double));
+                }
+                else if (column.type == BOOL)
+                {
+                    std::vector<uint8_t> bits((count + 7) / 8, 0);
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        bits[i / 8] |= static_cast<uint8_t>((values[c].ints[begin + i] != 0) << (i % 8));
+                    }
+                    addBuffer(body, buffers, bits.data(), bits.size());
+                }
+                else if (column.bitWidth == 64)
+                {
+                    addBuffer(body, buffers, values[c].ints.data() + begin, count * sizeof(int64_t));
+                }
+                else
+                {
+                    std::vector<int32_t> narrow(values[c].ints.begin() + begin, values[c].ints.begin() + begin + count);
+                    addBuffer(body, buffers, narrow.data(), narrow.size() * sizeof(int32_t));
+                }
+            }
+            FlatBufferBuilder builder;
+            stream += message(builder, 3, recordBatch(builder, count, nodes, buffers), body);
+        }
+
+        appendPod<uint32_t>(stream, 0xFFFFFFFF);
+        appendPod<int32_t>(stream, 0); // end of stream
+        return stream;
+    }
+
+    /**
+     * @brief Write the stream into a memory-mapped file.
+     *
+     * Pointing path at a tmpfs such as /dev/shm puts the stream in shared
+     * memory, where analytics processes can map it without copying.
+     *
+     * @param store The store to export.
+     * @param path The file to create.
+     * @return True if the file was written.
+     */
+    static bool writeShared(const BeerStore &store, const std::string &path)
+    {
+        std::string stream = encode(store);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool ok = ::ftruncate(fd, static_cast<off_t>(stream.size())) == 0;
+        if (ok && !stream.empty())
+        {
+            void *mapping = ::mmap(nullptr, stream.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok)
+            {
+                std::memcpy(mapping, stream.data(), stream.size());
+                ::munmap(mapping, stream.size());
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+};
+
+/**
+ * @brief Stage one of JSON Lines parsing: find the structural characters.
+ *
+ * Following simdjson's first stage, input is classified 64 bytes at a time
+ * into bitmasks of quotes, backslashes and operators ({ } [ ] : , and the
+ * newline that ends a record) using 16-byte SIMD compares. Escaped quotes are
+ * removed, a prefix XOR of the remaining quotes yields the inside-string
+ * mask, and operators inside strings are dropped. A JSON string cannot hold a
+ * raw newline, so the mask is restarted after every newline: a stray quote
+ * leaves only the rest of its own line inside a string. The result is the
+ * sorted list of positions of every structural character, including both
+ * quotes of each string and every newline.
+ */
+class JsonStructuralScanner
+{
+private:
+    struct BlockMasks
+    {
+        uint64_t quotes;
+        uint64_t backslashes;
+        uint64_t operators;
+        uint64_t newlines;
+    };
+
+    static BlockMasks classify(const char *block)
+    {
+        BlockMasks masks{0, 0, 0, 0};
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const char *bytes = block + lane * 16;
+            uint64_t quotes, backslashes, operators, newlines;
+#if defined(__SSE2__)
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+            auto eq = [&chunk](char c)
+            { return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)); };
+            quotes = static_cast<uint16_t>(_mm_movemask_epi8(eq('"')));
+            backslashes = static_cast<uint16_t>(_mm_movemask_epi8(eq('\\')));
+            __m128i ops = _mm_or_si128(_mm_or_si128(_mm_or_si128(eq('{'), eq('}')), _mm_or_si128(eq('['), eq(']'))),
+                                       _mm_or_si128(_mm_or_si128(eq(':'), eq(',')), eq('\n')));
+            operators = static_cast<uint16_t>(_mm_movemask_epi8(ops));
+            newlines = static_cast<uint16_t>(_mm_movemask_epi8(eq('\n')));
+#elif defined(__aarch64__)
+            uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(bytes));
+            auto eq = [&chunk](char c)
+            { return vceqq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(c))); };
+            auto movemask = [](uint8x16_t matches) -> uint64_t
+            {
+                static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+                uint8x16_t bits = vandq_u8(matches, vld1q_u8(weights));
+                return vaddv_u8(vget_low_u8(bits)) | (static_cast<uint64_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+            };
+            quotes = movemask(eq('"'));
+            backslashes = movemask(eq('\\'));
+            uint8x16_t ops = vorrq_u8(vorrq_u8(vorrq_u8(eq('{'), eq('}')), vorrq_u8(eq('['), eq(']'))),
+                                      vorrq_u8(vorrq_u8(eq(':'), eq(',')), eq('\n')));
+            operators = movemask(ops);
+            newlines = movemask(eq('\n'));
+#else
+            quotes = backslashes = operators = newlines = 0;
+            for (int i = 0; i < 16; ++i)
+            {
+                char c = bytes[i];
+                quotes |= static_cast<uint64_t>(c == '"') << i;
+                backslashes |= static_cast<uint64_t>(c == '\\') << i;
+                operators |= static_cast<uint64_t>(c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' || c == '\n') << i;
+                newlines |= static_cast<uint64_t>(c == '\n') << i;
+            }
+#endif
+            masks.quotes |= quotes << (lane * 16);
+            masks.backslashes |= backslashes << (lane * 16);
+            masks.operators |= operators << (lane * 16);
+            masks.newlines |= newlines << (lane * 16);
+        }
+        return masks;
+    }
+
+    static uint64_t prefixXor(uint64_t bits)
+    {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+public:
+    /**
+     * @brief Find the structural characters of a JSON Lines buffer.
+     * @param data The input.
+     * @param length The input length.
+     * @param positions Receives the structural positions in ascending order.
+     */
+    static void scan(const char *data, size_t length, std::vector<uint32_t> &positions)
+    {
+        positions.clear();
+        uint64_t escapeCarry = 0;   // the first byte of the next block is escaped
+        uint64_t insideString = 0;  // all ones if the previous block ended inside a string
+        char padded[64];
+        for (size_t offset = 0; offset < length; offset += 64)
+        {
+            const char *block = data + offset;
+            size_t available = std::min<size_t>(64, length - offset);
+            if (available < 64)
+            {
+                std::memset(padded, ' ', sizeof(padded));
+                std::memcpy(padded, block, available);
+                block = padded;
+            }
+            BlockMasks masks = classify(block);
+
+            // Backslashes are rare, so resolve escapes one run at a time.
+            uint64_t escaped = escapeCarry;
+            escapeCarry = 0;
+            for (uint64_t pending = masks.backslashes & ~escaped; pending != 0;)
+            {
+                int bit = __builtin_ctzll(pending);
+                if (bit == 63)
+                {
+                    escapeCarry = 1;
+                    break;
+                }
+                escaped |= 1ULL << (bit + 1);
+                pending &= ~((2ULL << (bit + 1)) - 1); // the escaped byte cannot start an escape
+            }
+
+            uint64_t quotes = masks.quotes & ~escaped;
+            uint64_t inside = prefixXor(quotes) ^ insideString;
+            // Newlines are rare too: a string still open at one ends there, so
+            // flip the mask back for the rest of the block.
+            for (uint64_t open; (open = masks.newlines & inside) != 0;)
+            {
+                int bit = __builtin_ctzll(open);
+                inside ^= bit == 63 ? 0 : ~0ULL << (bit + 1);
+                inside &= ~(1ULL << bit);
+            }
+            insideString = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+            uint64_t structural = (masks.operators & ~inside) | quotes;
+            if (available < 64)
+            {
+                structural &= (1ULL << available) - 1;
+            }
+            while (structural != 0)
+            {
+                positions.push_back(static_cast<uint32_t>(offset + __builtin_ctzll(structural)));
+                structural &= structural - 1;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Parses JSON Lines records into beers using the structural index.
+ *
+ * Each line must hold one flat object. Recognised keys are name, style,
+ * alcohol_content, container_size, is_metric, quantity, barcode and
+ * updated_date; an id key and unknown keys (including nested values) are
+ * ignored, since ids are assigned on import. name must be a string; style
+ * and updated_date must be strings or null (read as empty, and a missing
+ * date keeps the import time); the others must be unquoted numbers or
+ * booleans. A line breaking these rules, or holding anything but an object,
+ * is reported as an error; a string left open at the end of a line is
+ * reported on that line and does not affect the next.
+ */
+class JsonLinesReader
+{
+private:
+    const char *data;
+    size_t length;
+    std::vector<uint32_t> positions;
+    size_t next; // index into positions
+    std::vector<std::string> errors;
+
+    static void appendUtf8(std::string &out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    /**
+     * @brief Decode the string between two quote positions.
+     */
+    bool decodeString(uint32_t open, uint32_t close, std::string &out) const
+    {
+        const char *begin = data + open + 1;
+        const char *end = data + close;
+        const char *escape = static_cast<const char *>(std::memchr(begin, '\\', end - begin));
+        if (!escape)
+        {
+            out.assign(begin, end);
+            return true;
+        }
+        out.assign(begin, escape);
+        for (const char *cursor = escape; cursor < end; ++cursor)
+        {
+            if (*cursor != '\\')
+            {
+                out.push_back(*cursor);
+                continue;
+            }
+            if (++cursor >= end)
+            {
+                return false;
+            }
+            switch (*cursor)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out.push_back(*cursor);
+                break;
+            case 'b':
+                out.push_back('\b');
+                break;
+            case 'f':
+                out.push_back('\f');
+                break;
+            case 'n':
+                out.push_back('\n');
+                break;
+            case 'r':
+                out.push_back('\r');
+                break;
+            case 't':
+                out.push_back('\t');
+                break;
+            case 'u':
+            {
+                auto hex = [&](const char *at, uint32_t &value)
+                {
+                    if (end - at < 4)
+                    {
+                        return false;
+                    }
+                    auto result = std::from_chars(at, at + 4, value, 16);
+                    return result.ec == std::errc() && result.ptr == at + 4;
+                };
+                uint32_t codePoint;
+                if (!hex(cursor + 1, codePoint))
+                {
+                    return false;
+                }
+                cursor += 4;
+                uint32_t low;
+                if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - cursor > 6 && cursor[1] == '\\' &&
+                    cursor[2] == 'u' && hex(cursor + 3, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    cursor += 6;
+                }
+                appendUtf8(out, codePoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    char at(size_t index) const
+    {
+        return index < positions.size() ? data[positions[index]] : '\0';
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    /**
+     * @brief Check for a string opened at positions[index] that runs to the end of its line.
+     */
+    bool unterminated(size_t index) const
+    {
+        return at(index) == '"' && (at(index + 1) == '\n' || at(index + 1) == '\0');
+    }
+
+    /**
+     * @brief Get the trimmed text of a scalar value ending before a structural.
+     */
+    std::string scalarBefore(uint32_t from, uint32_t to) const
+    {
+        while (from < to && isSpace(data[from]))
+        {
+            ++from;
+        }
+        while (to > from && isSpace(data[to - 1]))
+        {
+            --to;
+        }
+        return std::string(data + from, to - from);
+    }
+
+    /**
+     * @brief Parse one record starting at positions[next].
+     */
+    bool parseRecord(std::optional<Beer> &beer, std::string &error)
+    {
+        std::string name, style, updatedDate;
+        double alcoholContent = 0;
+        int containerSize = 0, quantity = 0;
+        long long barcode = 0;
+        bool isMetric = true, hasName = false;
+
+        if (at(next) != '{')
+        {
+            error = "expected an object";
+            return false;
+        }
+        ++next;
+        if (at(next) == '}')
+        {
+            ++next;
+        }
+        else
+        {
+            while (true)
+            {
+                std::string key, text;
+                if (at(next) != '"' || at(next + 1) != '"' || !decodeString(positions[next], positions[next + 1], key))
+                {
+                    error = unterminated(next) ? "unterminated string" : "expected a key";
+                    return false;
+                }
+                next += 2;
+                if (at(next) != ':')
+                {
+                    error = "expected ':' after \"" + key + "\"";
+                    return false;
+                }
+                uint32_t valueStart = positions[next] + 1;
+                ++next;
+                while (valueStart < length && isSpace(data[valueStart]))
+                {
+                    ++valueStart;
+                }
+                bool isString = next < positions.size() && positions[next] == valueStart && at(next) == '"';
+                if (isString)
+                {
+                    if (at(next + 1) != '"' || !decodeString(positions[next], positions[next + 1], text))
+                    {
+                        error = unterminated(next) ? "unterminated string for \"" + key + "\""
+                                                   : "bad string for \"" + key + "\"";
+                        return false;
+                    }
+                    next += 2;
+                }
+                else if (next < positions.size() && positions[next] == valueStart && (at(next) == '{' || at(next) == '['))
+                {
+                    int depth = 0;
+                    do
+                    {
+                        char c = at(next);
+                        depth += (c == '{' || c == '[') - (c == '}' || c == ']');
+                        if (c == '\n' || c == '\0')
+                        {
+                            error = "unterminated value for \"" + key + "\"";
+                            return false;
+                        }
+                        ++next;
+                    } while (depth > 0);
+                    if (key == "name" || key == "style" || key == "updated_date" || key == "alcohol_content" ||
+                        key == "container_size" || key == "quantity" || key == "barcode" || key == "is_metric")
+                    {
+                        error = "bad value for \"" + key + "\"";
+                        return false;
+                    }
+                    key.clear(); // nested values are never Beer fields
+                }
+                else
+                {
+                    text = scalarBefore(valueStart, next < positions.size() ? positions[next] : static_cast<uint32_t>(length));
+                }
+
+                bool ok = true;
+                auto parseInt = [&text, &ok, isString](auto &value)
+                {
+                    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+                    ok = !isString && result.ec == std::errc() && result.ptr == text.data() + text.size();
+                };
+                bool isNull = !isString && text == "null";
+                if (key == "name")
+                {
+                    name = text;
+                    hasName = isString;
+                    ok = isString;
+                }
+                else if (key == "style")
+                {
+                    style = isNull ? std::string() : text;
+                    ok = isString || isNull;
+                }
+                else if (key == "updated_date")
+                {
+                    updatedDate = isNull ? std::string() : text;
+                    ok = isString || isNull;
+                }
+                else if (key == "alcohol_content")
+                {
+                    char *parsedEnd = nullptr;
+                    alcoholContent = std::strtod(text.c_str(), &parsedEnd);
+                    ok = !isString && !text.empty() && parsedEnd == text.c_str() + text.size();
+                }
+                else if (key == "container_size")
+                {
+                    parseInt(containerSize);
+                }
+                else if (key == "quantity")
+                {
+                    parseInt(quantity);
+                }
+                else if (key == "barcode")
+                {
+                    parseInt(barcode);
+                }
+                else if (key == "is_metric")
+                {
+                    ok = !isString && (text == "true" || text == "false" || text == "1" || text == "0");
+                    isMetric = text == "true" || text == "1";
+                }
+                if (!ok)
+                {
+                    error = "bad value for \"" + key + "\"";
+                    return false;
+                }
+
+                char separator = at(next++);
+                if (separator == '}')
+                {
+                    break;
+                }
+                if (separator != ',')
+                {
+                    error = "expected ',' or '}'";
+                    return false;
+                }
+            }
+        }
+        uint32_t lineEnd = next < positions.size() ? positions[next] : static_cast<uint32_t>(length);
+        if ((next < positions.size() && at(next) != '\n') || !scalarBefore(positions[next - 1] + 1, lineEnd).empty())
+        {
+            error = "trailing characters after the object";
+            return false;
+        }
+        ++next;
+        if (!hasName)
+        {
+            error = "missing \"name\"";
+            return false;
+        }
+        beer.emplace(style, name, alcoholContent, ContainerSize(isMetric, containerSize), quantity, barcode);
+        if (!updatedDate.empty())
+        {
+            beer->setUpdatedDate(updatedDate);
+        }
+        return true;
+    }
+
+public:
+    /**
+     * @brief Constructor for JsonLinesReader.
+     * @param data The JSON Lines text (must outlive the reader).
+     * @param length The text length (below 4 GiB).
+     */
+    JsonLinesReader(const char *data, size_t length) : data(data), length(length), next(0)
+    {
+        JsonStructuralScanner::scan(data, length, positions);
+    }
+
+    /**
+     * @brief Parse every record.
+     * @param beers Receives the parsed beers (ids unassigned).
+     */
+    void readAll(std::vector<Beer> &beers)
+    {
+        size_t line = 1;
+        uint32_t lineStart = 0;
+        while (lineStart < length)
+        {
+            // A line holding only a scalar has no structural before its newline.
+            uint32_t first = next < positions.size() ? positions[next] : static_cast<uint32_t>(length);
+            bool leadingText = !scalarBefore(lineStart, first).empty();
+            size_t lineEnd = next;
+            while (lineEnd < positions.size() && at(lineEnd) != '\n')
+            {
+                ++lineEnd;
+            }
+            if (leadingText)
+            {
+                errors.push_back("line " + std::to_string(line) + ": expected an object");
+            }
+            else if (at(next) != '\n' && next < positions.size()) // not a blank line
+            {
+                std::optional<Beer> beer;
+                std::string error;
+                if (parseRecord(beer, error))
+                {
+                    beers.push_back(*beer);
+                }
+                else
+                {
+                    errors.push_back("line " + std::to_string(line) + ": " + error);
+                }
+            }
+            lineStart = lineEnd < positions.size() ? positions[lineEnd] + 1 : static_cast<uint32_t>(length);
+            next = lineEnd + 1;
+            ++line;
+        }
+    }
+
+    /**
+     * @brief Get the errors of rejected lines.
+     * @return One message per rejected line.
+     */
+    const std::vector<std::string> &getErrors() const
+    {
+        return errors;
+    }
+};
+
+/**
+ * @brief Streams beers out as JSON Lines through a large output buffer.
+ *
+ * Numbers are formatted with std::to_chars straight into the buffer, which is
+ * written out whenever it is close to full.
+ */
+class JsonLinesWriter
+{
+private:
+    std::ostream &out;
+    std::vector<char> buffer;
+    size_t used;
+
+    static const size_t BUFFER_SIZE = 1 << 20;
+    static const size_t MAX_NUMBER = 32;
+
+    void reserve(size_t bytes)
+    {
+        if (used + bytes > buffer.size())
+        {
+            flush();
+            if (bytes > buffer.size())
+            {
+                buffer.resize(bytes);
+            }
+        }
+    }
+
+    void raw(const char *text, size_t size)
+    {
+        reserve(size);
+        std::memcpy(buffer.data() + used, text, size);
+        used += size;
+    }
+
+    template <size_t N>
+    void literal(const char (&text)[N])
+    {
+        raw(text, N - 1);
+    }
+
+    template <typename T>
+    void number(T value)
+    {
+        reserve(MAX_NUMBER);
+        used = std::to_chars(buffer.data() + used, buffer.data() + used + MAX_NUMBER, value).ptr - buffer.data();
+    }
+
+    void string(const std::string &value)
+    {
+        reserve(value.size() * 6 + 2);
+        char *cursor = buffer.data() + used;
+        *cursor++ = '"';
+        for (unsigned char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                *cursor++ = '\\';
+                *cursor++ = static_cast<char>(c);
+            }
+            else if (c < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                std::memcpy(cursor, "\\u00", 4);
+                cursor[4] = hex[c >> 4];
+                cursor[5] = hex[c & 0xF];
+                cursor += 6;
+            }
+            else
+            {
+                *cursor++ = static_cast<char>(c);
+            }
+        }
+        *cursor++ = '"';
+        used = cursor - buffer.data();
+    }
+
+public:
+    explicit JsonLinesWriter(std::ostream &out) : out(out), buffer(BUFFER_SIZE), used(0) {}
+
+    ~JsonLinesWriter()
+    {
+        flush();
+    }
+
+    /**
+     * @brief Append one beer as a JSON object line.
+     * @param beer The beer to write.
+     */
+    void write(const Beer &beer)
+    {
+        literal("{\"id\":");
+        number(beer.getId());
+        literal(",\"name\":");
+        string(beer.getName());
+        literal(",\"style\":");
+        string(beer.getStyle());
+        literal(",\"alcohol_content\":");
+        number(beer.getAlcoholContent());
+        literal(",\"container_size\":");
+        number(beer.getContainerSize().getSize());
+        if (beer.getContainerSize().getIsMetric())
+        {
+            literal(",\"is_metric\":true,\"quantity\":");
+        }
+        else
+        {
+            literal(",\"is_metric\":false,\"quantity\":");
+        }
+        number(beer.getQuantity());
+        literal(",\"barcode\":");
+        number(beer.getBarcode().getValue());
+        literal(",\"updated_date\":");
+        string(beer.getUpdatedDate());
+        literal("}\n");
+    }
+
+    /**
+     * @brief Write the buffered output to the stream.
+     */
+    void flush()
+    {
+        out.write(buffer.data(), used);
+        used = 0;
+    }
+};
+
+/**
+ * @brief The attributes of a beer that queries can refer to.
+ *
+ * The order matches ColumnarFormat::schema(), so the same names are used in
+ * queries, columnar files, Arrow streams and JSON Lines.
+ */
+enum class BeerColumn : uint8_t
+{
+    ID,
+    NAME,
+    STYLE,
+    ALCOHOL_CONTENT,
+    CONTAINER_SIZE,
+    IS_METRIC,
+    QUANTITY,
+    BARCODE,
+    UPDATED_DATE
+};
+
+const size_t BEER_COLUMN_COUNT = 9;
+
+/**
+ * @brief Get the value type of a beer column.
+ */
+ColumnType beerColumnType(BeerColumn column)
+{
+    return ColumnarFormat::schema()[static_cast<size_t>(column)].second;
+}
+
+/**
+ * @brief Get the name of a beer column.
+ */
+const std::string &beerColumnName(BeerColumn column)
+{
+    return ColumnarFormat::schema()[static_cast<size_t>(column)].first;
+}
+
+/**
+ * @brief Look up a beer column by name (abv and size are accepted as aliases).
+ * @param name The lower-case column name.
+ * @param column Receives the column.
+ * @return True if the name is a column.
+ */
+bool findBeerColumn(const std::string &name, BeerColumn &column)
+{
+    std::string canonical = name == "abv" ? "alcohol_content" : name == "size" ? "container_size" : name;
+    for (size_t i = 0; i < BEER_COLUMN_COUNT; ++i)
+    {
+        if (ColumnarFormat::schema()[i].first == canonical)
+        {
+            column = static_cast<BeerColumn>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief A single value produced or consumed by a query.
+ */
+struct QueryValue
+{
+    ColumnType type = ColumnType::INT64;
+    int64_t intValue = 0;
+    double doubleValue = 0;
+    std::string stringValue;
+
+    static QueryValue ofInt(int64_t value)
+    {
+        QueryValue result;
+        result.intValue = value;
+        return result;
+    }
+
+    static QueryValue ofDouble(double value)
+    {
+        QueryValue result;
+        result.type = ColumnType::DOUBLE;
+        result.doubleValue = value;
+        return result;
+    }
+
+    static QueryValue ofString(const std::string &value)
+    {
+        QueryValue result;
+        result.type = ColumnType::STRING;
+        result.stringValue = value;
+        return result;
+    }
+
+    /**
+     * @brief Get a numeric value as a double.
+     */
+    double asDouble() const
+    {
+        return type == ColumnType::DOUBLE ? doubleValue : static_cast<double>(intValue);
+    }
+
+    /**
+     * @brief Order two values; numbers compare numerically, strings lexically.
+     * @return Negative, zero or positive like strcmp.
+     */
+    int compare(const QueryValue &other) const
+    {
+        if (type == ColumnType::STRING || other.type == ColumnType::STRING)
+        {
+            return stringValue.compare(other.stringValue);
+        }
+        if (type == ColumnType::INT64 && other.type == ColumnType::INT64)
+        {
+            return (intValue > other.intValue) - (intValue < other.intValue);
+        }
+        return (asDouble() > other.asDouble()) - (asDouble() < other.asDouble());
+    }
+
+    /**
+     * @brief Append an encoding of the value to a grouping key.
+     */
+    void appendKey(std::string &key) const
+    {
+        appendPod(key, intValue);
+        appendPod(key, doubleValue);
+        appendString(key, stringValue);
+    }
+
+    /**
+     * @brief Format the value for display.
+     */
+    std::string toString() const
+    {
+        if (type == ColumnType::STRING)
+        {
+            return stringValue;
+        }
+        if (type == ColumnType::INT64)
+        {
+            return std::to_string(intValue);
+        }
+        char buffer[32];
+        return std::string(buffer, std::to_chars(buffer, buffer + sizeof(buffer), doubleValue).ptr);
+    }
+};
+
+/**
+ * @brief Get one attribute of a beer as a QueryValue.
+ */
+QueryValue beerColumnValue(const Beer &beer, BeerColumn column)
+{
+    switch (column)
+    {
+    case BeerColumn::ID:
+        return QueryValue::ofInt(beer.getId());
+    case BeerColumn::NAME:
+        return QueryValue::ofString(beer.getName());
+    case BeerColumn::STYLE:
+        return QueryValue::ofString(beer.getStyle());
+    case BeerColumn::ALCOHOL_CONTENT:
+        return QueryValue::ofDouble(beer.getAlcoholContent());
+    case BeerColumn::CONTAINER_SIZE:
+        return QueryValue::ofInt(beer.getContainerSize().getSize());
+    case BeerColumn::IS_METRIC:
+        return QueryValue::ofInt(beer.getContainerSize().getIsMetric() ? 1 : 0);
+    case BeerColumn::QUANTITY:
+        return QueryValue::ofInt(beer.getQuantity());
+    case BeerColumn::BARCODE:
+        return QueryValue::ofInt(beer.getBarcode().getValue());
+    default:
+        return QueryValue::ofString(beer.getUpdatedDate());
+    }
+}
+
+/**
+ * @brief A comparison operator in a WHERE clause.
+ */
+enum class CompareOp : uint8_t
+{
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE
+};
+
+/**
+ * @brief A node of a WHERE clause: a comparison or a boolean combination.
+ */
+struct Predicate
+{
+    enum Kind : uint8_t
+    {
+        COMPARE,
+        AND,
+        OR,
+        NOT
+    };
+
+    Kind kind = COMPARE;
+    BeerColumn column = BeerColumn::ID; // COMPARE only
+    CompareOp op = CompareOp::EQ;       // COMPARE only
+    QueryValue literal;                 // COMPARE only
+    int parameter = -1;                 // COMPARE only: the "?" that supplies the literal, if any
+    std::vector<std::unique_ptr<Predicate>> children;
+
+    static std::unique_ptr<Predicate> compare(BeerColumn column, CompareOp op, const QueryValue &literal)
+    {
+        std::unique_ptr<Predicate> predicate(new Predicate());
+        predicate->column = column;
+        predicate->op = op;
+        predicate->literal = literal;
+        return predicate;
+    }
+
+    static std::unique_ptr<Predicate> combine(Kind kind, std::unique_ptr<Predicate> left, std::unique_ptr<Predicate> right)
+    {
+        std::unique_ptr<Predicate> predicate(new Predicate());
+        predicate->kind = kind;
+        predicate->children.push_back(std::move(left));
+        if (right)
+        {
+            predicate->children.push_back(std::move(right));
+        }
+        return predicate;
+    }
+};
+
+/**
+ * @brief Evaluate a WHERE clause against a single beer.
+ * @param predicate The clause, with every parameter bound.
+ * @param beer The beer to test.
+ * @return True if the beer satisfies the clause.
+ */
+bool matchesPredicate(const Predicate &predicate, const Beer &beer)
+{
+    switch (predicate.kind)
+    {
+    case Predicate::COMPARE:
+    {
+        int comparison = beerColumnValue(beer, predicate.column).compare(predicate.literal);
+        switch (predicate.op)
+        {
+        case CompareOp::EQ:
+            return comparison == 0;
+        case CompareOp::NE:
+            return comparison != 0;
+        case CompareOp::LT:
+            return comparison < 0;
+        case CompareOp::LE:
+            return comparison <= 0;
+        case CompareOp::GT:
+            return comparison > 0;
+        default:
+            return comparison >= 0;
+        }
+    }
+    case Predicate::AND:
+        for (const auto &child : predicate.children)
+        {
+            if (!matchesPredicate(*child, beer))
+            {
+                return false;
+            }
+        }
+        return true;
+    case Predicate::OR:
+        for (const auto &child : predicate.children)
+        {
+            if (matchesPredicate(*child, beer))
+            {
+                return true;
+            }
+        }
+        return false;
+    default:
+        return !matchesPredicate(*predicate.children[0], beer);
+    }
+}
+
+/**
+ * @brief An aggregate function in a SELECT list.
+ */
+enum class Aggregate : uint8_t
+{
+    NONE,
+    COUNT,
+    SUM,
+    MIN,
+    MAX,
+    AVG
+};
+
+/**
+ * @brief One output column of a query.
+ */
+struct SelectItem
+{
+    Aggregate aggregate = Aggregate::NONE;
+    bool countStar = false;
+    BeerColumn column = BeerColumn::ID;
+    std::string label;
+};
+
+/**
+ * @brief One ORDER BY key, referring to an output column.
+ */
+struct OrderItem
+{
+    size_t outputIndex = 0;
+    bool descending = false;
+};
+
+/**
+ * @brief A parsed query.
+ */
+struct Query
+{
+    std::vector<SelectItem> items;
+    std::unique_ptr<Predicate> where;
+    std::vector<BeerColumn> groupBy;
+    std::vector<OrderItem> orderBy;
+    int64_t limit = -1;
+    bool explain = false; // show the plan instead of the rows
+    size_t parameterCount = 0; // "?" placeholders to bind before running
+
+    /**
+     * @brief Check whether the query aggregates (explicitly or through GROUP BY).
+     */
+    bool isAggregate() const
+    {
+        if (!groupBy.empty())
+        {
+            return true;
+        }
+        for (const SelectItem &item : items)
+        {
+            if (item.aggregate != Aggregate::NONE)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief One "column = value" assignment of an UPDATE.
+ */
+struct ColumnChange
+{
+    BeerColumn column;
+    QueryValue value;
+};
+
+/**
+ * @brief A statement entered at the query prompt.
+ */
+struct QueryStatement
+{
+    enum Kind : uint8_t
+    {
+        SELECT,
+        PREPARE,
+        EXECUTE,
+        CREATE_VIEW,
+        SHOW_VIEW,
+        SHOW_VIEWS,
+        DROP_VIEW,
+        WATCH,
+        UNWATCH,
+        SHOW_WATCHES,
+        SHOW_HOT,
+        SHOW_DEAD,
+        SHOW_ACTIVITY,
+        SHOW_PREFIX,
+        SHOW_CHANGED,
+        SHOW_UNTOUCHED,
+        SHOW_RECENT,
+        CREATE_REPORT,
+        DROP_REPORT,
+        SHOW_REPORTS,
+        RUN_REPORTS,
+        SHOW_ABV_BANDS,
+        UPDATE,
+        DELETE,
+        RECEIVE,
+        SHOW_EXPIRING,
+        SHOW_LOTS
+    };
+
+    Kind kind = SELECT;
+    std::string name;                  // PREPARE, EXECUTE, the view and report kinds; WATCH: "barcode" or "style"; SHOW PREFIX: the digits
+    std::string body;                  // SELECT / PREPARE / CREATE_VIEW / CREATE_REPORT: the query text; UPDATE / DELETE: the condition
+    std::vector<QueryValue> arguments; // EXECUTE; WATCH: key and threshold; UNWATCH: watch id; SHOW HOT/DEAD/RECENT: optional limit;
+                                       // SHOW CHANGED: date; SHOW UNTOUCHED: days; SHOW ABV BANDS: optional width;
+                                       // RECEIVE: quantity, beer id and date; SHOW EXPIRING: optional days; SHOW LOTS: beer id
+    bool below = false;                // WATCH: fire on dropping below rather than rising above
+    bool totalsOnly = false;           // SHOW PREFIX: skip the listing
+    std::vector<ColumnChange> changes; // UPDATE
+};
+
+/**
+ * @brief Parses the query language:
+ *
+ *   [EXPLAIN] SELECT * | item [, item ...]
+ *   [WHERE condition]
+ *   [GROUP BY column [, column ...]]
+ *   [ORDER BY output [ASC|DESC] [, ...]]
+ *   [LIMIT n]
+ *
+ * An item is a column or COUNT(*), COUNT/SUM/MIN/MAX/AVG(column). Conditions
+ * combine "column op literal" (op is =, !=, <>, <, <=, >, >=),
+ * "column [NOT] BETWEEN a AND b" and "column [NOT] IN (a, ...)" with AND, OR,
+ * NOT and parentheses. Strings are quoted with single quotes, and a "?" in
+ * place of a literal is a parameter bound when a prepared query runs.
+ * Keywords and column names are case-insensitive. Errors throw
+ * std::invalid_argument.
+ */
+class QueryParser
+{
+private:
+    struct Token
+    {
+        enum Kind : uint8_t
+        {
+            WORD,
+            NUMBER,
+            STRING,
+            SYMBOL,
+            END
+        };
+        Kind kind;
+        std::string text; // words are lower-cased
+        size_t offset;    // where the token starts in the query text
+    };
+
+    std::vector<Token> tokens;
+    size_t position;
+    size_t parameterCount;
+
+    static std::string lower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    void tokenize(const std::string &text)
+    {
+        size_t i = 0;
+        while (i < text.size())
+        {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            size_t start = i;
+            if (std::isspace(c))
+            {
+                ++i;
+            }
+            else if (std::isalpha(c) || c == '_')
+            {
+                while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_'))
+                {
+                    ++i;
+                }
+                tokens.push_back(Token{Token::WORD, lower(text.substr(start, i - start)), start});
+            }
+            else if (std::isdigit(c) || ((c == '-' || c == '.') && i + 1 < text.size() && std::isdigit(static_cast<unsigned char>(text[i + 1]))))
+            {
+                ++i;
+                while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '.' ||
+                                           ((text[i] == '-' || text[i] == '+') && (text[i - 1] == 'e' || text[i - 1] == 'E'))))
+                {
+                    ++i;
+                }
+                tokens.push_back(Token{Token::NUMBER, text.substr(start, i - start), start});
+            }
+            else if (c == '\'')
+            {
+                std::string value;
+                for (++i;; ++i)
+                {
+                    if (i >= text.size())
+                    {
+                        throw std::invalid_argument("unterminated string literal");
+                    }
+                    if (text[i] == '\'')
+                    {
+                        if (i + 1 < text.size() && text[i + 1] == '\'')
+                        {
+                            value.push_back('\'');
+                            ++i;
+                            continue;
+                        }
+                        ++i;
+                        break;
+                    }
+                    value.push_back(text[i]);
+                }
+                tokens.push_back(Token{Token::STRING, value, start});
+            }
+            else
+            {
+                std::string symbol(1, static_cast<char>(c));
+                if (i + 1 < text.size() && ((c == '<' && (text[i + 1] == '=' || text[i + 1] == '>')) ||
+                                            ((c == '>' || c == '!') && text[i + 1] == '=')))
+                {
+                    symbol.push_back(text[i + 1]);
+                }
+                if (symbol != "(" && symbol != ")" && symbol != "," && symbol != "*" && symbol != "=" && symbol != "<" &&
+                    symbol != ">" && symbol != "<=" && symbol != ">=" && symbol != "<>" && symbol != "!=" && symbol != ";" && symbol != "?")
+                {
+                    throw std::invalid_argument("unexpected character '" + symbol + "'");
+                }
+                i += symbol.size();
+                tokens.push_back(Token{Token::SYMBOL, symbol, start});
+            }
+        }
+        if (!tokens.empty() && tokens.back().kind == Token::SYMBOL && tokens.back().text == ";")
+        {
+            tokens.pop_back();
+        }
+        tokens.push_back(Token{Token::END, "", text.size()});
+    }
+
+    const Token &peek(size_t ahead = 0) const
+    {
+        return tokens[std::min(position + ahead, tokens.size() - 1)];
+    }
+
+    bool accept(const std::string &text)
+    {
+        if ((peek().kind == Token::WORD || peek().kind == Token::SYMBOL) && peek().text == text)
+        {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const std::string &text)
+    {
+        if (!accept(text))
+        {
+            throw std::invalid_argument("expected " + text + " near '" + peek().text + "'");
+        }
+    }
+
+    BeerColumn parseColumn()
+    {
+        BeerColumn column;
+        if (peek().kind != Token::WORD || !findBeerColumn(peek().text, column))
+        {
+            throw std::invalid_argument("unknown column '" + peek().text + "'");
+        }
+        ++position;
+        return column;
+    }
+
+    QueryValue parseLiteral()
+    {
+        const Token &token = peek();
+        ++position;
+        if (token.kind == Token::STRING)
+        {
+            return QueryValue::ofString(token.text);
+        }
+        if (token.kind == Token::WORD && (token.text == "true" || token.text == "false"))
+        {
+            return QueryValue::ofInt(token.text == "true" ? 1 : 0);
+        }
+        if (token.kind == Token::NUMBER)
+        {
+            int64_t intValue;
+            auto result = std::from_chars(token.text.data(), token.text.data() + token.text.size(), intValue);
+            if (result.ec == std::errc() && result.ptr == token.text.data() + token.text.size())
+            {
+                return QueryValue::ofInt(intValue);
+            }
+            char *end = nullptr;
+            double doubleValue = std::strtod(token.text.c_str(), &end);
+            if (end == token.text.c_str() + token.text.size())
+            {
+                return QueryValue::ofDouble(doubleValue);
+            }
+        }
+        throw std::invalid_argument("expected a literal near '" + token.text + "'");
+    }
+
+    std::unique_ptr<Predicate> parseComparison(BeerColumn column, CompareOp op)
+    {
+        if (accept("?"))
+        {
+            std::unique_ptr<Predicate> predicate = Predicate::compare(column, op, QueryValue());
+            predicate->parameter = static_cast<int>(parameterCount++);
+            return predicate;
+        }
+        QueryValue literal = parseLiteral();
+        checkLiteral(column, literal);
+        return Predicate::compare(column, op, literal);
+    }
+
+    std::unique_ptr<Predicate> parsePrimary()
+    {
+        if (accept("("))
+        {
+            std::unique_ptr<Predicate> inner = parseOr();
+            expect(")");
+            return inner;
+        }
+        BeerColumn column = parseColumn();
+        bool negated = accept("not");
+        std::unique_ptr<Predicate> result;
+        if (accept("between"))
+        {
+            std::unique_ptr<Predicate> low = parseComparison(column, CompareOp::GE);
+            expect("and");
+            result = Predicate::combine(Predicate::AND, std::move(low), parseComparison(column, CompareOp::LE));
+        }
+        else if (accept("in"))
+        {
+            expect("(");
+            do
+            {
+                std::unique_ptr<Predicate> equal = parseComparison(column, CompareOp::EQ);
+                result = result ? Predicate::combine(Predicate::OR, std::move(result), std::move(equal)) : std::move(equal);
+            } while (accept(","));
+            expect(")");
+        }
+        else
+        {
+            if (negated)
+            {
+                throw std::invalid_argument("expected BETWEEN or IN after NOT");
+            }
+            static const std::vector<std::pair<std::string, CompareOp>> operators = {
+                {"=", CompareOp::EQ}, {"!=", CompareOp::NE}, {"<>", CompareOp::NE}, {"<", CompareOp::LT}, {"<=", CompareOp::LE}, {">", CompareOp::GT}, {">=", CompareOp::GE}};
+            for (const auto &candidate : operators)
+            {
+                if (accept(candidate.first))
+                {
+                    return parseComparison(column, candidate.second);
+                }
+            }
+            throw std::invalid_argument("expected a comparison after " + beerColumnName(column));
+        }
+        return negated ? Predicate::combine(Predicate::NOT, std::move(result), nullptr) : std::move(result);
+    }
+
+    std::unique_ptr<Predicate> parseNot()
+    {
+        if (accept("not"))
+        {
+            return Predicate::combine(Predicate::NOT, parseNot(), nullptr);
+        }
+        return parsePrimary();
+    }
+
+    std::unique_ptr<Predicate> parseAnd()
+    {
+        std::unique_ptr<Predicate> left = parseNot();
+        while (accept("and"))
+        {
+            left = Predicate::combine(Predicate::AND, std::move(left), parseNot());
+        }
+        return left;
+    }
+
+    std::unique_ptr<Predicate> parseOr()
+    {
+        std::unique_ptr<Predicate> left = parseAnd();
+        while (accept("or"))
+        {
+            left = Predicate::combine(Predicate::OR, std::move(left), parseAnd());
+        }
+        return left;
+    }
+
+    SelectItem parseSelectItem()
+    {
+        static const std::vector<std::pair<std::string, Aggregate>> aggregates = {
+            {"count", Aggregate::COUNT}, {"sum", Aggregate::SUM}, {"min", Aggregate::MIN}, {"max", Aggregate::MAX}, {"avg", Aggregate::AVG}};
+        SelectItem item;
+        for (const auto &candidate : aggregates)
+        {
+            if (peek().kind == Token::WORD && peek().text == candidate.first && peek(1).text == "(")
+            {
+                position += 2;
+                item.aggregate = candidate.second;
+                std::string upper = candidate.first;
+                std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+                if (item.aggregate == Aggregate::COUNT && accept("*"))
+                {
+                    item.countStar = true;
+                    item.label = upper + "(*)";
+                }
+                else
+                {
+                    item.column = parseColumn();
+                    if ((item.aggregate == Aggregate::SUM || item.aggregate == Aggregate::AVG) &&
+                        beerColumnType(item.column) == ColumnType::STRING)
+                    {
+                        throw std::invalid_argument(upper + " needs a numeric column");
+                    }
+                    item.label = upper + "(" + beerColumnName(item.column) + ")";
+                }
+                expect(")");
+                return item;
+            }
+        }
+        item.column = parseColumn();
+        item.label = beerColumnName(item.column);
+        return item;
+    }
+
+public:
+    /**
+     * @brief Parse a query.
+     * @param text The query text.
+     * @return The parsed query.
+     */
+    static Query parse(const std::string &text)
+    {
+        QueryParser parser;
+        parser.position = 0;
+        parser.parameterCount = 0;
+        parser.tokenize(text);
+        return parser.parseQuery();
+    }
+
+    /**
+     * @brief Parse a statement: a query, "PREPARE name AS query",
+     * "EXECUTE name [(value, ...)]", "CREATE VIEW name AS query",
+     * "SHOW VIEW name", "SHOW VIEWS", "DROP VIEW name",
+     * "WATCH BARCODE number|STYLE 'style' BELOW|ABOVE number",
+     * "UNWATCH id", "SHOW WATCHES", "SHOW HOT [n]", "SHOW DEAD [n]",
+     * "SHOW ACTIVITY", "SHOW PREFIX digits [TOTALS]",
+     * "SHOW CHANGED SINCE 'date'", "SHOW UNTOUCHED days", "SHOW RECENT [n]",
+     * "CREATE REPORT name AS query", "DROP REPORT name", "SHOW REPORTS",
+     * "RUN REPORTS", "SHOW ABV BANDS [width]",
+     * "UPDATE SET column = value [, ...] WHERE condition",
+     * "DELETE WHERE condition", "RECEIVE quantity OF id BEST BEFORE 'date'",
+     * "SHOW EXPIRING [days]" or "SHOW LOTS id".
+     * @param text The statement text.
+     * @return The statement; queries are returned unparsed in body.
+     */
+    static QueryStatement parseStatement(const std::string &text)
+    {
+        QueryParser parser;
+        parser.position = 0;
+        parser.parameterCount = 0;
+        parser.tokenize(text);
+        QueryStatement statement;
+        auto parseName = [&parser]()
+        {
+            if (parser.peek().kind != Token::WORD)
+            {
+                throw std::invalid_argument("expected a name near '" + parser.peek().text + "'");
+            }
+            return parser.tokens[parser.position++].text;
+        };
+        auto parseTyped = [&parser](ColumnType type, const char *what)
+        {
+            QueryValue value = parser.parseLiteral();
+            if (value.type != type)
+            {
+                throw std::invalid_argument(std::string("expected ") + what + " near '" + value.toString() + "'");
+            }
+            return value;
+        };
+        if (parser.accept("prepare"))
+        {
+            statement.kind = QueryStatement::PREPARE;
+            statement.name = parseName();
+            parser.expect("as");
+            statement.body = text.substr(parser.peek().offset);
+            return statement;
+        }
+        if (parser.accept("create"))
+        {
+            statement.kind = parser.accept("report") ? QueryStatement::CREATE_REPORT : QueryStatement::CREATE_VIEW;
+            if (statement.kind == QueryStatement::CREATE_VIEW)
+            {
+                parser.expect("view");
+            }
+            statement.name = parseName();
+            parser.expect("as");
+            statement.body = text.substr(parser.peek().offset);
+            return statement;
+        }
+        if (parser.accept("execute"))
+        {
+            statement.kind = QueryStatement::EXECUTE;
+            statement.name = parseName();
+            bool parenthesized = parser.accept("(");
+            while (parser.peek().kind != Token::END && !(parenthesized && parser.peek().text == ")"))
+            {
+                statement.arguments.push_back(parser.parseLiteral());
+                if (!parser.accept(","))
+                {
+                    break;
+                }
+            }
+            if (parenthesized)
+            {
+                parser.expect(")");
+            }
+        }
+        else if (parser.accept("watch"))
+        {
+            statement.kind = QueryStatement::WATCH;
+            if (parser.accept("barcode"))
+            {
+                statement.name = "barcode";
+                statement.arguments.push_back(parseTyped(ColumnType::INT64, "a barcode"));
+            }
+            else
+            {
+                parser.expect("style");
+                statement.name = "style";
+                statement.arguments.push_back(parseTyped(ColumnType::STRING, "a quoted style"));
+            }
+            statement.below = parser.accept("below");
+            if (!statement.below)
+            {
+                parser.expect("above");
+            }
+            statement.arguments.push_back(parseTyped(ColumnType::INT64, "a whole-number threshold"));
+        }
+        else if (parser.accept("unwatch"))
+        {
+            statement.kind = QueryStatement::UNWATCH;
+            statement.arguments.push_back(parseTyped(ColumnType::INT64, "a watch id"));
+        }
+        else if (parser.accept("show"))
+        {
+            if (parser.accept("views"))
+            {
+                statement.kind = QueryStatement::SHOW_VIEWS;
+            }
+            else if (parser.accept("reports"))
+            {
+                statement.kind = QueryStatement::SHOW_REPORTS;
+            }
+            else if (parser.accept("abv"))
+            {
+                parser.expect("bands");
+                statement.kind = QueryStatement::SHOW_ABV_BANDS;
+                if (parser.peek().kind != Token::END)
+                {
+                    QueryValue width = parser.parseLiteral();
+                    if (width.type == ColumnType::STRING || width.asDouble() <= 0)
+                    {
+                        throw std::invalid_argument("expected a positive band width near '" + width.toString() + "'");
+                    }
+                    statement.arguments.push_back(width);
+                }
+            }
+            else if (parser.accept("watches"))
+            {
+                statement.kind = QueryStatement::SHOW_WATCHES;
+            }
+            else if (parser.accept("activity"))
+            {
+                statement.kind = QueryStatement::SHOW_ACTIVITY;
+            }
+            else if (parser.accept("prefix"))
+            {
+                // Kept as text: the leading zeros of a company prefix matter.
+                if (parser.peek().kind != Token::NUMBER)
+                {
+                    throw std::invalid_argument("expected barcode digits near '" + parser.peek().text + "'");
+                }
+                statement.kind = QueryStatement::SHOW_PREFIX;
+                statement.name = parser.tokens[parser.position++].text;
+                statement.totalsOnly = parser.accept("totals");
+            }
+            else if (parser.accept("changed"))
+            {
+                parser.expect("since");
+                statement.kind = QueryStatement::SHOW_CHANGED;
+                statement.arguments.push_back(parseTyped(ColumnType::STRING, "a quoted date"));
+            }
+            else if (parser.accept("untouched"))
+            {
+                statement.kind = QueryStatement::SHOW_UNTOUCHED;
+                statement.arguments.push_back(parseTyped(ColumnType::INT64, "a number of days"));
+            }
+            else if (parser.accept("expiring"))
+            {
+                statement.kind = QueryStatement::SHOW_EXPIRING;
+                if (parser.peek().kind != Token::END)
+                {
+                    statement.arguments.push_back(parseTyped(ColumnType::INT64, "a number of days"));
+                }
+            }
+            else if (parser.accept("lots"))
+            {
+                statement.kind = QueryStatement::SHOW_LOTS;
+                statement.arguments.push_back(parseTyped(ColumnType::INT64, "a beer id"));
+            }
+            else if (parser.peek().text == "hot" || parser.peek().text == "dead" || parser.peek().text == "recent")
+            {
+                std::string which = parseName();
+                statement.kind = which == "hot" ? QueryStatement::SHOW_HOT : which == "dead" ? QueryStatement::SHOW_DEAD : QueryStatement::SHOW_RECENT;
+                if (parser.peek().kind != Token::END)
+                {
+                    statement.arguments.push_back(parseTyped(ColumnType::INT64, "a row limit"));
+                }
+            }
+            else
+            {
+                parser.expect("view");
+                statement.kind = QueryStatement::SHOW_VIEW;
+                statement.name = parseName();
+            }
+        }
+        else if (parser.accept("drop"))
+        {
+            statement.kind = parser.accept("report") ? QueryStatement::DROP_REPORT : QueryStatement::DROP_VIEW;
+            if (statement.kind == QueryStatement::DROP_VIEW)
+            {
+                parser.expect("view");
+            }
+            statement.name = parseName();
+        }
+        else if (parser.accept("run"))
+        {
+            parser.expect("reports");
+            statement.kind = QueryStatement::RUN_REPORTS;
+        }
+        else if (parser.accept("receive"))
+        {
+            statement.kind = QueryStatement::RECEIVE;
+            statement.arguments.push_back(parseTyped(ColumnType::INT64, "a quantity"));
+            parser.expect("of");
+            statement.arguments.push_back(parseTyped(ColumnType::INT64, "a beer id"));
+            parser.expect("best");
+            parser.expect("before");
+            statement.arguments.push_back(parseTyped(ColumnType::STRING, "a quoted date"));
+        }
+        else if (parser.peek().text == "update" || parser.peek().text == "delete")
+        {
+            statement.kind = parseName() == "update" ? QueryStatement::UPDATE : QueryStatement::DELETE;
+            if (statement.kind == QueryStatement::UPDATE)
+            {
+                parser.expect("set");
+                do
+                {
+                    ColumnChange change;
+                    change.column = parser.parseColumn();
+                    parser.expect("=");
+                    change.value = parser.parseLiteral();
+                    statement.changes.push_back(change);
+                } while (parser.accept(","));
+            }
+            // The condition is parsed, and its indexes chosen, when the statement runs.
+            parser.expect("where");
+            statement.body = text.substr(parser.peek().offset);
+            return statement;
+        }
+        else
+        {
+            statement.body = text;
+            return statement;
+        }
+        if (parser.peek().kind != Token::END)
+        {
+            throw std::invalid_argument("unexpected '" + parser.peek().text + "'");
+        }
+        return statement;
+    }
+
+    /**
+     * @brief Check that a literal can be compared with a column.
+     * @throws std::invalid_argument if a string meets a number.
+     */
+    static void checkLiteral(BeerColumn column, const QueryValue &literal)
+    {
+        if ((beerColumnType(column) == ColumnType::STRING) != (literal.type == ColumnType::STRING))
+        {
+            throw std::invalid_argument("type mismatch comparing " + beerColumnName(column) + " with '" + literal.toString() + "'");
+        }
+    }
+
+private:
+    Query parseQuery()
+    {
+        Query query;
+        query.explain = accept("explain");
+        expect("select");
+        if (accept("*"))
+        {
+            for (size_t i = 0; i < BEER_COLUMN_COUNT; ++i)
+            {
+                SelectItem item;
+                item.column = static_cast<BeerColumn>(i);
+                item.label = beerColumnName(item.column);
+                query.items.push_back(item);
+            }
+        }
+        else
+        {
+            do
+            {
+                query.items.push_back(parseSelectItem());
+            } while (accept(","));
+        }
+        if (accept("where"))
+        {
+            query.where = parseOr();
+        }
+        if (accept("group"))
+        {
+            expect("by");
+            do
+            {
+                query.groupBy.push_back(parseColumn());
+            } while (accept(","));
+        }
+        if (query.isAggregate())
+        {
+            for (const SelectItem &item : query.items)
+            {
+                if (item.aggregate == Aggregate::NONE &&
+                    std::find(query.groupBy.begin(), query.groupBy.end(), item.column) == query.groupBy.end())
+                {
+                    throw std::invalid_argument(item.label + " must appear in GROUP BY or inside an aggregate");
+                }
+            }
+        }
+        if (accept("order"))
+        {
+            expect("by");
+            do
+            {
+                std::string label = parseSelectItem().label;
+                OrderItem order;
+                bool found = false;
+                for (size_t i = 0; i < query.items.size() && !found; ++i)
+                {
+                    if (query.items[i].label == label)
+                    {
+                        order.outputIndex = i;
+                        found = true;
+                    }
+                }
+                if (!found)
+                {
+                    throw std::invalid_argument("ORDER BY " + label + " must name a selected column");
+                }
+                order.descending = accept("desc");
+                if (!order.descending)
+                {
+                    accept("asc");
+                }
+                query.orderBy.push_back(order);
+            } while (accept(","));
+        }
+        if (accept("limit"))
+        {
+            QueryValue limit = parseLiteral();
+            if (limit.type != ColumnType::INT64 || limit.intValue < 0)
+            {
+                throw std::invalid_argument("LIMIT needs a non-negative integer");
+            }
+            query.limit = limit.intValue;
+        }
+        if (peek().kind != Token::END)
+        {
+            throw std::invalid_argument("unexpected '" + peek().text + "'");
+        }
+        query.parameterCount = parameterCount;
+        return query;
+    }
+};
+
+/**
+ * @brief Up to CAPACITY beers laid out column by column for vectorized execution.
+ *
+ * Only the columns a query needs are filled. Their vectors are sized to
+ * CAPACITY up front and overwritten in place, so refilling a batch does not
+ * allocate.
+ */
+struct ColumnBatch
+{
+    static constexpr size_t CAPACITY = 1024;
+
+    size_t size = 0;
+    std::vector<BeerColumn> needed;
+    std::vector<std::vector<int64_t>> ints = std::vector<std::vector<int64_t>>(BEER_COLUMN_COUNT);
+    std::vector<std::vector<double>> doubles = std::vector<std::vector<double>>(BEER_COLUMN_COUNT);
+    std::vector<std::vector<std::string>> strings = std::vector<std::vector<std::string>>(BEER_COLUMN_COUNT);
+
+    /**
+     * @brief Fill a column from now on.
+     */
+    void need(BeerColumn column)
+    {
+        if (std::find(needed.begin(), needed.end(), column) != needed.end())
+        {
+            return;
+        }
+        needed.push_back(column);
+        size_t c = static_cast<size_t>(column);
+        switch (beerColumnType(column))
+        {
+        case ColumnType::INT64:
+            ints[c].resize(CAPACITY);
+            break;
+        case ColumnType::DOUBLE:
+            doubles[c].resize(CAPACITY);
+            break;
+        default:
+            strings[c].resize(CAPACITY);
+            break;
+        }
+    }
+
+    /**
+     * @brief Append the needed attributes of a beer; the batch must not be full.
+     */
+    void append(const Beer &beer)
+    {
+        for (BeerColumn column : needed)
+        {
+            size_t c = static_cast<size_t>(column);
+            switch (column)
+            {
+            case BeerColumn::ID:
+                ints[c][size] = beer.getId();
+                break;
+            case BeerColumn::NAME:
+                strings[c][size] = beer.getName();
+                break;
+            case BeerColumn::STYLE:
+                strings[c][size] = beer.getStyle();
+                break;
+            case BeerColumn::ALCOHOL_CONTENT:
+                doubles[c][size] = beer.getAlcoholContent();
+                break;
+            case BeerColumn::CONTAINER_SIZE:
+                ints[c][size] = beer.getContainerSize().getSize();
+                break;
+            case BeerColumn::IS_METRIC:
+                ints[c][size] = beer.getContainerSize().getIsMetric() ? 1 : 0;
+                break;
+            case BeerColumn::QUANTITY:
+                ints[c][size] = beer.getQuantity();
+                break;
+            case BeerColumn::BARCODE:
+                ints[c][size] = beer.getBarcode().getValue();
+                break;
+            case BeerColumn::UPDATED_DATE:
+                strings[c][size] = beer.getUpdatedDate();
+                break;
+            }
+        }
+        ++size;
+    }
+
+    /**
+     * @brief Empty the batch, keeping its storage.
+     */
+    void clear()
+    {
+        size = 0;
+    }
+
+    /**
+     * @brief Get one cell as a QueryValue.
+     */
+    QueryValue value(BeerColumn column, size_t row) const
+    {
+        size_t c = static_cast<size_t>(column);
+        switch (beerColumnType(column))
+        {
+        case ColumnType::INT64:
+            return QueryValue::ofInt(ints[c][row]);
+        case ColumnType::DOUBLE:
+            return QueryValue::ofDouble(doubles[c][row]);
+        default:
+            return QueryValue::ofString(strings[c][row]);
+        }
+    }
+};
+
+/**
+ * @brief The rows of a query result.
+ */
+struct QueryResult
+{
+    std::vector<std::string> columns;
+    std::vector<std::vector<QueryValue>> rows;
+    size_t rowsScanned = 0; // candidate rows read through the access path
+    size_t rowsMatched = 0; // rows that satisfied the WHERE clause
+};
+
+/**
+ * @brief The value distribution of one column, used to estimate selectivity.
+ *
+ * Built from a sample of the rows: an equi-depth histogram, the share of
+ * each value when the sample holds only a few distinct ones, and an
+ * estimate of the number of distinct values in the whole column.
+ */
+struct ColumnStatistics
+{
+    static constexpr size_t HISTOGRAM_BUCKETS = 64;
+    static constexpr size_t MAX_FREQUENT = 256;
+
+    double rows = 0;
+    double distinct = 0;
+    bool complete = false;                               // the sample held every row
+    std::vector<QueryValue> bounds;                      // bucket boundaries, each bucket holds the same share of rows
+    std::vector<std::pair<QueryValue, double>> frequent; // value and share of rows, by value; empty if too many values
+
+    /**
+     * @brief Build the statistics from a sample.
+     * @param sample The sampled values; sorted in place.
+     * @param totalRows The number of rows the sample was drawn from.
+     * @return The statistics.
+     */
+    static ColumnStatistics build(std::vector<QueryValue> &sample, size_t totalRows)
+    {
+        ColumnStatistics statistics;
+        statistics.rows = static_cast<double>(totalRows);
+        statistics.complete = sample.size() == totalRows;
+        if (sample.empty())
+        {
+            return statistics;
+        }
+        std::sort(sample.begin(), sample.end(), [](const QueryValue &a, const QueryValue &b)
+                  { return a.compare(b) < 0; });
+
+        double n = static_cast<double>(sample.size());
+        double seen = 0, singletons = 0;
+        for (size_t i = 0; i < sample.size();)
+        {
+            size_t j = i + 1;
+            while (j < sample.size() && sample[j].compare(sample[i]) == 0)
+            {
+                ++j;
+            }
+            seen += 1;
+            singletons += j - i == 1 ? 1 : 0;
+            statistics.frequent.push_back(std::make_pair(sample[i], (j - i) / n));
+            i = j;
+        }
+        if (statistics.frequent.size() > MAX_FREQUENT)
+        {
+            statistics.frequent.clear();
+        }
+        // Values seen once in the sample stand for many unseen ones (the GEE estimator).
+        statistics.distinct = statistics.complete ? seen : std::sqrt(totalRows / n) * singletons + (seen - singletons);
+        statistics.distinct = std::min(std::max(statistics.distinct, seen), statistics.rows);
+        for (size_t b = 0; b <= HISTOGRAM_BUCKETS; ++b)
+        {
+            statistics.bounds.push_back(sample[(sample.size() - 1) * b / HISTOGRAM_BUCKETS]);
+        }
+        return statistics;
+    }
+
+    /**
+     * @brief Estimate the share of rows equal to a value.
+     */
+    double equalSelectivity(const QueryValue &value) const
+    {
+        if (bounds.empty())
+        {
+            return 0;
+        }
+        if (frequent.empty())
+        {
+            return 1.0 / std::max(distinct, 1.0);
+        }
+        auto it = std::lower_bound(frequent.begin(), frequent.end(), value, [](const std::pair<QueryValue, double> &entry, const QueryValue &key)
+                                   { return entry.first.compare(key) < 0; });
+        if (it != frequent.end() && it->first.compare(value) == 0)
+        {
+            return it->second;
+        }
+        return complete ? 0 : 1.0 / std::max(rows, 1.0);
+    }
+
+    /**
+     * @brief Estimate the share of rows below (or, if inclusive, at most) a value.
+     */
+    double belowSelectivity(const QueryValue &value, bool inclusive) const
+    {
+        if (bounds.empty())
+        {
+            return 0;
+        }
+        if (!frequent.empty())
+        {
+            double share = 0;
+            for (const auto &entry : frequent)
+            {
+                int comparison = entry.first.compare(value);
+                if (comparison > 0 || (comparison == 0 && !inclusive))
+                {
+                    break;
+                }
+                share += entry.second;
+            }
+            return share;
+        }
+        if (value.compare(bounds.front()) < 0)
+        {
+            return 0;
+        }
+        if (value.compare(bounds.back()) >= 0)
+        {
+            return value.compare(bounds.back()) == 0 && !inclusive ? 1 - equalSelectivity(value) : 1;
+        }
+        size_t bucket = std::upper_bound(bounds.begin(), bounds.end(), value, [](const QueryValue &key, const QueryValue &bound)
+                                         { return key.compare(bound) < 0; }) -
+                        bounds.begin() - 1;
+        double within = 0.5;
+        if (value.type != ColumnType::STRING)
+        {
+            double low = bounds[bucket].asDouble(), high = bounds[bucket + 1].asDouble();
+            within = high > low ? (value.asDouble() - low) / (high - low) : 0.5;
+        }
+        double share = (bucket + within) / HISTOGRAM_BUCKETS;
+        return std::min(1.0, share + (inclusive ? equalSelectivity(value) : 0));
+    }
+
+    /**
+     * @brief Estimate the share of rows for which "column op value" holds.
+     */
+    double selectivity(CompareOp op, const QueryValue &value) const
+    {
+        double share = 0;
+        switch (op)
+        {
+        case CompareOp::EQ:
+            share = equalSelectivity(value);
+            break;
+        case CompareOp::NE:
+            share = 1 - equalSelectivity(value);
+            break;
+        case CompareOp::LT:
+            share = belowSelectivity(value, false);
+            break;
+        case CompareOp::LE:
+            share = belowSelectivity(value, true);
+            break;
+        case CompareOp::GT:
+            share = 1 - belowSelectivity(value, true);
+            break;
+        case CompareOp::GE:
+            share = 1 - belowSelectivity(value, false);
+            break;
+        }
+        return std::min(1.0, std::max(0.0, share));
+    }
+};
+
+/**
+ * @brief Statistics for every beer column.
+ */
+struct TableStatistics
+{
+    static constexpr size_t SAMPLE_ROWS = 65536;
+
+    size_t rows = 0;
+    std::vector<ColumnStatistics> columns = std::vector<ColumnStatistics>(BEER_COLUMN_COUNT);
+
+    /**
+     * @brief Gather statistics from a uniform sample of the store.
+     * @param store The store to analyze.
+     * @return The statistics.
+     */
+    static TableStatistics analyze(const BeerStore &store)
+    {
+        TableStatistics statistics;
+        std::vector<Beer> sample;
+        uint64_t random = 0x9E3779B97F4A7C15ULL;
+        store.forEach([&](const Beer &beer)
+                      {
+                          ++statistics.rows;
+                          if (sample.size() < SAMPLE_ROWS)
+                          {
+                              sample.push_back(beer);
+                              return;
+                          }
+                          random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+                          size_t slot = (random >> 11) % statistics.rows;
+                          if (slot < SAMPLE_ROWS)
+                          {
+                              sample[slot] = beer;
+                          } });
+        for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+        {
+            std::vector<QueryValue> values;
+            values.reserve(sample.size());
+            for (const Beer &beer : sample)
+            {
+                values.push_back(beerColumnValue(beer, static_cast<BeerColumn>(c)));
+            }
+            statistics.columns[c] = ColumnStatistics::build(values, statistics.rows);
+        }
+        return statistics;
+    }
+
+    /**
+     * @brief Estimate the share of rows a WHERE clause keeps, assuming independent columns.
+     */
+    double selectivity(const Predicate &predicate) const
+    {
+        switch (predicate.kind)
+        {
+        case Predicate::COMPARE:
+            return columns[static_cast<size_t>(predicate.column)].selectivity(predicate.op, predicate.literal);
+        case Predicate::AND:
+        {
+            double share = 1;
+            for (const auto &child : predicate.children)
+            {
+                share *= selectivity(*child);
+            }
+            return share;
+        }
+        case Predicate::OR:
+        {
+            double miss = 1;
+            for (const auto &child : predicate.children)
+            {
+                miss *= 1 - selectivity(*child);
+            }
+            return 1 - miss;
+        }
+        default:
+            return 1 - selectivity(*predicate.children[0]);
+        }
+    }
+};
+
+/**
+ * @brief How a query reads beers from the store.
+ */
+struct AccessPath
+{
+    enum Kind : uint8_t
+    {
+        FULL_SCAN,
+        ID_RANGE,
+        HASH_PROBE,
+        RANGE_INDEX,
+        BITMAP_INTERSECTION
+    };
+
+    Kind kind = FULL_SCAN;
+    BeerColumn column = BeerColumn::ID; // ID_RANGE / HASH_PROBE / RANGE_INDEX
+    std::vector<QueryValue> keys;       // HASH_PROBE: rows equal to any of these
+    bool hasLow = false, hasHigh = false, lowInclusive = true, highInclusive = true;
+    QueryValue low, high;                                                // ID_RANGE / RANGE_INDEX bounds
+    std::vector<std::pair<BeerColumn, std::vector<QueryValue>>> bitmaps; // BITMAP_INTERSECTION: every column matches one of its values
+    double estimatedRows = 0;                                            // candidate rows read
+    double estimatedCost = 0;
+
+    /**
+     * @brief Describe the path for EXPLAIN.
+     */
+    std::string describe() const
+    {
+        auto literal = [](const QueryValue &value)
+        { return value.type == ColumnType::STRING ? "'" + value.stringValue + "'" : value.toString(); };
+        auto anyOf = [&literal](BeerColumn column, const std::vector<QueryValue> &values)
+        {
+            std::string text = beerColumnName(column) + (values.size() == 1 ? " = " : " IN (");
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                text += (i ? ", " : "") + literal(values[i]);
+            }
+            return text + (values.size() == 1 ? "" : ")");
+        };
+        std::string range;
+        if (hasLow)
+        {
+            range += literal(low) + (lowInclusive ? " <= " : " < ");
+        }
+        range += beerColumnName(column);
+        if (hasHigh)
+        {
+            range += (highInclusive ? " <= " : " < ") + literal(high);
+        }
+        switch (kind)
+        {
+        case ID_RANGE:
+            return "Id range scan (" + range + ")";
+        case HASH_PROBE:
+            return "Hash probe (" + anyOf(column, keys) + ")";
+        case RANGE_INDEX:
+            return "Range index scan (" + range + ")";
+        case BITMAP_INTERSECTION:
+        {
+            std::string text = "Bitmap intersection (";
+            for (size_t i = 0; i < bitmaps.size(); ++i)
+            {
+                text += (i ? " AND " : "") + anyOf(bitmaps[i].first, bitmaps[i].second);
+            }
+            return text + ")";
+        }
+        default:
+            return "Full scan";
+        }
+    }
+
+    /**
+     * @brief Get the id bounds of an ID_RANGE path.
+     * @param from Receives the first id.
+     * @param to Receives the last id.
+     * @return False if no id can match.
+     */
+    bool idBounds(int &from, int &to) const
+    {
+        double first = INT_MIN, last = INT_MAX;
+        if (hasLow)
+        {
+            double value = low.asDouble();
+            first = std::max(first, std::floor(value) + 1 - (lowInclusive && value == std::floor(value) ? 1 : 0));
+        }
+        if (hasHigh)
+        {
+            double value = high.asDouble();
+            last = std::min(last, std::ceil(value) - 1 + (highInclusive && value == std::ceil(value) ? 1 : 0));
+        }
+        from = static_cast<int>(std::max<double>(first, INT_MIN));
+        to = static_cast<int>(std::min<double>(last, INT_MAX));
+        return first <= last;
+    }
+};
+
+/**
+ * @brief Secondary indexes and statistics over the inventory for the query planner.
+ *
+ * name and barcode have hash indexes from value hash to ids, quantity and
+ * alcohol_content have ordered range indexes, and the low-cardinality
+ * style, container_size and is_metric columns have bitmap indexes over ids.
+ * The store itself serves id lookups and id ranges. The indexes are kept
+ * current through apply(); the statistics are re-analyzed once a tenth of
+ * the rows have changed since they were gathered.
+ *
+ * Each bitmap costs one bit per id, so a column keeps them only while it has
+ * at most MAX_BITMAP_VALUES distinct values. A column that outgrows the cap
+ * (free-text styles, say) drops its bitmaps and is scanned instead; they are
+ * rebuilt once the statistics count at most half the cap again.
+ *
+ * The indexes live in memory whatever the store, so even with an on-disk
+ * store the catalog takes memory in proportion to the number of beers.
+ */
+class QueryCatalog
+{
+public:
+    enum IndexKind : uint8_t
+    {
+        NO_INDEX,
+        PRIMARY,
+        HASH,
+        RANGE,
+        BITMAP
+    };
+
+    /**
+     * @brief Get the kind of index kept on a column.
+     */
+    static IndexKind indexKind(BeerColumn column)
+    {
+        switch (column)
+        {
+        case BeerColumn::ID:
+            return PRIMARY;
+        case BeerColumn::NAME:
+        case BeerColumn::BARCODE:
+            return HASH;
+        case BeerColumn::QUANTITY:
+        case BeerColumn::ALCOHOL_CONTENT:
+            return RANGE;
+        case BeerColumn::STYLE:
+        case BeerColumn::CONTAINER_SIZE:
+        case BeerColumn::IS_METRIC:
+            return BITMAP;
+        default:
+            return NO_INDEX;
+        }
+    }
+
+    /**
+     * @brief Check whether a literal can probe the hash and bitmap indexes.
+     *
+     * Those indexes only hold strings and whole numbers, so a decimal such
+     * as 500.0 probes as 500, and one with a fraction, which no stored
+     * value equals, is left to a scan.
+     */
+    static bool isProbeKey(const QueryValue &value)
+    {
+        return value.type != ColumnType::DOUBLE ||
+               (std::trunc(value.doubleValue) == value.doubleValue && std::fabs(value.doubleValue) < 9.2e18);
+    }
+
+    // The statistics stop keeping per-value shares beyond the same number of values.
+    static constexpr size_t MAX_BITMAP_VALUES = ColumnStatistics::MAX_FREQUENT;
+
+private:
+    typedef std::vector<uint64_t> Bitmap; // bit i is set if id i matches
+
+    struct BitmapEntry
+    {
+        Bitmap bits;
+        size_t rows = 0; // bits set
+    };
+
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> hashIndexes;
+    std::vector<std::set<std::pair<double, int>>> rangeIndexes;
+    std::vector<std::unordered_map<uint64_t, BitmapEntry>> bitmapIndexes;
+    std::vector<bool> bitmapDropped; // the column outgrew MAX_BITMAP_VALUES
+    int maxId;
+    TableStatistics statistics;
+    size_t changesSinceAnalyze;
+    bool analyzed;
+    std::vector<uint64_t> versions; // one per column, then one for the set of rows
+
+    static uint64_t keyOf(const QueryValue &value)
+    {
+        if (value.type == ColumnType::STRING)
+        {
+            return hashString(value.stringValue);
+        }
+        if (value.type == ColumnType::DOUBLE)
+        {
+            // Only whole numbers get here (see isProbeKey), and they must meet the integer columns' keys.
+            return static_cast<uint64_t>(static_cast<int64_t>(value.doubleValue));
+        }
+        return static_cast<uint64_t>(value.intValue);
+    }
+
+    void setBit(size_t c, uint64_t key, int id, bool add)
+    {
+        std::unordered_map<uint64_t, BitmapEntry> &bitmaps = bitmapIndexes[c];
+        auto it = bitmaps.find(key);
+        if (it == bitmaps.end())
+        {
+            if (!add)
+            {
+                return;
+            }
+            if (bitmaps.size() >= MAX_BITMAP_VALUES)
+            {
+                std::unordered_map<uint64_t, BitmapEntry>().swap(bitmaps);
+                bitmapDropped[c] = true;
+                return;
+            }
+            it = bitmaps.emplace(key, BitmapEntry()).first;
+        }
+        Bitmap &bitmap = it->second.bits;
+        if (bitmap.size() <= static_cast<size_t>(id) / 64)
+        {
+            bitmap.resize(id / 64 + 1, 0);
+        }
+        uint64_t bit = 1ULL << (id % 64);
+        if (add && !(bitmap[id / 64] & bit))
+        {
+            bitmap[id / 64] |= bit;
+            ++it->second.rows;
+        }
+        else if (!add && (bitmap[id / 64] & bit))
+        {
+            bitmap[id / 64] &= ~bit;
+            if (--it->second.rows == 0)
+            {
+                bitmaps.erase(it);
+            }
+        }
+    }
+
+    void index(const Beer &beer, bool add)
+    {
+        int id = beer.getId();
+        if (id < 0)
+        {
+            return;
+        }
+        maxId = std::max(maxId, id);
+        for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+        {
+            BeerColumn column = static_cast<BeerColumn>(c);
+            QueryValue value = beerColumnValue(beer, column);
+            switch (indexKind(column))
+            {
+            case HASH:
+            {
+                std::vector<int> &ids = hashIndexes[c][keyOf(value)];
+                if (add)
+                {
+                    ids.push_back(id);
+                }
+                else
+                {
+                    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+                    if (ids.empty())
+                    {
+                        hashIndexes[c].erase(keyOf(value));
+                    }
+                }
+                break;
+            }
+            case RANGE:
+                if (add)
+                {
+                    rangeIndexes[c].insert(std::make_pair(value.asDouble(), id));
+                }
+                else
+                {
+                    rangeIndexes[c].erase(std::make_pair(value.asDouble(), id));
+                }
+                break;
+            case BITMAP:
+                if (!bitmapDropped[c])
+                {
+                    setBit(c, keyOf(value), id, add);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+public:
+    QueryCatalog() : hashIndexes(BEER_COLUMN_COUNT), rangeIndexes(BEER_COLUMN_COUNT), bitmapIndexes(BEER_COLUMN_COUNT),
+                     bitmapDropped(BEER_COLUMN_COUNT, false), maxId(0), changesSinceAnalyze(0), analyzed(false), versions(BEER_COLUMN_COUNT + 1, 0) {}
+
+    /**
+     * @brief Reflect a change to the inventory in the indexes.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before)
+        {
+            index(*before, false);
+        }
+        if (after)
+        {
+            index(*after, true);
+        }
+        ++changesSinceAnalyze;
+        if (!before || !after)
+        {
+            ++versions[BEER_COLUMN_COUNT];
+            return;
+        }
+        for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+        {
+            BeerColumn column = static_cast<BeerColumn>(c);
+            if (beerColumnValue(*before, column).compare(beerColumnValue(*after, column)) != 0)
+            {
+                ++versions[c];
+            }
+        }
+    }
+
+    /**
+     * @brief Get the version of a column, which changes whenever an edit changes its value in some row.
+     */
+    uint64_t getVersion(BeerColumn column) const
+    {
+        return versions[static_cast<size_t>(column)];
+    }
+
+    /**
+     * @brief Get the version of the set of rows, which changes whenever a beer is added or removed.
+     */
+    uint64_t getRowVersion() const
+    {
+        return versions[BEER_COLUMN_COUNT];
+    }
+
+    /**
+     * @brief Get the statistics, re-analyzing the store if they are stale.
+     * @param store The store the catalog describes.
+     * @return The statistics.
+     */
+    const TableStatistics &getStatistics(const BeerStore &store)
+    {
+        if (!analyzed || changesSinceAnalyze > statistics.rows / 10)
+        {
+            statistics = TableStatistics::analyze(store);
+            changesSinceAnalyze = 0;
+            analyzed = true;
+            for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+            {
+                if (!bitmapDropped[c] || statistics.columns[c].distinct > MAX_BITMAP_VALUES / 2)
+                {
+                    continue;
+                }
+                bitmapDropped[c] = false;
+                BeerColumn column = static_cast<BeerColumn>(c);
+                store.forEach([&](const Beer &beer)
+                              {
+                                  if (beer.getId() >= 0 && !bitmapDropped[c])
+                                  {
+                                      setBit(c, keyOf(beerColumnValue(beer, column)), beer.getId(), true);
+                                  } });
+            }
+        }
+        return statistics;
+    }
+
+    /**
+     * @brief Check whether a column currently has bitmap indexes (see MAX_BITMAP_VALUES).
+     */
+    bool hasBitmap(BeerColumn column) const
+    {
+        return indexKind(column) == BITMAP && !bitmapDropped[static_cast<size_t>(column)];
+    }
+
+    /**
+     * @brief Get the largest id indexed so far (the length of the bitmaps).
+     */
+    int getMaxId() const
+    {
+        return maxId;
+    }
+
+    /**
+     * @brief Get the candidate ids of an index access path.
+     *
+     * Hash probes can return ids whose value only shares a hash with a key;
+     * the query's WHERE clause removes them.
+     *
+     * @param path A HASH_PROBE, RANGE_INDEX or BITMAP_INTERSECTION path.
+     * @return The candidate ids in ascending order.
+     */
+    std::vector<int> lookup(const AccessPath &path) const
+    {
+        std::vector<int> ids;
+        size_t c = static_cast<size_t>(path.column);
+        if (path.kind == AccessPath::HASH_PROBE)
+        {
+            for (const QueryValue &key : path.keys)
+            {
+                auto it = hashIndexes[c].find(keyOf(key));
+                if (it != hashIndexes[c].end())
+                {
+                    ids.insert(ids.end(), it->second.begin(), it->second.end());
+                }
+            }
+        }
+        else if (path.kind == AccessPath::RANGE_INDEX)
+        {
+            const std::set<std::pair<double, int>> &entries = rangeIndexes[c];
+            auto it = !path.hasLow ? entries.begin()
+                      : path.lowInclusive ? entries.lower_bound(std::make_pair(path.low.asDouble(), INT_MIN))
+                                          : entries.upper_bound(std::make_pair(path.low.asDouble(), INT_MAX));
+            auto end = !path.hasHigh ? entries.end()
+                       : path.highInclusive ? entries.upper_bound(std::make_pair(path.high.asDouble(), INT_MAX))
+                                            : entries.lower_bound(std::make_pair(path.high.asDouble(), INT_MIN));
+            for (; it != end && it != entries.end(); ++it)
+            {
+                ids.push_back(it->second);
+            }
+        }
+        else if (path.kind == AccessPath::BITMAP_INTERSECTION)
+        {
+            Bitmap result(maxId / 64 + 1, ~0ULL);
+            for (const auto &constraint : path.bitmaps)
+            {
+                const auto &index = bitmapIndexes[static_cast<size_t>(constraint.first)];
+                Bitmap any(result.size(), 0);
+                for (const QueryValue &key : constraint.second)
+                {
+                    auto it = index.find(keyOf(key));
+                    if (it == index.end())
+                    {
+                        continue;
+                    }
+                    const Bitmap &bits = it->second.bits;
+                    for (size_t w = 0; w < bits.size() && w < any.size(); ++w)
+                    {
+                        any[w] |= bits[w];
+                    }
+                }
+                for (size_t w = 0; w < result.size(); ++w)
+                {
+                    result[w] &= any[w];
+                }
+            }
+            for (size_t w = 0; w < result.size(); ++w)
+            {
+                for (uint64_t bits = result[w]; bits != 0; bits &= bits - 1)
+                {
+                    ids.push_back(static_cast<int>(w * 64 + __builtin_ctzll(bits)));
+                }
+            }
+            return ids;
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+};
+
+/**
+ * @brief The access path chosen for a query and the alternatives it beat.
+ */
+struct QueryPlan
+{
+    AccessPath access;
+    std::vector<AccessPath> alternatives;
+    double estimatedRows = 0; // rows the WHERE clause keeps
+};
+
+/**
+ * @brief Chooses the cheapest access path for a query.
+ *
+ * Every top-level conjunct of the WHERE clause that an index can answer
+ * yields a candidate path: the id range, a hash probe, a range index scan,
+ * or the intersection of all bitmap-indexed equalities. Each is costed from
+ * the statistics as index work plus one fetch per candidate row, against a
+ * full scan that filters every row in batches. An OR of equalities on the id
+ * or a range-indexed column is read as the range covering its keys, so it is
+ * costed by the rows in that range.
+ */
+class QueryPlanner
+{
+private:
+    static constexpr double SCAN_COST = 1.0;  // read and filter one row of a scan
+    static constexpr double FETCH_COST = 4.0; // fetch one row by id
+    static constexpr double ENTRY_COST = 0.2; // visit one index entry
+    static constexpr double WORD_COST = 0.05; // combine one 64-bit bitmap word
+
+    struct Constraint
+    {
+        std::vector<QueryValue> equals;
+        bool hasLow = false, hasHigh = false, lowInclusive = true, highInclusive = true;
+        QueryValue low, high;
+        double selectivity = 1;
+        bool used = false;
+    };
+
+    static bool equalitiesOn(const Predicate &predicate, BeerColumn &column, std::vector<QueryValue> &values)
+    {
+        if (predicate.kind == Predicate::COMPARE)
+        {
+            if (predicate.op != CompareOp::EQ || (!values.empty() && predicate.column != column))
+            {
+                return false;
+            }
+            column = predicate.column;
+            values.push_back(predicate.literal);
+            return true;
+        }
+        if (predicate.kind != Predicate::OR)
+        {
+            return false;
+        }
+        for (const auto &child : predicate.children)
+        {
+            if (!equalitiesOn(*child, column, values))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void constrain(const Predicate &conjunct, const TableStatistics &statistics, std::vector<Constraint> &constraints)
+    {
+        if (conjunct.kind == Predicate::AND)
+        {
+            for (const auto &child : conjunct.children)
+            {
+                constrain(*child, statistics, constraints);
+            }
+            return;
+        }
+        BeerColumn column = BeerColumn::ID;
+        std::vector<QueryValue> values;
+        if (equalitiesOn(conjunct, column, values))
+        {
+            Constraint &constraint = constraints[static_cast<size_t>(column)];
+            if (!constraint.used || constraint.equals.empty() || values.size() < constraint.equals.size())
+            {
+                constraint.equals = values;
+            }
+            constraint.selectivity *= statistics.selectivity(conjunct);
+            constraint.used = true;
+            return;
+        }
+        if (conjunct.kind != Predicate::COMPARE || conjunct.op == CompareOp::NE)
+        {
+            return;
+        }
+        Constraint &constraint = constraints[static_cast<size_t>(conjunct.column)];
+        const QueryValue &value = conjunct.literal;
+        if (conjunct.op == CompareOp::GT || conjunct.op == CompareOp::GE)
+        {
+            int comparison = constraint.hasLow ? value.compare(constraint.low) : 1;
+            if (comparison > 0 || (comparison == 0 && conjunct.op == CompareOp::GT))
+            {
+                constraint.low = value;
+                constraint.lowInclusive = conjunct.op == CompareOp::GE;
+            }
+            constraint.hasLow = true;
+        }
+        else
+        {
+            int comparison = constraint.hasHigh ? value.compare(constraint.high) : -1;
+            if (comparison < 0 || (comparison == 0 && conjunct.op == CompareOp::LT))
+            {
+                constraint.high = value;
+                constraint.highInclusive = conjunct.op == CompareOp::LE;
+            }
+            constraint.hasHigh = true;
+        }
+        constraint.selectivity *= statistics.selectivity(conjunct);
+        constraint.used = true;
+    }
+
+public:
+    /**
+     * @brief Plan a query.
+     * @param query The query.
+     * @param catalog The indexes available.
+     * @param statistics The column statistics.
+     * @param rows The number of beers in the store.
+     * @return The plan, with the chosen path and the alternatives considered.
+     */
+    static QueryPlan plan(const Query &query, const QueryCatalog &catalog, const TableStatistics &statistics, size_t rows)
+    {
+        QueryPlan plan;
+        double n = static_cast<double>(rows);
+        double logN = std::log2(n + 2);
+        plan.estimatedRows = query.where ? n * statistics.selectivity(*query.where) : n;
+
+        AccessPath scan;
+        scan.estimatedRows = n;
+        scan.estimatedCost = n * SCAN_COST;
+        plan.alternatives.push_back(scan);
+
+        std::vector<Constraint> constraints(BEER_COLUMN_COUNT);
+        if (query.where)
+        {
+            constrain(*query.where, statistics, constraints);
+        }
+        AccessPath bitmap;
+        bitmap.kind = AccessPath::BITMAP_INTERSECTION;
+        double bitmapShare = 1, bitmapKeys = 0;
+        for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+        {
+            const Constraint &constraint = constraints[c];
+            BeerColumn column = static_cast<BeerColumn>(c);
+            QueryCatalog::IndexKind kind = QueryCatalog::indexKind(column);
+            if (!constraint.used || kind == QueryCatalog::NO_INDEX)
+            {
+                continue;
+            }
+            AccessPath path;
+            path.column = column;
+            path.estimatedRows = n * constraint.selectivity;
+            bool probeable = std::all_of(constraint.equals.begin(), constraint.equals.end(), QueryCatalog::isProbeKey);
+            if (!constraint.equals.empty() && kind == QueryCatalog::HASH && probeable)
+            {
+                path.kind = AccessPath::HASH_PROBE;
+                path.keys = constraint.equals;
+                path.estimatedCost = path.keys.size() * ENTRY_COST + path.estimatedRows * (ENTRY_COST + FETCH_COST);
+                plan.alternatives.push_back(path);
+            }
+            else if (!constraint.equals.empty() && catalog.hasBitmap(column) && probeable)
+            {
+                bitmap.bitmaps.push_back(std::make_pair(column, constraint.equals));
+                bitmapShare *= constraint.selectivity;
+                bitmapKeys += constraint.equals.size();
+            }
+            else if (kind == QueryCatalog::PRIMARY || kind == QueryCatalog::RANGE)
+            {
+                path.kind = kind == QueryCatalog::PRIMARY ? AccessPath::ID_RANGE : AccessPath::RANGE_INDEX;
+                if (!constraint.equals.empty())
+                {
+                    auto order = [](const QueryValue &a, const QueryValue &b)
+                    { return a.compare(b) < 0; };
+                    path.low = *std::min_element(constraint.equals.begin(), constraint.equals.end(), order);
+                    path.high = *std::max_element(constraint.equals.begin(), constraint.equals.end(), order);
+                    path.hasLow = path.hasHigh = true;
+                    // The scan reads every row between the smallest and largest key.
+                    const ColumnStatistics &columnStatistics = statistics.columns[c];
+                    double covered = columnStatistics.selectivity(CompareOp::GE, path.low) +
+                                     columnStatistics.selectivity(CompareOp::LE, path.high) - 1;
+                    path.estimatedRows = std::max(path.estimatedRows, n * covered);
+                }
+                else
+                {
+                    path.hasLow = constraint.hasLow;
+                    path.low = constraint.low;
+                    path.lowInclusive = constraint.lowInclusive;
+                    path.hasHigh = constraint.hasHigh;
+                    path.high = constraint.high;
+                    path.highInclusive = constraint.highInclusive;
+                }
+                if (path.kind == AccessPath::ID_RANGE)
+                {
+                    path.estimatedCost = logN + path.estimatedRows * SCAN_COST;
+                }
+                else
+                {
+                    path.estimatedCost = logN + path.estimatedRows * (ENTRY_COST * (1 + std::log2(path.estimatedRows + 2)) + FETCH_COST);
+                }
+                plan.alternatives.push_back(path);
+            }
+        }
+        if (!bitmap.bitmaps.empty())
+        {
+            bitmap.estimatedRows = n * bitmapShare;
+            bitmap.estimatedCost = (bitmapKeys + 1) * (catalog.getMaxId() / 64 + 1) * WORD_COST + bitmap.estimatedRows * FETCH_COST;
+            plan.alternatives.push_back(bitmap);
+        }
+
+        plan.access = *std::min_element(plan.alternatives.begin(), plan.alternatives.end(), [](const AccessPath &a, const AccessPath &b)
+                                        { return a.estimatedCost < b.estimatedCost; });
+        return plan;
+    }
+};
+
+/**
+ * @brief A WHERE clause compiled into specialized scan kernels.
+ *
+ * Only conjunctions of comparisons are compiled (including BETWEEN, which
+ * parses to two). Each comparison becomes a template instance for its
+ * column type and operator, picked once when the query is prepared, so
+ * no per-batch switching or per-row dispatch remains. The first comparison
+ * builds the selection vector straight from a dense pass over the batch;
+ * the rest narrow it without branching. Other shapes (OR, NOT, IN) are
+ * left to QueryEngine's interpreter.
+ */
+class PredicateKernel
+{
+private:
+    typedef size_t (*TermKernel)(const ColumnBatch &batch, size_t column, const QueryValue &literal, uint16_t *selection, size_t selected);
+
+    struct Term
+    {
+        TermKernel dense;  // first term: select from every row of the batch
+        TermKernel narrow; // later terms: narrow the selection
+        size_t column;
+        QueryValue literal;
+    };
+
+    std::vector<Term> terms;
+
+    template <CompareOp OP, typename T, typename U>
+    static bool holds(const T &value, const U &literal)
+    {
+        if constexpr (OP == CompareOp::EQ)
+        {
+            return value == literal;
+        }
+        else if constexpr (OP == CompareOp::NE)
+        {
+            return value != literal;
+        }
+        else if constexpr (OP == CompareOp::LT)
+        {
+            return value < literal;
+        }
+        else if constexpr (OP == CompareOp::LE)
+        {
+            return value <= literal;
+        }
+        else if constexpr (OP == CompareOp::GT)
+        {
+            return value > literal;
+        }
+        else
+        {
+            return value >= literal;
+        }
+    }
+
+    template <CompareOp OP, bool DENSE, typename T, typename U>
+    static size_t selectRows(const T *values, const U &literal, size_t rows, uint16_t *selection, size_t selected)
+    {
+        size_t kept = 0;
+        if constexpr (DENSE)
+        {
+            for (size_t row = 0; row < rows; ++row)
+            {
+                selection[kept] = static_cast<uint16_t>(row);
+                kept += holds<OP>(values[row], literal) ? 1 : 0;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < selected; ++i)
+            {
+                uint16_t row = selection[i];
+                selection[kept] = row;
+                kept += holds<OP>(values[row], literal) ? 1 : 0;
+            }
+        }
+        return kept;
+    }
+
+    // LITERAL is the type the literal is compared as: int64_t, double or std::string.
+    template <ColumnType TYPE, typename LITERAL, CompareOp OP, bool DENSE>
+    static size_t termKernel(const ColumnBatch &batch, size_t column, const QueryValue &literal, uint16_t *selection, size_t selected)
+    {
+        if constexpr (TYPE == ColumnType::STRING)
+        {
+            return selectRows<OP, DENSE>(batch.strings[column].data(), literal.stringValue, batch.size, selection, selected);
+        }
+        else if constexpr (TYPE == ColumnType::DOUBLE)
+        {
+            return selectRows<OP, DENSE>(batch.doubles[column].data(), literal.asDouble(), batch.size, selection, selected);
+        }
+        else if constexpr (std::is_same<LITERAL, double>::value)
+        {
+            return selectRows<OP, DENSE>(batch.ints[column].data(), literal.doubleValue, batch.size, selection, selected);
+        }
+        else
+        {
+            return selectRows<OP, DENSE>(batch.ints[column].data(), literal.intValue, batch.size, selection, selected);
+        }
+    }
+
+    template <ColumnType TYPE, typename LITERAL, bool DENSE>
+    static TermKernel select(CompareOp op)
+    {
+        switch (op)
+        {
+        case CompareOp::EQ:
+            return &termKernel<TYPE, LITERAL, CompareOp::EQ, DENSE>;
+        case CompareOp::NE:
+            return &termKernel<TYPE, LITERAL, CompareOp::NE, DENSE>;
+        case CompareOp::LT:
+            return &termKernel<TYPE, LITERAL, CompareOp::LT, DENSE>;
+        case CompareOp::LE:
+            return &termKernel<TYPE, LITERAL, CompareOp::LE, DENSE>;
+        case CompareOp::GT:
+            return &termKernel<TYPE, LITERAL, CompareOp::GT, DENSE>;
+        default:
+            return &termKernel<TYPE, LITERAL, CompareOp::GE, DENSE>;
+        }
+    }
+
+    template <ColumnType TYPE, typename LITERAL>
+    static void specialize(Term &term, CompareOp op)
+    {
+        term.dense = select<TYPE, LITERAL, true>(op);
+        term.narrow = select<TYPE, LITERAL, false>(op);
+    }
+
+    static bool collect(const Predicate &predicate, std::vector<Term> &terms)
+    {
+        if (predicate.kind == Predicate::AND)
+        {
+            for (const auto &child : predicate.children)
+            {
+                if (!collect(*child, terms))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (predicate.kind != Predicate::COMPARE)
+        {
+            return false;
+        }
+        Term term;
+        term.column = static_cast<size_t>(predicate.column);
+        term.literal = predicate.literal;
+        switch (beerColumnType(predicate.column))
+        {
+        case ColumnType::STRING:
+            specialize<ColumnType::STRING, std::string>(term, predicate.op);
+            break;
+        case ColumnType::DOUBLE:
+            specialize<ColumnType::DOUBLE, double>(term, predicate.op);
+            break;
+        default:
+            if (predicate.literal.type == ColumnType::DOUBLE)
+            {
+                specialize<ColumnType::INT64, double>(term, predicate.op);
+            }
+            else
+            {
+                specialize<ColumnType::INT64, int64_t>(term, predicate.op);
+            }
+            break;
+        }
+        terms.push_back(term);
+        return true;
+    }
+
+public:
+    /**
+     * @brief Compile a WHERE clause.
+     * @param where The clause, with every parameter bound.
+     * @return The kernel, or nothing if the clause is not a conjunction of comparisons.
+     */
+    static std::optional<PredicateKernel> compile(const Predicate &where)
+    {
+        PredicateKernel kernel;
+        if (!collect(where, kernel.terms))
+        {
+            return std::nullopt;
+        }
+        return kernel;
+    }
+
+    /**
+     * @brief Get the number of comparisons in the kernel.
+     */
+    size_t getTermCount() const
+    {
+        return terms.size();
+    }
+
+    /**
+     * @brief Select the rows of a batch that satisfy every comparison.
+     * @param batch The batch to filter.
+     * @param selection Receives the matching row numbers in order.
+     */
+    void apply(const ColumnBatch &batch, std::vector<uint16_t> &selection) const
+    {
+        selection.resize(ColumnBatch::CAPACITY);
+        size_t kept = terms[0].dense(batch, terms[0].column, terms[0].literal, selection.data(), 0);
+        for (size_t i = 1; i < terms.size() && kept > 0; ++i)
+        {
+            kept = terms[i].narrow(batch, terms[i].column, terms[i].literal, selection.data(), kept);
+        }
+        selection.resize(kept);
+    }
+};
+
+/**
+ * @brief A query parsed once and run many times.
+ *
+ * The "?" parameters in its WHERE clause are bound before each run, and
+ * the clause is compiled into a PredicateKernel whenever its shape allows.
+ */
+class PreparedQuery
+{
+private:
+    Query query;
+    std::vector<Predicate *> parameters; // the comparisons each "?" belongs to, in order
+    std::optional<PredicateKernel> kernel;
+    bool bound;
+
+    static void findParameters(Predicate &predicate, std::vector<Predicate *> &parameters)
+    {
+        if (predicate.parameter >= 0)
+        {
+            parameters[predicate.parameter] = &predicate;
+        }
+        for (const auto &child : predicate.children)
+        {
+            findParameters(*child, parameters);
+        }
+    }
+
+public:
+    /**
+     * @brief Parse and, if it has no parameters, compile a query.
+     * @param text The query text.
+     * @throws std::invalid_argument if the query does not parse.
+     */
+    explicit PreparedQuery(const std::string &text) : query(QueryParser::parse(text)), parameters(query.parameterCount), bound(query.parameterCount == 0)
+    {
+        if (query.where)
+        {
+            findParameters(*query.where, parameters);
+            if (bound)
+            {
+                kernel = PredicateKernel::compile(*query.where);
+            }
+        }
+    }
+
+    /**
+     * @brief Bind values to the parameters and recompile the kernel.
+     * @param values One value per "?", in order of appearance.
+     * @throws std::invalid_argument if the count or a type does not match.
+     */
+    void bind(const std::vector<QueryValue> &values)
+    {
+        if (values.size() != parameters.size())
+        {
+            throw std::invalid_argument("expected " + std::to_string(parameters.size()) + " parameters, got " + std::to_string(values.size()));
+        }
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            QueryParser::checkLiteral(parameters[i]->column, values[i]);
+        }
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            parameters[i]->literal = values[i];
+        }
+        bound = true;
+        if (query.where)
+        {
+            kernel = PredicateKernel::compile(*query.where);
+        }
+    }
+
+    /**
+     * @brief Check whether every parameter has a value.
+     */
+    bool isBound() const
+    {
+        return bound;
+    }
+
+    /**
+     * @brief Get the number of "?" parameters.
+     */
+    size_t getParameterCount() const
+    {
+        return parameters.size();
+    }
+
+    /**
+     * @brief Get the parsed query with its current parameter values.
+     */
+    const Query &getQuery() const
+    {
+        return query;
+    }
+
+    /**
+     * @brief Get the compiled WHERE clause, or null if it runs interpreted.
+     */
+    const PredicateKernel *getKernel() const
+    {
+        return kernel ? &*kernel : nullptr;
+    }
+};
+
+/**
+ * @brief Executes parsed queries over a BeerStore in column batches.
+ *
+ * Beers are read through an access path (a full scan or an index lookup),
+ * gathered into ColumnBatches of 1024 rows, filtered by narrowing a
+ * selection vector with one tight loop per comparison (or by a compiled
+ * PredicateKernel, when one is given), and then projected or aggregated.
+ * The WHERE clause is always applied in full, so an index only has to
+ * return a superset of the matching beers. Aggregates over a full scan
+ * of a large store that allows concurrent reads run on all cores: each
+ * thread aggregates one slice into its own table, and the tables are
+ * merged by key partition (see Sink::mergeAll).
+ */
+class QueryEngine
+{
+private:
+    typedef std::vector<uint16_t> Selection;
+
+    /**
+     * @brief Keep the selected rows for which keep(row) holds, without branching.
+     */
+    template <typename Keep>
+    static void refine(Selection &selection, Keep keep)
+    {
+        size_t kept = 0;
+        for (uint16_t row : selection)
+        {
+            selection[kept] = row;
+            kept += keep(row) ? 1 : 0;
+        }
+        selection.resize(kept);
+    }
+
+    template <typename T, typename U>
+    static void compareColumn(Selection &selection, const T *values, CompareOp op, const U &literal)
+    {
+        switch (op)
+        {
+        case CompareOp::EQ:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] == literal; });
+            break;
+        case CompareOp::NE:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] != literal; });
+            break;
+        case CompareOp::LT:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] < literal; });
+            break;
+        case CompareOp::LE:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] <= literal; });
+            break;
+        case CompareOp::GT:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] > literal; });
+            break;
+        case CompareOp::GE:
+            refine(selection, [&](uint16_t row)
+                   { return values[row] >= literal; });
+            break;
+        }
+    }
+
+    static void filter(const Predicate &predicate, const ColumnBatch &batch, Selection &selection)
+    {
+        switch (predicate.kind)
+        {
+        case Predicate::COMPARE:
+        {
+            size_t c = static_cast<size_t>(predicate.column);
+            ColumnType type = beerColumnType(predicate.column);
+            if (type == ColumnType::STRING)
+            {
+                compareColumn(selection, batch.strings[c].data(), predicate.op, predicate.literal.stringValue);
+            }
+            else if (type == ColumnType::DOUBLE)
+            {
+                compareColumn(selection, batch.doubles[c].data(), predicate.op, predicate.literal.asDouble());
+            }
+            else if (predicate.literal.type == ColumnType::INT64)
+            {
+                compareColumn(selection, batch.ints[c].data(), predicate.op, predicate.literal.intValue);
+            }
+            else
+            {
+                compareColumn(selection, batch.ints[c].data(), predicate.op, predicate.literal.doubleValue);
+            }
+            break;
+        }
+        case Predicate::AND:
+            for (const auto &child : predicate.children)
+            {
+                filter(*child, batch, selection);
+            }
+            break;
+        case Predicate::OR:
+        {
+            std::vector<uint8_t> matched(batch.size, 0);
+            for (const auto &child : predicate.children)
+            {
+                Selection branch = selection;
+                filter(*child, batch, branch);
+                for (uint16_t row : branch)
+                {
+                    matched[row] = 1;
+                }
+            }
+            refine(selection, [&](uint16_t row)
+                   { return matched[row] != 0; });
+            break;
+        }
+        case Predicate::NOT:
+        {
+            std::vector<uint8_t> matched(batch.size, 0);
+            Selection branch = selection;
+            filter(*predicate.children[0], batch, branch);
+            for (uint16_t row : branch)
+            {
+                matched[row] = 1;
+            }
+            refine(selection, [&](uint16_t row)
+                   { return matched[row] == 0; });
+            break;
+        }
+        }
+    }
+
+    static void markColumns(const Predicate &predicate, ColumnBatch &batch)
+    {
+        if (predicate.kind == Predicate::COMPARE)
+        {
+            batch.need(predicate.column);
+        }
+        for (const auto &child : predicate.children)
+        {
+            markColumns(*child, batch);
+        }
+    }
+
+    struct Accumulator
+    {
+        int64_t count = 0;
+        int64_t intSum = 0;
+        double doubleSum = 0;
+        bool any = false;
+        QueryValue minimum, maximum;
+
+        void add(const QueryValue &value)
+        {
+            ++count;
+            intSum += value.intValue;
+            doubleSum += value.asDouble();
+            if (!any || value.compare(minimum) < 0)
+            {
+                minimum = value;
+            }
+            if (!any || value.compare(maximum) > 0)
+            {
+                maximum = value;
+            }
+            any = true;
+        }
+
+        void merge(const Accumulator &other)
+        {
+            if (other.any)
+            {
+                if (!any || other.minimum.compare(minimum) < 0)
+                {
+                    minimum = other.minimum;
+                }
+                if (!any || other.maximum.compare(maximum) > 0)
+                {
+                    maximum = other.maximum;
+                }
+                any = true;
+            }
+            count += other.count;
+            intSum += other.intSum;
+            doubleSum += other.doubleSum;
+        }
+
+        QueryValue result(const SelectItem &item) const
+        {
+            switch (item.aggregate)
+            {
+            case Aggregate::COUNT:
+                return QueryValue::ofInt(count);
+            case Aggregate::SUM:
+                return beerColumnType(item.column) == ColumnType::INT64 ? QueryValue::ofInt(intSum) : QueryValue::ofDouble(doubleSum);
+            case Aggregate::MIN:
+                return minimum;
+            case Aggregate::MAX:
+                return maximum;
+            case Aggregate::AVG:
+                return QueryValue::ofDouble(count ? doubleSum / count : 0);
+            default:
+                return QueryValue();
+            }
+        }
+    };
+
+    struct Group
+    {
+        std::vector<QueryValue> keys;
+        std::vector<Accumulator> accumulators;
+    };
+
+public:
+    /**
+     * @brief Pick the number of slices to scan a store in on separate threads.
+     * @return 1 if the store is small or cannot be read concurrently.
+     */
+    static size_t sliceCount(const BeerStore &store)
+    {
+        const size_t ROWS_PER_SLICE = 1 << 16;
+        if (!store.allowsConcurrentReads() || store.size() < 2 * ROWS_PER_SLICE)
+        {
+            return 1;
+        }
+        // One slice per thread: more would only add partial tables to merge.
+        return std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), store.size() / ROWS_PER_SLICE);
+    }
+
+    /**
+     * @brief Feed the beers an access path selects to a visitor.
+     * @param store The store to read.
+     * @param catalog The indexes the path may use.
+     * @param path The access path.
+     * @param visitor Called for each candidate beer.
+     */
+    static void readPath(const BeerStore &store, const QueryCatalog &catalog, const AccessPath &path,
+                         const std::function<void(const Beer &)> &visitor)
+    {
+        if (path.kind == AccessPath::FULL_SCAN)
+        {
+            store.forEach(visitor);
+            return;
+        }
+        if (path.kind == AccessPath::ID_RANGE)
+        {
+            int from, to;
+            if (path.idBounds(from, to))
+            {
+                store.scanRange(from, to, visitor);
+            }
+            return;
+        }
+        for (int id : catalog.lookup(path))
+        {
+            std::optional<Beer> beer = store.find(id);
+            if (beer)
+            {
+                visitor(*beer);
+            }
+        }
+    }
+
+    /**
+     * @brief The filtering and projection or aggregation of one query, fed a batch at a time.
+     *
+     * Several sinks can share one scan: mark every sink's columns on the
+     * batch, then hand each full batch to all of them. Sinks fed disjoint
+     * parts of the input can be merged, in input order, before finishing.
+     */
+    class Sink
+    {
+    private:
+        const Query *query;
+        const PredicateKernel *kernel;
+        bool aggregate;
+        bool earlyLimit;
+        std::unordered_map<std::string, Group> groups;
+        std::vector<std::string> groupOrder; // first-seen order, for stable output
+        Selection selection;
+        QueryResult result;
+
+    public:
+        /**
+         * @param query The parsed query; must outlive the sink.
+         * @param kernel The compiled WHERE clause, or null to interpret it.
+         */
+        Sink(const Query &query, const PredicateKernel *kernel)
+            : query(&query), kernel(kernel), aggregate(query.isAggregate()),
+              earlyLimit(!aggregate && query.orderBy.empty() && query.limit >= 0)
+        {
+            for (const SelectItem &item : query.items)
+            {
+                result.columns.push_back(item.label);
+            }
+            selection.reserve(ColumnBatch::CAPACITY);
+        }
+
+        /**
+         * @brief Mark the columns the query reads on a batch.
+         */
+        void need(ColumnBatch &batch) const
+        {
+            for (const SelectItem &item : query->items)
+            {
+                if (!item.countStar)
+                {
+                    batch.need(item.column);
+                }
+            }
+            for (BeerColumn column : query->groupBy)
+            {
+                batch.need(column);
+            }
+            if (query->where)
+            {
+                markColumns(*query->where, batch);
+            }
+        }
+
+        /**
+         * @brief Check whether a LIMIT without ORDER BY is already met, so further rows are not needed.
+         */
+        bool isDone() const
+        {
+            return earlyLimit && result.rows.size() >= static_cast<size_t>(query->limit);
+        }
+
+        /**
+         * @brief Filter a batch and project or aggregate the rows that match.
+         */
+        void consume(const ColumnBatch &batch)
+        {
+            result.rowsScanned += batch.size;
+            if (kernel)
+            {
+                kernel->apply(batch, selection);
+            }
+            else
+            {
+                selection.resize(batch.size);
+                for (size_t row = 0; row < batch.size; ++row)
+                {
+                    selection[row] = static_cast<uint16_t>(row);
+                }
+                if (query->where)
+                {
+                    filter(*query->where, batch, selection);
+                }
+            }
+            result.rowsMatched += selection.size();
+            if (!aggregate)
+            {
+                for (uint16_t row : selection)
+                {
+                    if (isDone())
+                    {
+                        break;
+                    }
+                    std::vector<QueryValue> output;
+                    for (const SelectItem &item : query->items)
+                    {
+                        output.push_back(batch.value(item.column, row));
+                    }
+                    result.rows.push_back(std::move(output));
+                }
+                return;
+            }
+            std::string key;
+            for (uint16_t row : selection)
+            {
+                key.clear();
+                for (BeerColumn column : query->groupBy)
+                {
+                    batch.value(column, row).appendKey(key);
+                }
+                auto inserted = groups.try_emplace(key);
+                Group &group = inserted.first->second;
+                if (inserted.second)
+                {
+                    groupOrder.push_back(key);
+                    for (BeerColumn column : query->groupBy)
+                    {
+                        group.keys.push_back(batch.value(column, row));
+                    }
+                    group.accumulators.resize(query->items.size());
+                }
+                for (size_t i = 0; i < query->items.size(); ++i)
+                {
+                    const SelectItem &item = query->items[i];
+                    if (item.aggregate != Aggregate::NONE)
+                    {
+                        group.accumulators[i].add(item.countStar ? QueryValue() : batch.value(item.column, row));
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Take in a sink of the same query that was fed the input following this one's.
+         */
+        void merge(Sink &other)
+        {
+            if (isDone())
+            {
+                return; // a sequential scan would have stopped before other's input
+            }
+            result.rowsScanned += other.result.rowsScanned;
+            result.rowsMatched += other.result.rowsMatched;
+            for (std::vector<QueryValue> &row : other.result.rows)
+            {
+                if (isDone())
+                {
+                    break;
+                }
+                result.rows.push_back(std::move(row));
+            }
+            for (const std::string &key : other.groupOrder)
+            {
+                Group &theirs = other.groups[key];
+                auto inserted = groups.emplace(key, Group());
+                if (inserted.second)
+                {
+                    groupOrder.push_back(key);
+                    inserted.first->second = std::move(theirs);
+                    continue;
+                }
+                for (size_t i = 0; i < theirs.accumulators.size(); ++i)
+                {
+                    inserted.first->second.accumulators[i].merge(theirs.accumulators[i]);
+                }
+            }
+        }
+
+        /**
+         * @brief Merge sinks of the same query fed consecutive parts of the input.
+         *
+         * Groups are routed by key hash to partitions that are merged on
+         * separate threads, so no single thread folds every partial table;
+         * the merged groups keep the order a sequential run would have
+         * first seen them in.
+         *
+         * @param partials The sinks, in input order; they are left empty.
+         * @return The merged sink.
+         */
+        static Sink mergeAll(std::vector<Sink> &partials)
+        {
+            if (!partials[0].aggregate || partials.size() == 1)
+            {
+                Sink merged = std::move(partials[0]);
+                for (size_t p = 1; p < partials.size(); ++p)
+                {
+                    merged.merge(partials[p]);
+                }
+                return merged;
+            }
+
+            const size_t partitions = std::min<size_t>(64, 4 * std::max(1u, std::thread::hardware_concurrency()));
+            // routed[p][b]: the positions in partial p's groupOrder of the keys that hash to partition b
+            std::vector<std::vector<std::vector<uint32_t>>> routed(partials.size(), std::vector<std::vector<uint32_t>>(partitions));
+            parallelFor(partials.size(), [&](size_t p)
+                        {
+                            const std::vector<std::string> &order = partials[p].groupOrder;
+                            for (size_t i = 0; i < order.size(); ++i)
+                            {
+                                routed[p][hashString(order[i]) % partitions].push_back(static_cast<uint32_t>(i));
+                            }
+                        });
+
+            struct Partition
+            {
+                std::unordered_map<std::string, Group> groups;
+                std::vector<std::pair<uint64_t, const std::string *>> firstSeen; // (partial << 32 | position, key in groups)
+            };
+            std::vector<Partition> merging(partitions);
+            parallelFor(partitions, [&](size_t b)
+                        {
+                            Partition &partition = merging[b];
+                            for (size_t p = 0; p < partials.size(); ++p)
+                            {
+                                for (uint32_t i : routed[p][b])
+                                {
+                                    const std::string &key = partials[p].groupOrder[i];
+                                    Group &theirs = partials[p].groups.find(key)->second;
+                                    auto inserted = partition.groups.try_emplace(key);
+                                    if (inserted.second)
+                                    {
+                                        inserted.first->second = std::move(theirs);
+                                        partition.firstSeen.push_back(std::make_pair(static_cast<uint64_t>(p) << 32 | i, &inserted.first->first));
+                                        continue;
+                                    }
+                                    for (size_t a = 0; a < theirs.accumulators.size(); ++a)
+                                    {
+                                        inserted.first->second.accumulators[a].merge(theirs.accumulators[a]);
+                                    }
+                                }
+                            }
+                        });
+
+            Sink merged = std::move(partials[0]);
+            for (size_t p = 1; p < partials.size(); ++p)
+            {
+                merged.result.rowsScanned += partials[p].result.rowsScanned;
+                merged.result.rowsMatched += partials[p].result.rowsMatched;
+            }
+            std::vector<std::pair<uint64_t, const std::string *>> firstSeen;
+            for (const Partition &partition : merging)
+            {
+                firstSeen.insert(firstSeen.end(), partition.firstSeen.begin(), partition.firstSeen.end());
+            }
+            std::sort(firstSeen.begin(), firstSeen.end());
+            merged.groupOrder.clear();
+            merged.groupOrder.reserve(firstSeen.size());
+            for (const auto &entry : firstSeen)
+            {
+                merged.groupOrder.push_back(*entry.second);
+            }
+            merged.groups.clear();
+            merged.groups.reserve(firstSeen.size());
+            for (Partition &partition : merging)
+            {
+                while (!partition.groups.empty())
+                {
+                    merged.groups.insert(partition.groups.extract(partition.groups.begin()));
+                }
+            }
+            return merged;
+        }
+
+        /**
+         * @brief Build the result: emit the groups, then apply ORDER BY and LIMIT.
+         */
+        QueryResult finish()
+        {
+            if (aggregate)
+            {
+                if (groups.empty() && query->groupBy.empty())
+                {
+                    groupOrder.push_back("");
+                    groups[""].accumulators.resize(query->items.size());
+                }
+                for (const std::string &key : groupOrder)
+                {
+                    const Group &group = groups[key];
+                    std::vector<QueryValue> output;
+                    for (size_t i = 0; i < query->items.size(); ++i)
+                    {
+                        const SelectItem &item = query->items[i];
+                        if (item.aggregate != Aggregate::NONE)
+                        {
+                            output.push_back(group.accumulators[i].result(item));
+                        }
+                        else
+                        {
+                            size_t keyIndex = std::find(query->groupBy.begin(), query->groupBy.end(), item.column) - query->groupBy.begin();
+                            output.push_back(group.keys[keyIndex]);
+                        }
+                    }
+                    result.rows.push_back(std::move(output));
+                }
+            }
+            orderAndLimit(*query, result);
+            return std::move(result);
+        }
+    };
+
+    /**
+     * @brief Execute a query.
+     * @param query The parsed query.
+     * @param store The store to read.
+     * @param catalog The indexes the access path may use.
+     * @param path The access path to read through.
+     * @param kernel The compiled WHERE clause, or null to interpret it.
+     * @return The result rows.
+     */
+    static QueryResult execute(const Query &query, const BeerStore &store, const QueryCatalog &catalog, const AccessPath &path,
+                               const PredicateKernel *kernel = nullptr)
+    {
+        size_t slices = path.kind == AccessPath::FULL_SCAN && query.isAggregate() ? sliceCount(store) : 1;
+        if (slices > 1)
+        {
+            // Each worker aggregates its slice into its own table; mergeAll combines them.
+            std::vector<Sink> partials(slices, Sink(query, kernel));
+            parallelFor(slices, [&](size_t s)
+                        {
+                            ColumnBatch batch;
+                            partials[s].need(batch);
+                            store.scanSlice(s, slices, [&](const Beer &beer)
+                                            {
+                                                batch.append(beer);
+                                                if (batch.size == ColumnBatch::CAPACITY)
+                                                {
+                                                    partials[s].consume(batch);
+                                                    batch.clear();
+                                                } });
+                            if (batch.size > 0)
+                            {
+                                partials[s].consume(batch);
+                            } });
+            return Sink::mergeAll(partials).finish();
+        }
+
+        Sink sink(query, kernel);
+        ColumnBatch batch;
+        sink.need(batch);
+        readPath(store, catalog, path, [&](const Beer &beer)
+                 {
+                     if (sink.isDone())
+                     {
+                         return;
+                     }
+                     batch.append(beer);
+                     if (batch.size == ColumnBatch::CAPACITY)
+                     {
+                         sink.consume(batch);
+                         batch.clear();
+                     } });
+        if (batch.size > 0)
+        {
+            sink.consume(batch);
+        }
+        return sink.finish();
+    }
+
+    /**
+     * @brief Apply a query's ORDER BY and LIMIT to its result rows.
+     * @param query The query.
+     * @param result The rows to sort and truncate.
+     */
+    static void orderAndLimit(const Query &query, QueryResult &result)
+    {
+        if (!query.orderBy.empty())
+        {
+            auto before = [&query](const std::vector<QueryValue> &a, const std::vector<QueryValue> &b)
+            {
+                for (const OrderItem &order : query.orderBy)
+                {
+                    int comparison = a[order.outputIndex].compare(b[order.outputIndex]);
+                    if (comparison != 0)
+                    {
+                        return order.descending ? comparison > 0 : comparison < 0;
+                    }
+                }
+                return false;
+            };
+            if (query.limit >= 0 && static_cast<size_t>(query.limit) < result.rows.size())
+            {
+                std::partial_sort(result.rows.begin(), result.rows.begin() + query.limit, result.rows.end(), before);
+            }
+            else
+            {
+                std::stable_sort(result.rows.begin(), result.rows.end(), before);
+            }
+        }
+        if (query.limit >= 0 && static_cast<size_t>(query.limit) < result.rows.size())
+        {
+            result.rows.resize(query.limit);
+        }
+    }
+};
+
+/**
+ * @brief A set of named reports answered together by one pass over the inventory.
+ *
+ * Each report is a query without parameters. A run fills one ColumnBatch
+ * with every column any report reads and hands each full batch to all the
+ * reports' QueryEngine::Sinks, so a set of reports costs one scan plus
+ * their filtering and aggregation rather than one scan each. When the store
+ * allows concurrent reads and is large enough, it is scanned in slices on
+ * all cores, and each report's partial results are merged so the output
+ * matches a sequential run.
+ */
+class SharedScan
+{
+private:
+    struct Report
+    {
+        std::string name;
+        std::string text;
+        PreparedQuery query;
+    };
+
+    std::vector<Report> reports; // in the order they were added
+
+public:
+    /**
+     * @brief Add a report, replacing any with the same name.
+     * @param name The report name.
+     * @param text The query text.
+     * @throws std::invalid_argument if the query does not parse or uses parameters or EXPLAIN.
+     */
+    void add(const std::string &name, const std::string &text)
+    {
+        PreparedQuery query(text);
+        if (!query.isBound() || query.getQuery().explain)
+        {
+            throw std::invalid_argument("a report cannot use parameters or EXPLAIN");
+        }
+        remove(name);
+        reports.push_back(Report{name, text, std::move(query)});
+    }
+
+    /**
+     * @brief Remove a report.
+     * @return True if a report with that name existed.
+     */
+    bool remove(const std::string &name)
+    {
+        auto it = std::find_if(reports.begin(), reports.end(), [&name](const Report &report)
+                               { return report.name == name; });
+        if (it == reports.end())
+        {
+            return false;
+        }
+        reports.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Get the number of reports.
+     */
+    size_t size() const
+    {
+        return reports.size();
+    }
+
+    /**
+     * @brief Visit the reports in the order they were added.
+     * @param visitor Called with each report's name and query text.
+     */
+    void forEach(const std::function<void(const std::string &, const std::string &)> &visitor) const
+    {
+        for (const Report &report : reports)
+        {
+            visitor(report.name, report.text);
+        }
+    }
+
+    /**
+     * @brief Run every report in one pass over a store.
+     * @param store The store to read.
+     * @return One result per report, in the order they were added.
+     */
+    std::vector<QueryResult> run(const BeerStore &store) const
+    {
+        size_t slices = QueryEngine::sliceCount(store);
+        std::vector<std::vector<QueryEngine::Sink>> sinks(slices);
+        parallelFor(slices, [&](size_t s)
+                    {
+                        std::vector<QueryEngine::Sink> &own = sinks[s];
+                        own.reserve(reports.size());
+                        ColumnBatch batch;
+                        for (const Report &report : reports)
+                        {
+                            own.emplace_back(report.query.getQuery(), report.query.getKernel());
+                            own.back().need(batch);
+                        }
+                        auto flush = [&]()
+                        {
+                            for (QueryEngine::Sink &sink : own)
+                            {
+                                if (!sink.isDone())
+                                {
+                                    sink.consume(batch);
+                                }
+                            }
+                            batch.clear();
+                        };
+                        store.scanSlice(s, slices, [&](const Beer &beer)
+                                        {
+                                            batch.append(beer);
+                                            if (batch.size == ColumnBatch::CAPACITY)
+                                            {
+                                                flush();
+                                            } });
+                        if (batch.size > 0)
+                        {
+                            flush();
+                        } });
+
+        std::vector<QueryResult> results;
+        for (size_t r = 0; r < reports.size(); ++r)
+        {
+            std::vector<QueryEngine::Sink> partials;
+            for (size_t s = 0; s < slices; ++s)
+            {
+                partials.push_back(std::move(sinks[s][r]));
+            }
+            results.push_back(QueryEngine::Sink::mergeAll(partials).finish());
+        }
+        return results;
+    }
+};
+
+/**
+ * @brief A named grouped aggregate over the inventory, kept current by deltas.
+ *
+ * The view is defined by an aggregate query. Every added, removed or
+ * changed beer only adjusts the group it leaves and the group it enters,
+ * so reading the view costs O(groups) instead of a scan. COUNT, SUM and
+ * AVG keep running totals; MIN and MAX keep a count per distinct value so
+ * that removals can be undone.
+ */
+class MaterializedView
+{
+private:
+    struct ValueOrder
+    {
+        bool operator()(const QueryValue &a, const QueryValue &b) const
+        {
+            return a.compare(b) < 0;
+        }
+    };
+
+    struct Group
+    {
+        std::vector<QueryValue> keys;
+        int64_t rows = 0;
+        std::vector<int64_t> intSums;                                   // per item
+        std::vector<double> doubleSums;                                 // per item
+        std::vector<std::map<QueryValue, int64_t, ValueOrder>> values; // per MIN / MAX item
+    };
+
+    Query query;
+    std::unordered_map<std::string, Group> groups;
+
+    void apply(const Beer &beer, int sign)
+    {
+        if (query.where && !matchesPredicate(*query.where, beer))
+        {
+            return;
+        }
+        std::string key;
+        for (BeerColumn column : query.groupBy)
+        {
+            beerColumnValue(beer, column).appendKey(key);
+        }
+        auto inserted = groups.emplace(key, Group());
+        Group &group = inserted.first->second;
+        if (inserted.second)
+        {
+            for (BeerColumn column : query.groupBy)
+            {
+                group.keys.push_back(beerColumnValue(beer, column));
+            }
+            group.intSums.resize(query.items.size());
+            group.doubleSums.resize(query.items.size());
+            group.values.resize(query.items.size());
+        }
+        group.rows += sign;
+        for (size_t i = 0; i < query.items.size(); ++i)
+        {
+            const SelectItem &item = query.items[i];
+            if (item.aggregate == Aggregate::NONE || item.countStar)
+            {
+                continue;
+            }
+            QueryValue value = beerColumnValue(beer, item.column);
+            group.intSums[i] += sign * value.intValue;
+            group.doubleSums[i] += sign * value.asDouble();
+            if (item.aggregate == Aggregate::MIN || item.aggregate == Aggregate::MAX)
+            {
+                auto &counts = group.values[i];
+                if ((counts[value] += sign) == 0)
+                {
+                    counts.erase(value);
+                }
+            }
+        }
+        if (group.rows == 0 && !query.groupBy.empty())
+        {
+            groups.erase(inserted.first);
+        }
+    }
+
+public:
+    /**
+     * @brief Define a view.
+     * @param text An aggregate query, e.g. "SELECT style, SUM(quantity) GROUP BY style".
+     * @throws std::invalid_argument if the query does not parse or does not aggregate.
+     */
+    explicit MaterializedView(const std::string &text) : query(QueryParser::parse(text))
+    {
+        if (!query.isAggregate())
+        {
+            throw std::invalid_argument("a view needs GROUP BY or an aggregate");
+        }
+        if (query.parameterCount > 0 || query.explain)
+        {
+            throw std::invalid_argument("a view cannot use parameters or EXPLAIN");
+        }
+        if (query.groupBy.empty())
+        {
+            Group &group = groups[std::string()]; // the single group exists even when empty
+            group.intSums.resize(query.items.size());
+            group.doubleSums.resize(query.items.size());
+            group.values.resize(query.items.size());
+        }
+    }
+
+    /**
+     * @brief Fill the view from the current contents of a store.
+     * @param store The store to read.
+     */
+    void populate(const BeerStore &store)
+    {
+        store.forEach([this](const Beer &beer)
+                      { apply(beer, 1); });
+    }
+
+    /**
+     * @brief Apply one change to the inventory.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before)
+        {
+            apply(*before, -1);
+        }
+        if (after)
+        {
+            apply(*after, 1);
+        }
+    }
+
+    /**
+     * @brief Get the number of groups in the view.
+     */
+    size_t getGroupCount() const
+    {
+        return groups.size();
+    }
+
+    /**
+     * @brief Read the view as a query result, in the view's ORDER BY if it has one.
+     */
+    QueryResult read() const
+    {
+        QueryResult result;
+        for (const SelectItem &item : query.items)
+        {
+            result.columns.push_back(item.label);
+        }
+        for (const auto &entry : groups)
+        {
+            const Group &group = entry.second;
+            std::vector<QueryValue> row;
+            for (size_t i = 0; i < query.items.size(); ++i)
+            {
+                const SelectItem &item = query.items[i];
+                switch (item.aggregate)
+                {
+                case Aggregate::NONE:
+                    row.push_back(group.keys[std::find(query.groupBy.begin(), query.groupBy.end(), item.column) - query.groupBy.begin()]);
+                    break;
+                case Aggregate::COUNT:
+                    row.push_back(QueryValue::ofInt(group.rows));
+                    break;
+                case Aggregate::SUM:
+                    row.push_back(beerColumnType(item.column) == ColumnType::INT64 ? QueryValue::ofInt(group.intSums[i])
+                                                                                  : QueryValue::ofDouble(group.doubleSums[i]));
+                    break;
+                case Aggregate::AVG:
+                    row.push_back(QueryValue::ofDouble(group.rows ? group.doubleSums[i] / group.rows : 0));
+                    break;
+                case Aggregate::MIN:
+                    row.push_back(group.values[i].empty() ? QueryValue() : group.values[i].begin()->first);
+                    break;
+                case Aggregate::MAX:
+                    row.push_back(group.values[i].empty() ? QueryValue() : group.values[i].rbegin()->first);
+                    break;
+                }
+            }
+            result.rows.push_back(std::move(row));
+        }
+        QueryEngine::orderAndLimit(query, result);
+        return result;
+    }
+};
+
+/**
+ * @brief Results of recent queries, reused until the data they read changes.
+ *
+ * Entries are keyed by a normalized form of the parsed query, so spelling,
+ * case, column aliases and EXECUTE arguments that come to the same query
+ * share one entry. The key holds what each output column computes (its
+ * column and aggregate) but not its label; a hit is printed under the
+ * labels of the query that asked for it. Each entry remembers the catalog versions of the columns
+ * it read and of the set of rows; a lookup compares those few counters and
+ * drops the entry if any has moved. Edits to columns a query never reads
+ * leave its entry valid.
+ */
+class QueryResultCache
+{
+private:
+    struct Entry
+    {
+        QueryResult result;
+        std::vector<std::pair<BeerColumn, uint64_t>> columnVersions;
+        uint64_t rowVersion = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    size_t capacity;
+    uint64_t clock;
+    size_t hits;
+    size_t misses;
+
+    static void readColumns(const Predicate &predicate, std::vector<bool> &read)
+    {
+        if (predicate.kind == Predicate::COMPARE)
+        {
+            read[static_cast<size_t>(predicate.column)] = true;
+        }
+        for (const auto &child : predicate.children)
+        {
+            readColumns(*child, read);
+        }
+    }
+
+    static void appendPredicate(const Predicate &predicate, std::string &key)
+    {
+        appendPod(key, static_cast<uint8_t>(predicate.kind));
+        if (predicate.kind == Predicate::COMPARE)
+        {
+            appendPod(key, static_cast<uint8_t>(predicate.column));
+            appendPod(key, static_cast<uint8_t>(predicate.op));
+            appendPod(key, static_cast<uint8_t>(predicate.literal.type));
+            predicate.literal.appendKey(key);
+        }
+        appendPod(key, static_cast<uint32_t>(predicate.children.size()));
+        for (const auto &child : predicate.children)
+        {
+            appendPredicate(*child, key);
+        }
+    }
+
+public:
+    explicit QueryResultCache(size_t capacity = 256) : capacity(capacity), clock(0), hits(0), misses(0) {}
+
+    /**
+     * @brief Build the cache key of a query with its parameters bound.
+     */
+    static std::string normalize(const Query &query)
+    {
+        std::string key;
+        appendPod(key, static_cast<uint32_t>(query.items.size()));
+        for (const SelectItem &item : query.items)
+        {
+            appendPod(key, static_cast<uint8_t>(item.aggregate));
+            appendPod(key, static_cast<uint8_t>(item.countStar));
+            appendPod(key, static_cast<uint8_t>(item.column));
+        }
+        appendPod(key, static_cast<uint8_t>(query.where != nullptr));
+        if (query.where)
+        {
+            appendPredicate(*query.where, key);
+        }
+        appendPod(key, static_cast<uint32_t>(query.groupBy.size()));
+        for (BeerColumn column : query.groupBy)
+        {
+            appendPod(key, static_cast<uint8_t>(column));
+        }
+        appendPod(key, static_cast<uint32_t>(query.orderBy.size()));
+        for (const OrderItem &order : query.orderBy)
+        {
+            appendPod(key, static_cast<uint32_t>(order.outputIndex));
+            appendPod(key, static_cast<uint8_t>(order.descending));
+        }
+        appendPod(key, query.limit);
+        return key;
+    }
+
+    /**
+     * @brief Look up a result that is still current.
+     * @param key The normalized query.
+     * @param catalog The catalog whose versions the entry is checked against.
+     * @return The cached result, or null if there is none or it is stale.
+     */
+    const QueryResult *find(const std::string &key, const QueryCatalog &catalog)
+    {
+        auto it = entries.find(key);
+        if (it == entries.end())
+        {
+            ++misses;
+            return nullptr;
+        }
+        Entry &entry = it->second;
+        bool current = entry.rowVersion == catalog.getRowVersion();
+        for (size_t i = 0; current && i < entry.columnVersions.size(); ++i)
+        {
+            current = entry.columnVersions[i].second == catalog.getVersion(entry.columnVersions[i].first);
+        }
+        if (!current)
+        {
+            entries.erase(it);
+            ++misses;
+            return nullptr;
+        }
+        entry.lastUsed = ++clock;
+        ++hits;
+        return &entry.result;
+    }
+
+    /**
+     * @brief Remember a result, evicting the least recently used entry if the cache is full.
+     * @param key The normalized query.
+     * @param query The query that produced the result.
+     * @param catalog The catalog whose current versions the result reflects.
+     * @param result The result.
+     */
+    void store(const std::string &key, const Query &query, const QueryCatalog &catalog, QueryResult result)
+    {
+        if (capacity == 0)
+        {
+            return;
+        }
+        if (entries.size() >= capacity && entries.find(key) == entries.end())
+        {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->second.lastUsed < oldest->second.lastUsed)
+                {
+                    oldest = it;
+                }
+            }
+            entries.erase(oldest);
+        }
+        std::vector<bool> read(BEER_COLUMN_COUNT, false);
+        for (const SelectItem &item : query.items)
+        {
+            read[static_cast<size_t>(item.column)] = read[static_cast<size_t>(item.column)] || !item.countStar;
+        }
+        for (BeerColumn column : query.groupBy)
+        {
+            read[static_cast<size_t>(column)] = true;
+        }
+        if (query.where)
+        {
+            readColumns(*query.where, read);
+        }
+        Entry &entry = entries[key];
+        entry.result = std::move(result);
+        entry.columnVersions.clear();
+        for (size_t c = 0; c < BEER_COLUMN_COUNT; ++c)
+        {
+            if (read[c])
+            {
+                entry.columnVersions.emplace_back(static_cast<BeerColumn>(c), catalog.getVersion(static_cast<BeerColumn>(c)));
+            }
+        }
+        entry.rowVersion = catalog.getRowVersion();
+        entry.lastUsed = ++clock;
+    }
+
+    /**
+     * @brief Get the number of lookups answered from the cache.
+     */
+    size_t getHits() const
+    {
+        return hits;
+    }
+
+    /**
+     * @brief Get the number of lookups that had to run the query.
+     */
+    size_t getMisses() const
+    {
+        return misses;
+    }
+};
+
+/**
+ * @brief Print a query result as a table under the given column labels.
+ * @param result The result to print.
+ * @param columns One label per column of the result.
+ */
+void printQueryResult(const QueryResult &result, const std::vector<std::string> &columns)
+{
+    std::vector<size_t> widths;
+    for (const std::string &column : columns)
+    {
+        widths.push_back(column.size());
+    }
+    for (const auto &row : result.rows)
+    {
+        for (size_t i = 0; i < row.size(); ++i)
+        {
+            widths[i] = std::max(widths[i], row[i].toString().size());
+        }
+    }
+    auto printRow = [&widths](const std::vector<std::string> &cells)
+    {
+        for (size_t i = 0; i < cells.size(); ++i)
+        {
+            std::cout << (i ? " | " : "") << cells[i] << std::string(widths[i] - cells[i].size(), ' ');
+        }
+        std::cout << std::endl;
+    };
+    printRow(columns);
+    std::string separator;
+    for (size_t i = 0; i < widths.size(); ++i)
+    {
+        separator += std::string(widths[i], '-') + (i + 1 < widths.size() ? "-+-" : "");
+    }
+    std::cout << separator << std::endl;
+    for (const auto &row : result.rows)
+    {
+        std::vector<std::string> cells;
+        for (const QueryValue &value : row)
+        {
+            cells.push_back(value.toString());
+        }
+        printRow(cells);
+    }
+    std::cout << "(" << result.rows.size() << (result.rows.size() == 1 ? " row)" : " rows)") << std::endl;
+}
+
+/**
+ * @brief Print a query result as a table.
+ * @param result The result to print.
+ */
+void printQueryResult(const QueryResult &result)
+{
+    printQueryResult(result, result.columns);
+}
+
+/**
+ * @brief Print the plan of an executed query with estimated and actual row counts.
+ * @param plan The plan the query ran with.
+ * @param query The query that ran.
+ * @param result The result it produced.
+ * @param planMillis The time spent planning.
+ * @param executeMillis The time spent executing.
+ */
+void printQueryPlan(const QueryPlan &plan, const PreparedQuery &query, const QueryResult &result, double planMillis, double executeMillis)
+{
+    std::cout << "Plan: " << plan.access.describe() << std::endl;
+    if (query.getKernel())
+    {
+        std::cout << "  filter: compiled kernel (" << query.getKernel()->getTermCount() << " comparisons)" << std::endl;
+    }
+    else if (query.getQuery().where)
+    {
+        std::cout << "  filter: interpreted" << std::endl;
+    }
+    std::cout << "  rows read:     estimated " << static_cast<long long>(std::llround(plan.access.estimatedRows))
+              << ", actual " << result.rowsScanned << std::endl;
+    std::cout << "  rows matched:  estimated " << static_cast<long long>(std::llround(plan.estimatedRows))
+              << ", actual " << result.rowsMatched << std::endl;
+    std::cout << "  rows returned: " << result.rows.size() << std::endl;
+    std::cout << "Considered:" << std::endl;
+    for (const AccessPath &path : plan.alternatives)
+    {
+        std::cout << "  " << (path.describe() == plan.access.describe() ? "* " : "  ") << path.describe()
+                  << "  cost " << static_cast<long long>(std::llround(path.estimatedCost))
+                  << ", rows " << static_cast<long long>(std::llround(path.estimatedRows)) << std::endl;
+    }
+    std::cout << "Time: planning " << planMillis << " ms, execution " << executeMillis << " ms" << std::endl;
+}
+
+/**
+ * @brief Threshold watches on stock levels.
+ *
+ * A watch fires when the quantity on hand of a barcode, or the total of a
+ * style, crosses its threshold: "below N" when it falls from N or more to
+ * less than N, "above M" when it rises from M or less to more than M. The
+ * watches on each barcode or style are kept in two sets ordered by
+ * threshold, so a change from old to new fires exactly the thresholds
+ * between them with one range search: O(log W + fired) however many watches
+ * are registered.
+ */
+class WatchRegistry
+{
+public:
+    enum Subject : uint8_t
+    {
+        BARCODE_QUANTITY,
+        STYLE_TOTAL
+    };
+
+    struct Watch
+    {
+        int id = 0;
+        Subject subject = BARCODE_QUANTITY;
+        std::string key; // the barcode's digits or the style
+        bool below = false;
+        int64_t threshold = 0;
+
+        /**
+         * @brief Describe the watch, e.g. "total of style IPA above 500".
+         */
+        std::string describe() const
+        {
+            return std::string(subject == BARCODE_QUANTITY ? "quantity of barcode " : "total of style ") + key +
+                   (below ? " below " : " above ") + std::to_string(threshold);
+        }
+    };
+
+    struct Firing
+    {
+        const Watch *watch;
+        int64_t value; // the level that crossed the threshold
+    };
+
+private:
+    struct Level
+    {
+        int64_t value = 0;
+        std::set<std::pair<int64_t, int>> below; // (threshold, watch id)
+        std::set<std::pair<int64_t, int>> above;
+    };
+
+    std::unordered_map<std::string, Level> levels[2]; // per subject, by key
+    std::unordered_map<int, Watch> watches;
+    int nextId;
+
+    void move(Subject subject, const std::string &key, int64_t delta, std::vector<Firing> &fired)
+    {
+        if (delta == 0)
+        {
+            return;
+        }
+        auto it = levels[subject].find(key);
+        if (it == levels[subject].end())
+        {
+            it = levels[subject].emplace(key, Level()).first;
+        }
+        Level &level = it->second;
+        int64_t before = level.value;
+        level.value += delta;
+        if (delta < 0)
+        {
+            // before >= threshold > after
+            auto first = level.below.upper_bound(std::make_pair(level.value, INT_MAX));
+            auto last = level.below.upper_bound(std::make_pair(before, INT_MAX));
+            for (; first != last; ++first)
+            {
+                fired.push_back(Firing{&watches.at(first->second), level.value});
+            }
+        }
+        else
+        {
+            // before <= threshold < after
+            auto first = level.above.lower_bound(std::make_pair(before, INT_MIN));
+            auto last = level.above.lower_bound(std::make_pair(level.value, INT_MIN));
+            for (; first != last; ++first)
+            {
+                fired.push_back(Firing{&watches.at(first->second), level.value});
+            }
+        }
+        if (level.value == 0 && level.below.empty() && level.above.empty())
+        {
+            levels[subject].erase(it);
+        }
+    }
+
+public:
+    WatchRegistry() : nextId(1) {}
+
+    /**
+     * @brief Register a watch.
+     * @param subject What the threshold applies to.
+     * @param key The barcode's digits or the style.
+     * @param below True to fire on falling below the threshold, false on rising above it.
+     * @param threshold The threshold.
+     * @return The new watch.
+     */
+    const Watch &add(Subject subject, const std::string &key, bool below, int64_t threshold)
+    {
+        Watch watch;
+        watch.id = nextId++;
+        watch.subject = subject;
+        watch.key = key;
+        watch.below = below;
+        watch.threshold = threshold;
+        Level &level = levels[subject][key];
+        (below ? level.below : level.above).insert(std::make_pair(threshold, watch.id));
+        return watches.emplace(watch.id, watch).first->second;
+    }
+
+    /**
+     * @brief Remove a watch.
+     * @param id The watch id.
+     * @return True if the watch existed.
+     */
+    bool remove(int id)
+    {
+        auto it = watches.find(id);
+        if (it == watches.end())
+        {
+            return false;
+        }
+        const Watch &watch = it->second;
+        auto level = levels[watch.subject].find(watch.key);
+        (watch.below ? level->second.below : level->second.above).erase(std::make_pair(watch.threshold, id));
+        if (level->second.value == 0 && level->second.below.empty() && level->second.above.empty())
+        {
+            levels[watch.subject].erase(level);
+        }
+        watches.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Get the current level a watch compares against.
+     */
+    int64_t getLevel(const Watch &watch) const
+    {
+        auto it = levels[watch.subject].find(watch.key);
+        return it == levels[watch.subject].end() ? 0 : it->second.value;
+    }
+
+    /**
+     * @brief Call a function for every watch, in id order.
+     */
+    void forEach(const std::function<void(const Watch &)> &visitor) const
+    {
+        std::vector<const Watch *> sorted;
+        for (const auto &entry : watches)
+        {
+            sorted.push_back(&entry.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Watch *a, const Watch *b)
+                  { return a->id < b->id; });
+        for (const Watch *watch : sorted)
+        {
+            visitor(*watch);
+        }
+    }
+
+    /**
+     * @brief Track a change to the inventory and collect the watches it fires.
+     *
+     * A change that leaves a beer under the same barcode or style moves that
+     * level once by the net difference, so an edit from 10 to 12 bottles
+     * does not look like a drop to 0.
+     *
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     * @param fired Receives the watches that fired; valid until the next call.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after, std::vector<Firing> &fired)
+    {
+        fired.clear();
+        int64_t removed = before ? before->getQuantity() : 0;
+        int64_t added = after ? after->getQuantity() : 0;
+        std::string oldBarcode = before ? std::to_string(before->getBarcode().getValue()) : std::string();
+        std::string newBarcode = after ? std::to_string(after->getBarcode().getValue()) : std::string();
+        if (before && after && oldBarcode == newBarcode)
+        {
+            move(BARCODE_QUANTITY, newBarcode, added - removed, fired);
+        }
+        else
+        {
+            if (before)
+            {
+                move(BARCODE_QUANTITY, oldBarcode, -removed, fired);
+            }
+            if (after)
+            {
+                move(BARCODE_QUANTITY, newBarcode, added, fired);
+            }
+        }
+        if (before && after && before->getStyle() == after->getStyle())
+        {
+            move(STYLE_TOTAL, after->getStyle(), added - removed, fired);
+        }
+        else
+        {
+            if (before)
+            {
+                move(STYLE_TOTAL, before->getStyle(), -removed, fired);
+            }
+            if (after)
+            {
+                move(STYLE_TOTAL, after->getStyle(), added, fired);
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of registered watches.
+     */
+    size_t size() const
+    {
+        return watches.size();
+    }
+};
+
+/**
+ * @brief A server-sent-events feed of inventory changes for live dashboards.
+ *
+ * Displays connect with "GET /events" and receive one "snapshot" event with
+ * every count, then at most one "delta" event per tick holding only what
+ * changed since the previous tick: the latest count of each changed name,
+ * the total, the breakage total and newly flagged beers. Changes published
+ * between ticks are coalesced, so a display never sees more than one event
+ * per interval however busy the inventory is. Each tick's event is
+ * serialized once and shared by every subscriber's send queue, so the cost
+ * of a tick is one serialization plus one send per display. A display that
+ * falls MAX_BACKLOG events behind is disconnected and can reconnect for a
+ * fresh snapshot.
+ *
+ * The feed listens on the loopback interface unless given another address,
+ * and sends no Access-Control-Allow-Origin header unless given an origin, so
+ * by default only pages and tools on the same machine can subscribe.
+ *
+ * The sockets are served by one background thread; publish* may be called
+ * from any thread.
+ */
+class DashboardFeed
+{
+private:
+    typedef std::shared_ptr<const std::string> Buffer;
+
+    struct Subscriber
+    {
+        int socket = -1;
+        std::string request; // bytes of the request header read so far
+        bool streaming = false;
+        bool needsSnapshot = false;
+        bool closeWhenDrained = false;
+        std::vector<Buffer> queue;
+        size_t queueHead = 0; // first unsent buffer in queue
+        size_t sent = 0;      // bytes of queue[queueHead] already sent
+    };
+
+    struct Delta
+    {
+        std::map<std::string, int> counts;
+        std::optional<int> total;
+        std::optional<int> breakageTotal;
+        std::vector<std::pair<std::string, int>> flagged;
+
+        bool empty() const
+        {
+            return counts.empty() && !total && !breakageTotal && flagged.empty();
+        }
+    };
+
+    static const size_t MAX_BACKLOG = 64;
+    static const size_t MAX_REQUEST = 8192;
+    static const int HEARTBEAT_TICKS = 15;
+
+    int listener;
+    Buffer streamHeader;
+    std::chrono::milliseconds interval;
+    std::atomic<bool> stopping;
+    std::mutex mutex; // guards pending
+    Delta pending;
+
+    // Owned by the worker thread.
+    std::map<std::string, int> counts;
+    int total;
+    int breakageTotal;
+    uint64_t sequence;
+    std::vector<Subscriber> subscribers;
+    std::thread worker;
+
+    static void appendJsonString(std::string &out, const std::string &value)
+    {
+        out.push_back('"');
+        for (unsigned char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out.push_back('\\');
+                out.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                out += "\\u00";
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xF]);
+            }
+            else
+            {
+                out.push_back(static_cast<char>(c));
+            }
+        }
+        out.push_back('"');
+    }
+
+    static void appendCounts(std::string &out, const std::map<std::string, int> &values)
+    {
+        out += "\"counts\":{";
+        bool first = true;
+        for (const auto &entry : values)
+        {
+            if (!first)
+            {
+                out.push_back(',');
+            }
+            first = false;
+            appendJsonString(out, entry.first);
+            out.push_back(':');
+            out += std::to_string(entry.second);
+        }
+        out.push_back('}');
+    }
+
+    Buffer serializeSnapshot() const
+    {
+        std::string event = "event: snapshot\nid: " + std::to_string(sequence) + "\ndata: {\"seq\":" + std::to_string(sequence) +
+                            ",\"total\":" + std::to_string(total) + ",\"breakage\":" + std::to_string(breakageTotal) + ",";
+        appendCounts(event, counts);
+        event += "}\n\n";
+        return std::make_shared<const std::string>(std::move(event));
+    }
+
+    Buffer serializeDelta(const Delta &delta) const
+    {
+        std::string event = "event: delta\nid: " + std::to_string(sequence) + "\ndata: {\"seq\":" + std::to_string(sequence);
+        if (delta.total)
+        {
+            event += ",\"total\":" + std::to_string(*delta.total);
+        }
+        if (delta.breakageTotal)
+        {
+            event += ",\"breakage\":" + std::to_string(*delta.breakageTotal);
+        }
+        if (!delta.counts.empty())
+        {
+            event.push_back(',');
+            appendCounts(event, delta.counts);
+        }
+        if (!delta.flagged.empty())
+        {
+            event += ",\"flagged\":[";
+            for (size_t i = 0; i < delta.flagged.size(); ++i)
+            {
+                event += i == 0 ? "{\"name\":" : ",{\"name\":";
+                appendJsonString(event, delta.flagged[i].first);
+                event += ",\"quantity\":" + std::to_string(delta.flagged[i].second) + "}";
+            }
+            event.push_back(']');
+        }
+        event += "}\n\n";
+        return std::make_shared<const std::string>(std::move(event));
+    }
+
+    static void enqueue(Subscriber &subscriber, const Buffer &buffer)
+    {
+        subscriber.queue.push_back(buffer);
+    }
+
+    /**
+     * @brief Read whatever the client has sent and answer a complete request.
+     * @return False if the connection should be closed.
+     */
+    bool readRequest(Subscriber &subscriber)
+    {
+        char buffer[1024];
+        ssize_t received = recv(subscriber.socket, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        if (subscriber.streaming || subscriber.closeWhenDrained)
+        {
+            return true; // ignore anything after the request
+        }
+        subscriber.request.append(buffer, static_cast<size_t>(received));
+        if (subscriber.request.find("\r\n\r\n") == std::string::npos)
+        {
+            return subscriber.request.size() <= MAX_REQUEST;
+        }
+        static const Buffer notFound = std::make_shared<const std::string>(
+            "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 29\r\nConnection: close\r\n\r\n"
+            "Subscribe with GET /events.\r\n");
+        const std::string &request = subscriber.request;
+        if (request.compare(0, 12, "GET /events ") == 0 || request.compare(0, 12, "GET /events?") == 0)
+        {
+            subscriber.streaming = true;
+            subscriber.needsSnapshot = true;
+            enqueue(subscriber, streamHeader);
+        }
+        else
+        {
+            subscriber.closeWhenDrained = true;
+            enqueue(subscriber, notFound);
+        }
+        subscriber.request.clear();
+        subscriber.request.shrink_to_fit();
+        return true;
+    }
+
+    /**
+     * @brief Send as much of the queue as the socket takes without blocking.
+     * @return False if the connection should be closed.
+     */
+    static bool flush(Subscriber &subscriber)
+    {
+        while (subscriber.queueHead < subscriber.queue.size())
+        {
+            const std::string &buffer = *subscriber.queue[subscriber.queueHead];
+            ssize_t written = send(subscriber.socket, buffer.data() + subscriber.sent, buffer.size() - subscriber.sent, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            subscriber.sent += static_cast<size_t>(written);
+            if (subscriber.sent < buffer.size())
+            {
+                return true;
+            }
+            subscriber.sent = 0;
+            subscriber.queue[subscriber.queueHead++].reset();
+        }
+        subscriber.queue.clear();
+        subscriber.queueHead = 0;
+        return !subscriber.closeWhenDrained;
+    }
+
+    void acceptAll()
+    {
+        for (;;)
+        {
+            int socket = accept(listener, nullptr, nullptr);
+            if (socket < 0)
+            {
+                return;
+            }
+            fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+            Subscriber subscriber;
+            subscriber.socket = socket;
+            subscribers.push_back(std::move(subscriber));
+        }
+    }
+
+    void tick(int &idleTicks)
+    {
+        Delta delta;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(delta, pending);
+        }
+        Buffer event;
+        if (!delta.empty())
+        {
+            ++sequence;
+            for (const auto &entry : delta.counts)
+            {
+                counts[entry.first] = entry.second;
+            }
+            total = delta.total.value_or(total);
+            breakageTotal = delta.breakageTotal.value_or(breakageTotal);
+            event = serializeDelta(delta);
+            idleTicks = 0;
+        }
+        else if (++idleTicks >= HEARTBEAT_TICKS)
+        {
+            static const Buffer heartbeat = std::make_shared<const std::string>(": keep-alive\n\n");
+            event = heartbeat;
+            idleTicks = 0;
+        }
+        Buffer snapshot;
+        for (Subscriber &subscriber : subscribers)
+        {
+            if (!subscriber.streaming)
+            {
+                continue;
+            }
+            if (subscriber.needsSnapshot)
+            {
+                if (!snapshot)
+                {
+                    snapshot = serializeSnapshot();
+                }
+                enqueue(subscriber, snapshot);
+                subscriber.needsSnapshot = false;
+            }
+            else if (event)
+            {
+                enqueue(subscriber, event);
+            }
+        }
+    }
+
+    void run()
+    {
+        std::vector<pollfd> fds;
+        auto nextTick = std::chrono::steady_clock::now() + interval;
+        int idleTicks = 0;
+        while (!stopping)
+        {
+            fds.clear();
+            fds.push_back(pollfd{listener, POLLIN, 0});
+            for (const Subscriber &subscriber : subscribers)
+            {
+                short events = POLLIN;
+                if (subscriber.queueHead < subscriber.queue.size())
+                {
+                    events |= POLLOUT;
+                }
+                fds.push_back(pollfd{subscriber.socket, events, 0});
+            }
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - std::chrono::steady_clock::now());
+            poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(0, wait.count())));
+
+            std::vector<bool> alive(subscribers.size(), true);
+            for (size_t i = 0; i < subscribers.size(); ++i)
+            {
+                short revents = fds[i + 1].revents;
+                if (revents & (POLLERR | POLLHUP | POLLNVAL))
+                {
+                    alive[i] = false;
+                }
+                else if (revents & POLLIN)
+                {
+                    alive[i] = readRequest(subscribers[i]);
+                }
+            }
+            if (std::chrono::steady_clock::now() >= nextTick)
+            {
+                tick(idleTicks);
+                nextTick += interval;
+                if (nextTick < std::chrono::steady_clock::now())
+                {
+                    nextTick = std::chrono::steady_clock::now() + interval;
+                }
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < subscribers.size(); ++i)
+            {
+                Subscriber &subscriber = subscribers[i];
+                if (alive[i] && subscriber.queueHead < subscriber.queue.size())
+                {
+                    alive[i] = flush(subscriber);
+                }
+                if (!alive[i] || subscriber.queue.size() - subscriber.queueHead > MAX_BACKLOG)
+                {
+                    close(subscriber.socket);
+                    continue;
+                }
+                if (kept != i)
+                {
+                    subscribers[kept] = std::move(subscriber);
+                }
+                ++kept;
+            }
+            subscribers.resize(kept);
+            if (fds[0].revents & POLLIN)
+            {
+                acceptAll();
+            }
+        }
+        for (Subscriber &subscriber : subscribers)
+        {
+            close(subscriber.socket);
+        }
+    }
+
+public:
+    /**
+     * @brief Start serving the feed.
+     * @param port The TCP port to listen on, or 0 for any free port.
+     * @param interval The tick: the most often a display receives an event.
+     * @param bindAddress The IPv4 address to listen on; "0.0.0.0" for every interface.
+     * @param allowOrigin The origin sent in Access-Control-Allow-Origin, or empty for none.
+     * @throws std::runtime_error if the address is invalid or the port cannot be opened.
+     */
+    DashboardFeed(int port, std::chrono::milliseconds interval, const std::string &bindAddress = "127.0.0.1",
+                  const std::string &allowOrigin = "")
+        : interval(interval), stopping(false), total(0), breakageTotal(0), sequence(0)
+    {
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        if (inet_pton(AF_INET, bindAddress.c_str(), &address.sin_addr) != 1)
+        {
+            throw std::runtime_error("Invalid dashboard address " + bindAddress);
+        }
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        std::string header = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                             "Connection: keep-alive\r\n";
+        if (!allowOrigin.empty())
+        {
+            header += "Access-Control-Allow-Origin: " + allowOrigin + "\r\n";
+        }
+        streamHeader = std::make_shared<const std::string>(header + "\r\n");
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            throw std::runtime_error("Unable to create the dashboard socket");
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+        {
+            close(listener);
+            throw std::runtime_error("Unable to listen on port " + std::to_string(port));
+        }
+        fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+        worker = std::thread([this]()
+                             { run(); });
+    }
+
+    DashboardFeed(const DashboardFeed &) = delete;
+    DashboardFeed &operator=(const DashboardFeed &) = delete;
+
+    ~DashboardFeed()
+    {
+        stopping = true;
+        worker.join();
+        close(listener);
+    }
+
+    /**
+     * @brief Get the port the feed listens on.
+     */
+    int getPort() const
+    {
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+        return ntohs(address.sin_port);
+    }
+
+    /**
+     * @brief Publish the new count of a beer name.
+     */
+    void publishCount(const std::string &name, int count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.counts[name] = count;
+    }
+
+    /**
+     * @brief Publish the new total number of bottles.
+     */
+    void publishTotal(int newTotal)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.total = newTotal;
+    }
+
+    /**
+     * @brief Publish the new breakage total.
+     */
+    void publishBreakageTotal(int newTotal)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.breakageTotal = newTotal;
+    }
+
+    /**
+     * @brief Publish a beer flagged for breakage.
+     */
+    void publishFlagged(const std::string &name, int quantity)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.flagged.push_back(std::make_pair(name, quantity));
+    }
+};
+
+/**
+ * @brief Constant-memory sketches of which barcodes the inventory operations touch.
+ *
+ * Every add, remove and edit is one event for the barcode involved. Three
+ * sketches summarise the stream, each O(1) per event:
+ *
+ * - Space-Saving keeps the TOP_K most active barcodes in a small min-heap.
+ *   A barcode outside it replaces the least active entry and inherits its
+ *   count as an error bound, so a true heavy hitter is never missed.
+ * - A count-min sketch estimates the activity of any barcode, never
+ *   underestimating; a barcode that estimates zero has certainly been idle.
+ * - One HyperLogLog per hour for the last HOURS hours estimates how many
+ *   distinct barcodes were active in that hour.
+ *
+ * At each new hour all counts are halved, so "hot" and "dead" describe
+ * recent activity rather than history.
+ */
+class ActivitySketch
+{
+public:
+    static const size_t TOP_K = 64;
+    static const size_t HOURS = 24;
+
+    struct HeavyHitter
+    {
+        long long barcode;
+        uint64_t count; // may overcount by up to error
+        uint64_t error;
+    };
+
+private:
+    static const size_t DEPTH = 4;
+    static const size_t WIDTH = 4096; // a power of two
+    static const int PRECISION = 12;   // HyperLogLog registers = 2^PRECISION
+
+    std::vector<uint32_t> counters;          // DEPTH rows of WIDTH count-min cells
+    std::vector<HeavyHitter> heap;           // Space-Saving entries, least count first
+    std::unordered_map<long long, size_t> heapIndex;
+    std::vector<std::vector<uint8_t>> hours; // HyperLogLog registers, a ring indexed by hour
+    std::vector<int64_t> hourStamps;         // the hour each ring slot describes
+    int64_t currentHour;
+
+    bool less(size_t a, size_t b) const
+    {
+        return heap[a].count < heap[b].count;
+    }
+
+    void swapEntries(size_t a, size_t b)
+    {
+        std::swap(heap[a], heap[b]);
+        heapIndex[heap[a].barcode] = a;
+        heapIndex[heap[b].barcode] = b;
+    }
+
+    void siftUp(size_t i)
+    {
+        while (i > 0 && less(i, (i - 1) / 2))
+        {
+            swapEntries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void siftDown(size_t i)
+    {
+        for (;;)
+        {
+            size_t smallest = i;
+            for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap.size(); ++child)
+            {
+                if (less(child, smallest))
+                {
+                    smallest = child;
+                }
+            }
+            if (smallest == i)
+            {
+                return;
+            }
+            swapEntries(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void advanceTo(int64_t hour)
+    {
+        if (hour <= currentHour)
+        {
+            return;
+        }
+        int shift = static_cast<int>(std::min<int64_t>(hour - currentHour, 32));
+        for (uint32_t &counter : counters)
+        {
+            counter = shift >= 32 ? 0 : counter >> shift;
+        }
+        for (HeavyHitter &entry : heap)
+        {
+            entry.count = shift >= 32 ? 0 : entry.count >> shift; // monotone, so the heap stays ordered
+            entry.error = shift >= 32 ? 0 : entry.error >> shift;
+        }
+        currentHour = hour;
+        size_t slot = static_cast<size_t>(hour % static_cast<int64_t>(HOURS));
+        std::fill(hours[slot].begin(), hours[slot].end(), 0);
+        hourStamps[slot] = hour;
+    }
+
+    static double estimateDistinct(const std::vector<uint8_t> &registers)
+    {
+        const double m = static_cast<double>(registers.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t rank : registers)
+        {
+            sum += std::ldexp(1.0, -rank);
+            zeros += rank == 0;
+        }
+        double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0)
+        {
+            estimate = m * std::log(m / static_cast<double>(zeros)); // linear counting for small sets
+        }
+        return estimate;
+    }
+
+public:
+    ActivitySketch() : counters(DEPTH * WIDTH, 0), hours(HOURS, std::vector<uint8_t>(size_t(1) << PRECISION, 0)),
+                       hourStamps(HOURS, -1), currentHour(-1) {}
+
+    /**
+     * @brief Count one operation on a barcode.
+     * @param barcode The barcode involved.
+     * @param now The time of the operation.
+     */
+    void record(long long barcode, std::time_t now)
+    {
+        advanceTo(static_cast<int64_t>(now) / 3600);
+        uint64_t hash = mixHash(static_cast<uint64_t>(barcode));
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            uint32_t &counter = counters[row * WIDTH + ((hash >> (16 * row)) & (WIDTH - 1))];
+            counter += counter != UINT32_MAX;
+        }
+
+        std::vector<uint8_t> &registers = hours[static_cast<size_t>(currentHour % static_cast<int64_t>(HOURS))];
+        uint64_t second = mixHash(hash);
+        uint64_t rest = second << PRECISION;
+        uint8_t rank = static_cast<uint8_t>(rest == 0 ? 64 - PRECISION + 1 : __builtin_clzll(rest) + 1);
+        uint8_t &reg = registers[second >> (64 - PRECISION)];
+        reg = std::max(reg, rank);
+
+        auto it = heapIndex.find(barcode);
+        if (it != heapIndex.end())
+        {
+            ++heap[it->second].count;
+            siftDown(it->second);
+        }
+        else if (heap.size() < TOP_K)
+        {
+            heap.push_back(HeavyHitter{barcode, 1, 0});
+            heapIndex[barcode] = heap.size() - 1;
+            siftUp(heap.size() - 1);
+        }
+        else
+        {
+            heapIndex.erase(heap[0].barcode);
+            heap[0] = HeavyHitter{barcode, heap[0].count + 1, heap[0].count};
+            heapIndex[barcode] = 0;
+            siftDown(0);
+        }
+    }
+
+    /**
+     * @brief Estimate the recent activity of a barcode (never an underestimate).
+     */
+    uint64_t estimate(long long barcode) const
+    {
+        uint64_t hash = mixHash(static_cast<uint64_t>(barcode));
+        uint32_t least = UINT32_MAX;
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            least = std::min(least, counters[row * WIDTH + ((hash >> (16 * row)) & (WIDTH - 1))]);
+        }
+        return least;
+    }
+
+    /**
+     * @brief Get the most active barcodes, most active first.
+     * @param limit The most entries to return.
+     */
+    std::vector<HeavyHitter> topBarcodes(size_t limit) const
+    {
+        std::vector<HeavyHitter> result;
+        for (const HeavyHitter &entry : heap)
+        {
+            if (entry.count > 0)
+            {
+                result.push_back(entry);
+            }
+        }
+        std::sort(result.begin(), result.end(), [](const HeavyHitter &a, const HeavyHitter &b)
+                  { return a.count != b.count ? a.count > b.count : a.barcode < b.barcode; });
+        result.resize(std::min(limit, result.size()));
+        return result;
+    }
+
+    /**
+     * @brief Estimate the distinct barcodes active in each recent hour.
+     * @param now The current time.
+     * @return One (hour start, estimate) pair per hour with activity, oldest first.
+     */
+    std::vector<std::pair<std::time_t, double>> hourlyDistinct(std::time_t now) const
+    {
+        int64_t hour = static_cast<int64_t>(now) / 3600;
+        std::vector<std::pair<std::time_t, double>> result;
+        for (int64_t h = hour - static_cast<int64_t>(HOURS) + 1; h <= hour; ++h)
+        {
+            size_t slot = static_cast<size_t>(((h % static_cast<int64_t>(HOURS)) + HOURS) % HOURS);
+            if (h >= 0 && hourStamps[slot] == h)
+            {
+                result.push_back(std::make_pair(static_cast<std::time_t>(h * 3600), estimateDistinct(hours[slot])));
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief A small front cache for point lookups on skewed traffic.
+ *
+ * The table is set-associative: a key hashes to one set of WAYS entries
+ * whose tags fill a single cache line, so a probe touches one line before
+ * the record itself. With the default 256 sets the tags, frequency sketch
+ * and cached records stay within a typical L2 cache.
+ *
+ * Admission follows TinyLFU: every lookup counts the key in a count-min
+ * sketch of small saturating counters, halved every SAMPLE_FACTOR x
+ * capacity lookups so it tracks recent popularity. On a miss the new entry
+ * replaces the least frequent entry of its set only if it has been looked
+ * up more often, so a burst of one-off lookups cannot flush the hot keys.
+ *
+ * Callers must invalidate a key whenever the records it maps to change.
+ */
+template <typename Key, typename Value>
+class HotCache
+{
+public:
+    static const size_t WAYS = 8;
+
+private:
+    static const size_t DEPTH = 4;
+    static const size_t SAMPLE_FACTOR = 10;
+    static const uint8_t MAX_FREQUENCY = 15;
+
+    struct alignas(64) Set
+    {
+        uint64_t tags[WAYS]; // 0 marks an empty way
+    };
+
+    struct Slot
+    {
+        Key key;
+        Value value;
+    };
+
+    std::vector<Set> sets;
+    std::vector<Slot> slots; // WAYS per set
+    std::vector<uint8_t> frequencies; // DEPTH rows of counters
+    size_t setMask;
+    size_t frequencyMask;
+    size_t lookups;
+    size_t hits;
+    size_t misses;
+
+    static uint64_t hashKey(const Key &key)
+    {
+        if constexpr (std::is_same<Key, std::string>::value)
+        {
+            return mixHash(hashString(key)) | 1;
+        }
+        else
+        {
+            return mixHash(static_cast<uint64_t>(key)) | 1;
+        }
+    }
+
+    size_t counterIndex(uint64_t hash, size_t row) const
+    {
+        return row * (frequencyMask + 1) + ((hash >> (16 * row)) & frequencyMask);
+    }
+
+    uint8_t frequency(uint64_t hash) const
+    {
+        uint8_t least = MAX_FREQUENCY;
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            least = std::min(least, frequencies[counterIndex(hash, row)]);
+        }
+        return least;
+    }
+
+    void touch(uint64_t hash)
+    {
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            uint8_t &counter = frequencies[counterIndex(hash, row)];
+            counter += counter < MAX_FREQUENCY;
+        }
+        if (++lookups >= SAMPLE_FACTOR * slots.size())
+        {
+            for (uint8_t &counter : frequencies)
+            {
+                counter >>= 1;
+            }
+            lookups = 0;
+        }
+    }
+
+    /**
+     * @brief Find the way holding a key in its set.
+     * @return The way, or WAYS if the key is not cached.
+     */
+    size_t findWay(const Set &set, size_t setIndex, uint64_t hash, const Key &key) const
+    {
+        for (size_t way = 0; way < WAYS; ++way)
+        {
+            if (set.tags[way] == hash && slots[setIndex * WAYS + way].key == key)
+            {
+                return way;
+            }
+        }
+        return WAYS;
+    }
+
+public:
+    /**
+     * @brief Create an empty cache.
+     * @param setCount The number of sets, rounded up to a power of two.
+     */
+    explicit HotCache(size_t setCount = 256) : lookups(0), hits(0), misses(0)
+    {
+        size_t count = 1;
+        while (count < setCount)
+        {
+            count <<= 1;
+        }
+        sets.assign(count, Set());
+        slots.resize(count * WAYS);
+        setMask = count - 1;
+        frequencyMask = count * WAYS * 2 - 1; // two counters per entry and row
+        frequencies.assign(DEPTH * (frequencyMask + 1), 0);
+    }
+
+    /**
+     * @brief Look up a key and count the lookup towards its admission.
+     * @return The cached value, valid until the cache next changes, or null.
+     */
+    const Value *find(const Key &key)
+    {
+        uint64_t hash = hashKey(key);
+        touch(hash);
+        size_t setIndex = hash & setMask;
+        size_t way = findWay(sets[setIndex], setIndex, hash, key);
+        if (way == WAYS)
+        {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        return &slots[setIndex * WAYS + way].value;
+    }
+
+    /**
+     * @brief Offer the value of a key that missed; it is kept if it is
+     * looked up more often than the entry it would displace.
+     */
+    void offer(const Key &key, const Value &value)
+    {
+        uint64_t hash = hashKey(key);
+        size_t setIndex = hash & setMask;
+        Set &set = sets[setIndex];
+        size_t victim = findWay(set, setIndex, hash, key);
+        if (victim == WAYS)
+        {
+            uint8_t victimFrequency = MAX_FREQUENCY + 1;
+            for (size_t way = 0; way < WAYS && victimFrequency > 0; ++way)
+            {
+                uint8_t wayFrequency = set.tags[way] == 0 ? 0 : frequency(set.tags[way]);
+                if (wayFrequency < victimFrequency)
+                {
+                    victim = way;
+                    victimFrequency = wayFrequency;
+                }
+            }
+            if (set.tags[victim] != 0 && frequency(hash) <= victimFrequency)
+            {
+                return;
+            }
+        }
+        set.tags[victim] = hash;
+        slots[setIndex * WAYS + victim] = Slot{key, value};
+    }
+
+    /**
+     * @brief Drop a key whose records changed.
+     */
+    void invalidate(const Key &key)
+    {
+        uint64_t hash = hashKey(key);
+        size_t setIndex = hash & setMask;
+        size_t way = findWay(sets[setIndex], setIndex, hash, key);
+        if (way != WAYS)
+        {
+            sets[setIndex].tags[way] = 0;
+            slots[setIndex * WAYS + way] = Slot();
+        }
+    }
+
+    /**
+     * @brief Get the number of lookups answered from the cache.
+     */
+    size_t getHits() const
+    {
+        return hits;
+    }
+
+    /**
+     * @brief Get the number of lookups that missed.
+     */
+    size_t getMisses() const
+    {
+        return misses;
+    }
+};
+
+/**
+ * @brief A minimal perfect hash function in the style of BBHash.
+ *
+ * Keys are hashed into a bit array of GAMMA x n bits; the bits hit by
+ * exactly one key are kept and the colliding keys move on to the next,
+ * smaller level. A key's index is the number of kept bits before its own,
+ * found with a rank table sampled every 512 bits, so the n keys map
+ * one-to-one onto [0, n) with about 3 bits per key and one probe per level
+ * (most keys stop at the first). The few keys left after MAX_LEVELS go to
+ * an ordinary hash map. Keys outside the set map to an arbitrary index or
+ * NOT_FOUND, so callers check the key stored at that index.
+ */
+class PerfectHash
+{
+public:
+    static const uint32_t NOT_FOUND = UINT32_MAX;
+
+private:
+    static const int MAX_LEVELS = 24;
+    static constexpr double GAMMA = 2.0;
+
+    std::vector<uint64_t> bits;          // every level's kept bits, concatenated
+    std::vector<uint32_t> ranks;         // kept bits before each 512-bit block
+    std::vector<uint64_t> levelOffsets;  // first bit of each level
+    std::vector<uint64_t> levelSizes;    // bits in each level, a multiple of 64
+    std::unordered_map<uint64_t, uint32_t> fallback;
+
+    static uint64_t position(uint64_t key, size_t level, uint64_t size)
+    {
+        uint64_t hash = mixHash(key + 0x9E3779B97F4A7C15ULL * (level + 1));
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(hash) * size) >> 64);
+    }
+
+    uint32_t rank(uint64_t bit) const
+    {
+        size_t word = bit / 64;
+        uint32_t count = ranks[word / 8];
+        for (size_t w = word & ~size_t(7); w < word; ++w)
+        {
+            count += static_cast<uint32_t>(__builtin_popcountll(bits[w]));
+        }
+        return count + static_cast<uint32_t>(__builtin_popcountll(bits[word] & ((1ULL << (bit % 64)) - 1)));
+    }
+
+public:
+    /**
+     * @brief Build the function over a set of distinct keys.
+     * @param keys The keys; duplicates are not allowed.
+     */
+    explicit PerfectHash(std::vector<uint64_t> keys)
+    {
+        std::vector<uint64_t> hit, collided;
+        for (size_t level = 0; level < MAX_LEVELS && !keys.empty(); ++level)
+        {
+            uint64_t size = (static_cast<uint64_t>(keys.size() * GAMMA) + 63) / 64 * 64;
+            hit.assign(size / 64, 0);
+            collided.assign(size / 64, 0);
+            for (uint64_t key : keys)
+            {
+                uint64_t bit = position(key, level, size);
+                uint64_t mask = 1ULL << (bit % 64);
+                collided[bit / 64] |= hit[bit / 64] & mask;
+                hit[bit / 64] |= mask;
+            }
+            for (size_t w = 0; w < hit.size(); ++w)
+            {
+                hit[w] &= ~collided[w];
+            }
+            size_t kept = 0;
+            for (uint64_t key : keys)
+            {
+                uint64_t bit = position(key, level, size);
+                if (!(hit[bit / 64] >> (bit % 64) & 1))
+                {
+                    keys[kept++] = key;
+                }
+            }
+            keys.resize(kept);
+            levelOffsets.push_back(bits.size() * 64);
+            levelSizes.push_back(size);
+            bits.insert(bits.end(), hit.begin(), hit.end());
+        }
+        bits.resize((bits.size() + 7) / 8 * 8 + 8, 0); // whole rank blocks, plus one so rank(end) is valid
+        uint32_t total = 0;
+        for (size_t w = 0; w < bits.size(); ++w)
+        {
+            if (w % 8 == 0)
+            {
+                ranks.push_back(total);
+            }
+            total += static_cast<uint32_t>(__builtin_popcountll(bits[w]));
+        }
+        for (uint64_t key : keys)
+        {
+            fallback.emplace(key, total++);
+        }
+    }
+
+    /**
+     * @brief Map a key to its index.
+     * @return The key's index if it was in the set; otherwise any index or NOT_FOUND.
+     */
+    uint32_t lookup(uint64_t key) const
+    {
+        for (size_t level = 0; level < levelSizes.size(); ++level)
+        {
+            uint64_t bit = levelOffsets[level] + position(key, level, levelSizes[level]);
+            if (bits[bit / 64] >> (bit % 64) & 1)
+            {
+                return rank(bit);
+            }
+        }
+        auto it = fallback.find(key);
+        return it == fallback.end() ? NOT_FOUND : it->second;
+    }
+
+    /**
+     * @brief Get the memory used by the function itself, in bits.
+     */
+    size_t sizeInBits() const
+    {
+        return bits.size() * 64 + ranks.size() * 32 + fallback.size() * 96;
+    }
+};
+
+/**
+ * @brief A barcode-to-ids index split into a frozen part and a mutable overlay.
+ *
+ * The frozen part is built from the whole inventory (at snapshot time or
+ * when the overlay grows): a PerfectHash over the distinct barcodes and, by
+ * its index, each barcode and its ids, so a lookup is one probe and one key
+ * check with no collision chains. Barcodes whose ids change afterwards are
+ * kept in a small hash map overlay that is checked first. Rebuilds run on a
+ * background thread from a copy of the (barcode, id) pairs; changes made
+ * meanwhile are also recorded in a second overlay that becomes the overlay
+ * of the new frozen part when it is swapped in.
+ */
+class BarcodeDirectory
+{
+private:
+    struct Frozen
+    {
+        std::unique_ptr<PerfectHash> hash;
+        std::vector<long long> barcodes; // by perfect hash index
+        std::vector<uint32_t> offsets;   // ids of barcode i are ids[offsets[i]] .. ids[offsets[i + 1]]
+        std::vector<int> ids;
+    };
+
+    std::unique_ptr<Frozen> frozen;
+    std::unordered_map<long long, std::vector<int>> overlay; // barcodes changed since frozen was built
+    std::unordered_map<long long, std::vector<int>> recent;  // changed since the running rebuild started
+    std::future<std::unique_ptr<Frozen>> rebuilding;
+
+    static std::unique_ptr<Frozen> build(std::vector<std::pair<long long, int>> pairs)
+    {
+        std::sort(pairs.begin(), pairs.end());
+        std::vector<uint64_t> keys;
+        for (size_t i = 0; i < pairs.size(); ++i)
+        {
+            if (i == 0 || pairs[i].first != pairs[i - 1].first)
+            {
+                keys.push_back(static_cast<uint64_t>(pairs[i].first));
+            }
+        }
+        std::unique_ptr<Frozen> result(new Frozen());
+        result->hash.reset(new PerfectHash(keys));
+        result->barcodes.assign(keys.size(), 0);
+        std::vector<uint32_t> counts(keys.size() + 1, 0);
+        for (const auto &pair : pairs)
+        {
+            uint32_t index = result->hash->lookup(static_cast<uint64_t>(pair.first));
+            result->barcodes[index] = pair.first;
+            ++counts[index + 1];
+        }
+        for (size_t i = 1; i < counts.size(); ++i)
+        {
+            counts[i] += counts[i - 1];
+        }
+        result->offsets = counts;
+        result->ids.resize(pairs.size());
+        for (const auto &pair : pairs) // pairs are sorted, so each barcode's ids stay in id order
+        {
+            result->ids[counts[result->hash->lookup(static_cast<uint64_t>(pair.first))]++] = pair.second;
+        }
+        return result;
+    }
+
+    std::vector<int> frozenIds(long long barcode) const
+    {
+        if (!frozen)
+        {
+            return std::vector<int>();
+        }
+        uint32_t index = frozen->hash->lookup(static_cast<uint64_t>(barcode));
+        if (index >= frozen->barcodes.size() || frozen->barcodes[index] != barcode)
+        {
+            return std::vector<int>();
+        }
+        return std::vector<int>(frozen->ids.begin() + frozen->offsets[index], frozen->ids.begin() + frozen->offsets[index + 1]);
+    }
+
+    void finishRebuild()
+    {
+        if (rebuilding.valid() && rebuilding.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            frozen = rebuilding.get();
+            overlay.swap(recent);
+            recent.clear();
+        }
+    }
+
+    void change(long long barcode, int removeId, int addId)
+    {
+        auto it = overlay.find(barcode);
+        if (it == overlay.end())
+        {
+            it = overlay.emplace(barcode, frozenIds(barcode)).first;
+        }
+        std::vector<int> &ids = it->second;
+        if (removeId >= 0)
+        {
+            ids.erase(std::remove(ids.begin(), ids.end(), removeId), ids.end());
+        }
+        if (addId >= 0)
+        {
+            ids.insert(std::lower_bound(ids.begin(), ids.end(), addId), addId);
+        }
+        if (rebuilding.valid())
+        {
+            recent[barcode] = ids;
+        }
+    }
+
+public:
+    ~BarcodeDirectory()
+    {
+        if (rebuilding.valid())
+        {
+            rebuilding.wait();
+        }
+    }
+
+    /**
+     * @brief Start rebuilding the frozen part from a store in the background.
+     *
+     * The store is read now; the perfect hash is built on another thread
+     * and swapped in by a later call once it is ready. Does nothing if a
+     * rebuild is already running.
+     *
+     * @param store The store to index.
+     */
+    void rebuild(const BeerStore &store)
+    {
+        finishRebuild();
+        if (rebuilding.valid())
+        {
+            return;
+        }
+        std::vector<std::pair<long long, int>> pairs;
+        pairs.reserve(store.size());
+        store.forEach([&pairs](const Beer &beer)
+                      { pairs.push_back(std::make_pair(beer.getBarcode().getValue(), beer.getId())); });
+        recent.clear();
+        rebuilding = std::async(std::launch::async, &BarcodeDirectory::build, std::move(pairs));
+    }
+
+    /**
+     * @brief Wait for a running rebuild and swap it in.
+     */
+    void waitForRebuild()
+    {
+        if (rebuilding.valid())
+        {
+            rebuilding.wait();
+            finishRebuild();
+        }
+    }
+
+    /**
+     * @brief Check whether the overlay has grown enough to be worth a rebuild.
+     */
+    bool needsRebuild() const
+    {
+        return !rebuilding.valid() && overlay.size() > std::max<size_t>(1024, frozen ? frozen->barcodes.size() / 8 : 0);
+    }
+
+    /**
+     * @brief Reflect a change to the inventory.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        finishRebuild();
+        if (before && after && before->getBarcode().getValue() == after->getBarcode().getValue())
+        {
+            return; // quantities and other fields are not indexed
+        }
+        if (before)
+        {
+            change(before->getBarcode().getValue(), before->getId(), -1);
+        }
+        if (after)
+        {
+            change(after->getBarcode().getValue(), -1, after->getId());
+        }
+    }
+
+    /**
+     * @brief Get the ids of the beers with a barcode.
+     * @param barcode The barcode to look up.
+     * @return The ids in ascending order.
+     */
+    std::vector<int> find(long long barcode)
+    {
+        finishRebuild();
+        auto it = overlay.find(barcode);
+        return it != overlay.end() ? it->second : frozenIds(barcode);
+    }
+
+    /**
+     * @brief Describe the index: barcodes frozen, bits per barcode and overlay size.
+     */
+    std::string describe() const
+    {
+        if (!frozen)
+        {
+            return "perfect hash pending, " + std::to_string(overlay.size()) + " barcodes in the overlay";
+        }
+        size_t count = frozen->barcodes.size();
+        char bits[32];
+        char *bitsEnd = std::to_chars(bits, bits + sizeof(bits), count ? static_cast<double>(frozen->hash->sizeInBits()) / count : 0.0,
+                                      std::chars_format::fixed, 2).ptr;
+        return std::to_string(count) + " barcodes in the perfect hash (" + std::string(bits, bitsEnd) + " bits each), " +
+               std::to_string(overlay.size()) + " in the overlay" + (rebuilding.valid() ? ", rebuilding" : "");
+    }
+};
+
+/**
+ * @brief A blocked Bloom filter for fast negative existence checks.
+ *
+ * Each key sets one bit in each of the eight 64-bit words of a single
+ * 64-byte block, so an insert or probe touches one cache line. The probe
+ * checks the whole block against the key's mask with a few SIMD operations
+ * where available. The filter is sized for BITS_PER_KEY bits per expected
+ * key (a false-positive rate well under 1%); past that it still works but
+ * answers "maybe" more often, so the owner rebuilds it larger.
+ */
+class BlockedBloomFilter
+{
+private:
+    static const size_t BITS_PER_KEY = 16;
+
+    struct alignas(64) Block
+    {
+        uint64_t words[8];
+    };
+
+    std::vector<Block> blocks;
+    size_t keys;
+    size_t capacity;
+
+    size_t blockOf(uint64_t hash) const
+    {
+        return static_cast<size_t>((static_cast<unsigned __int128>(hash) * blocks.size()) >> 64);
+    }
+
+    static Block maskOf(uint64_t hash)
+    {
+        uint64_t bits = mixHash(hash ^ 0x5851F42D4C957F2DULL);
+        Block mask;
+        for (int i = 0; i < 8; ++i)
+        {
+            mask.words[i] = 1ULL << ((bits >> (6 * i)) & 63);
+        }
+        return mask;
+    }
+
+public:
+    /**
+     * @brief Create an empty filter.
+     * @param expectedKeys The number of keys the filter is sized for.
+     */
+    explicit BlockedBloomFilter(size_t expectedKeys = 0) : keys(0), capacity(std::max<size_t>(expectedKeys, 1024))
+    {
+        blocks.assign((capacity * BITS_PER_KEY + 511) / 512, Block());
+    }
+
+    /**
+     * @brief Add a key, given as a well-mixed 64-bit hash.
+     */
+    void insert(uint64_t hash)
+    {
+        Block &block = blocks[blockOf(hash)];
+        Block mask = maskOf(hash);
+        for (int i = 0; i < 8; ++i)
+        {
+            block.words[i] |= mask.words[i];
+        }
+        ++keys;
+    }
+
+    /**
+     * @brief Check whether a key may have been added.
+     * @return False only if the key was certainly never added.
+     */
+    bool mayContain(uint64_t hash) const
+    {
+        const Block &block = blocks[blockOf(hash)];
+        Block mask = maskOf(hash);
+#if defined(__SSE2__)
+        __m128i missing = _mm_setzero_si128();
+        for (int i = 0; i < 8; i += 2)
+        {
+            __m128i want = _mm_load_si128(reinterpret_cast<const __m128i *>(&mask.words[i]));
+            __m128i have = _mm_load_si128(reinterpret_cast<const __m128i *>(&block.words[i]));
+            missing = _mm_or_si128(missing, _mm_andnot_si128(have, want));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(__aarch64__)
+        uint64x2_t missing = vdupq_n_u64(0);
+        for (int i = 0; i < 8; i += 2)
+        {
+            missing = vorrq_u64(missing, vbicq_u64(vld1q_u64(&mask.words[i]), vld1q_u64(&block.words[i])));
+        }
+        return (vgetq_lane_u64(missing, 0) | vgetq_lane_u64(missing, 1)) == 0;
+#else
+        uint64_t missing = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            missing |= mask.words[i] & ~block.words[i];
+        }
+        return missing == 0;
+#endif
+    }
+
+    /**
+     * @brief Check whether more keys were added than the filter was sized for.
+     */
+    bool isSaturated() const
+    {
+        return keys > capacity;
+    }
+
+    /**
+     * @brief Get the number of keys added.
+     */
+    size_t size() const
+    {
+        return keys;
+    }
+};
+
+/**
+ * @brief An ordered adaptive radix tree over barcodes with subtree totals.
+ *
+ * Barcodes are keyed by their eight big-endian bytes, so the tree's order
+ * is numeric order. Inner nodes grow and shrink between four layouts (4,
+ * 16, 48 and 256 children) with their child count, and single-child paths
+ * are compressed into a node prefix, so the tree stays shallow and compact
+ * however the barcodes are distributed. Every node also keeps the number of
+ * beers and bottles below it: a range total adds up whole subtrees and only
+ * descends along the two range boundaries, instead of visiting every barcode
+ * in the range.
+ *
+ * A GS1 company prefix (the leading digits of a 12-digit UPC) is a range of
+ * barcodes; see prefixRange.
+ */
+class BarcodeRadixTree
+{
+public:
+    struct Totals
+    {
+        int64_t beers = 0;
+        int64_t bottles = 0;
+    };
+
+private:
+    enum Kind : uint8_t
+    {
+        LEAF,
+        NODE4,
+        NODE16,
+        NODE48,
+        NODE256
+    };
+
+    struct Node
+    {
+        Kind kind;
+        uint8_t prefixLength = 0; // inner nodes: bytes compressed below the parent's byte
+        uint8_t prefix[8] = {};
+        uint16_t count = 0; // inner nodes: children
+        Totals totals;
+
+        explicit Node(Kind kind) : kind(kind) {}
+        virtual ~Node() {}
+    };
+
+    struct Leaf : Node
+    {
+        uint64_t key;
+        std::vector<std::pair<int, int>> beers; // (id, quantity), by id
+
+        explicit Leaf(uint64_t key) : Node(LEAF), key(key) {}
+    };
+
+    struct Node4 : Node
+    {
+        uint8_t keys[4];
+        std::unique_ptr<Node> children[4];
+
+        Node4() : Node(NODE4) {}
+    };
+
+    struct Node16 : Node
+    {
+        uint8_t keys[16];
+        std::unique_ptr<Node> children[16];
+
+        Node16() : Node(NODE16) {}
+    };
+
+    struct Node48 : Node
+    {
+        uint8_t index[256] = {}; // child slot + 1, or 0
+        std::unique_ptr<Node> children[48];
+
+        Node48() : Node(NODE48) {}
+    };
+
+    struct Node256 : Node
+    {
+        std::unique_ptr<Node> children[256];
+
+        Node256() : Node(NODE256) {}
+    };
+
+    std::unique_ptr<Node> root;
+
+    static uint8_t byteAt(uint64_t key, size_t depth)
+    {
+        return static_cast<uint8_t>(key >> (56 - 8 * depth));
+    }
+
+    /**
+     * @brief Get the smallest and largest keys that agree with key on the first depth bytes.
+     */
+    static void span(uint64_t key, size_t depth, uint64_t &low, uint64_t &high)
+    {
+        uint64_t free = depth >= 8 ? 0 : (depth == 0 ? ~0ULL : (1ULL << (64 - 8 * depth)) - 1);
+        low = key & ~free;
+        high = key | free;
+    }
+
+    static void addTotals(Totals &totals, int64_t beers, int64_t bottles)
+    {
+        totals.beers += beers;
+        totals.bottles += bottles;
+    }
+
+    static std::unique_ptr<Node> *findChild(Node *node, uint8_t byte)
+    {
+        switch (node->kind)
+        {
+        case NODE4:
+        {
+            Node4 *n = static_cast<Node4 *>(node);
+            for (int i = 0; i < n->count; ++i)
+            {
+                if (n->keys[i] == byte)
+                {
+                    return &n->children[i];
+                }
+            }
+            return nullptr;
+        }
+        case NODE16:
+        {
+            Node16 *n = static_cast<Node16 *>(node);
+#if defined(__SSE2__)
+            __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(n->keys)));
+            int bits = _mm_movemask_epi8(matches) & ((1 << n->count) - 1);
+            return bits ? &n->children[__builtin_ctz(bits)] : nullptr;
+#else
+            for (int i = 0; i < n->count; ++i)
+            {
+                if (n->keys[i] == byte)
+                {
+                    return &n->children[i];
+                }
+            }
+            return nullptr;
+#endif
+        }
+        case NODE48:
+        {
+            Node48 *n = static_cast<Node48 *>(node);
+            return n->index[byte] ? &n->children[n->index[byte] - 1] : nullptr;
+        }
+        case NODE256:
+        {
+            Node256 *n = static_cast<Node256 *>(node);
+            return n->children[byte] ? &n->children[byte] : nullptr;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    /**
+     * @brief Visit the children of an inner node in byte order.
+     */
+    static void forEachChild(Node *node, const std::function<void(uint8_t, Node *)> &visitor)
+    {
+        switch (node->kind)
+        {
+        case NODE4:
+        {
+            Node4 *n = static_cast<Node4 *>(node);
+            for (int i = 0; i < n->count; ++i)
+            {
+                visitor(n->keys[i], n->children[i].get());
+            }
+            break;
+        }
+        case NODE16:
+        {
+            Node16 *n = static_cast<Node16 *>(node);
+            for (int i = 0; i < n->count; ++i)
+            {
+                visitor(n->keys[i], n->children[i].get());
+            }
+            break;
+        }
+        case NODE48:
+        {
+            Node48 *n = static_cast<Node48 *>(node);
+            for (int byte = 0; byte < 256; ++byte)
+            {
+                if (n->index[byte])
+                {
+                    visitor(static_cast<uint8_t>(byte), n->children[n->index[byte] - 1].get());
+                }
+            }
+            break;
+        }
+        case NODE256:
+        {
+            Node256 *n = static_cast<Node256 *>(node);
+            for (int byte = 0; byte < 256; ++byte)
+            {
+                if (n->children[byte])
+                {
+                    visitor(static_cast<uint8_t>(byte), n->children[byte].get());
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    static void copyHeader(const Node *from, Node *to)
+    {
+        to->prefixLength = from->prefixLength;
+        std::memcpy(to->prefix, from->prefix, sizeof(from->prefix));
+        to->totals = from->totals;
+    }
+
+    /**
+     * @brief Move every child of an inner node into a node of another layout.
+     */
+    static std::unique_ptr<Node> relayout(std::unique_ptr<Node> node, Kind kind)
+    {
+        std::unique_ptr<Node> result;
+        switch (kind)
+        {
+        case NODE4:
+            result.reset(new Node4());
+            break;
+        case NODE16:
+            result.reset(new Node16());
+            break;
+        case NODE48:
+            result.reset(new Node48());
+            break;
+        default:
+            result.reset(new Node256());
+            break;
+        }
+        copyHeader(node.get(), result.get());
+        std::vector<std::pair<uint8_t, Node *>> children;
+        forEachChild(node.get(), [&children](uint8_t byte, Node *child)
+                     { children.push_back(std::make_pair(byte, child)); });
+        for (const auto &child : children)
+        {
+            std::unique_ptr<Node> *slot = findChild(node.get(), child.first);
+            insertChild(result.get(), child.first, std::move(*slot));
+        }
+        return result;
+    }
+
+    static size_t capacity(Kind kind)
+    {
+        return kind == NODE4 ? 4 : kind == NODE16 ? 16 : kind == NODE48 ? 48 : 256;
+    }
+
+    /**
+     * @brief Add a child to an inner node that has room for it.
+     */
+    static void insertChild(Node *node, uint8_t byte, std::unique_ptr<Node> child)
+    {
+        switch (node->kind)
+        {
+        case NODE4:
+        case NODE16:
+        {
+            uint8_t *keys = node->kind == NODE4 ? static_cast<Node4 *>(node)->keys : static_cast<Node16 *>(node)->keys;
+            std::unique_ptr<Node> *children = node->kind == NODE4 ? static_cast<Node4 *>(node)->children : static_cast<Node16 *>(node)->children;
+            int position = node->count;
+            while (position > 0 && keys[position - 1] > byte)
+            {
+                keys[position] = keys[position - 1];
+                children[position] = std::move(children[position - 1]);
+                --position;
+            }
+            keys[position] = byte;
+            children[position] = std::move(child);
+            break;
+        }
+        case NODE48:
+        {
+            Node48 *n = static_cast<Node48 *>(node);
+            int slot = 0;
+            while (n->children[slot])
+            {
+                ++slot;
+            }
+            n->children[slot] = std::move(child);
+            n->index[byte] = static_cast<uint8_t>(slot + 1);
+            break;
+        }
+        default:
+            static_cast<Node256 *>(node)->children[byte] = std::move(child);
+            break;
+        }
+        ++node->count;
+    }
+
+    static void addChild(std::unique_ptr<Node> &ref, uint8_t byte, std::unique_ptr<Node> child)
+    {
+        if (ref->count == capacity(ref->kind))
+        {
+            Kind larger = static_cast<Kind>(ref->kind + 1);
+            ref = relayout(std::move(ref), larger);
+        }
+        insertChild(ref.get(), byte, std::move(child));
+    }
+
+    static void removeChild(std::unique_ptr<Node> &ref, uint8_t byte)
+    {
+        Node *node = ref.get();
+        switch (node->kind)
+        {
+        case NODE4:
+        case NODE16:
+        {
+            uint8_t *keys = node->kind == NODE4 ? static_cast<Node4 *>(node)->keys : static_cast<Node16 *>(node)->keys;
+            std::unique_ptr<Node> *children = node->kind == NODE4 ? static_cast<Node4 *>(node)->children : static_cast<Node16 *>(node)->children;
+            int position = 0;
+            while (keys[position] != byte)
+            {
+                ++position;
+            }
+            for (; position + 1 < node->count; ++position)
+            {
+                keys[position] = keys[position + 1];
+                children[position] = std::move(children[position + 1]);
+            }
+            children[position].reset();
+            break;
+        }
+        case NODE48:
+        {
+            Node48 *n = static_cast<Node48 *>(node);
+            n->children[n->index[byte] - 1].reset();
+            n->index[byte] = 0;
+            break;
+        }
+        default:
+            static_cast<Node256 *>(node)->children[byte].reset();
+            break;
+        }
+        --node->count;
+
+        if (node->kind == NODE4 && node->count == 1)
+        {
+            // Merge the single remaining child into this node's place.
+            Node4 *n = static_cast<Node4 *>(node);
+            std::unique_ptr<Node> child = std::move(n->children[0]);
+            if (child->kind != LEAF)
+            {
+                uint8_t prefix[8];
+                size_t length = 0;
+                for (size_t i = 0; i < n->prefixLength; ++i)
+                {
+                    prefix[length++] = n->prefix[i];
+                }
+                prefix[length++] = n->keys[0];
+                for (size_t i = 0; i < child->prefixLength; ++i)
+                {
+                    prefix[length++] = child->prefix[i];
+                }
+                std::memcpy(child->prefix, prefix, length);
+                child->prefixLength = static_cast<uint8_t>(length);
+            }
+            ref = std::move(child);
+        }
+        else if ((node->kind == NODE16 && node->count == 3) || (node->kind == NODE48 && node->count == 12) ||
+                 (node->kind == NODE256 && node->count == 37))
+        {
+            Kind smaller = static_cast<Kind>(node->kind - 1);
+            ref = relayout(std::move(ref), smaller);
+        }
+    }
+
+    void insert(std::unique_ptr<Node> &ref, uint64_t key, size_t depth, int id, int quantity)
+    {
+        if (!ref)
+        {
+            Leaf *leaf = new Leaf(key);
+            leaf->beers.push_back(std::make_pair(id, quantity));
+            leaf->totals = Totals{1, quantity};
+            ref.reset(leaf);
+            return;
+        }
+        Node *node = ref.get();
+        if (node->kind == LEAF)
+        {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            if (leaf->key == key)
+            {
+                auto position = std::lower_bound(leaf->beers.begin(), leaf->beers.end(), std::make_pair(id, INT_MIN));
+                leaf->beers.insert(position, std::make_pair(id, quantity));
+                addTotals(leaf->totals, 1, quantity);
+                return;
+            }
+            std::unique_ptr<Node> split(new Node4());
+            while (byteAt(leaf->key, depth + split->prefixLength) == byteAt(key, depth + split->prefixLength))
+            {
+                split->prefix[split->prefixLength] = byteAt(key, depth + split->prefixLength);
+                ++split->prefixLength;
+            }
+            size_t at = depth + split->prefixLength;
+            split->totals = leaf->totals;
+            uint8_t oldByte = byteAt(leaf->key, at);
+            insertChild(split.get(), oldByte, std::move(ref));
+            std::unique_ptr<Node> fresh;
+            insert(fresh, key, at + 1, id, quantity);
+            addTotals(split->totals, 1, quantity);
+            insertChild(split.get(), byteAt(key, at), std::move(fresh));
+            ref = std::move(split);
+            return;
+        }
+        size_t matched = 0;
+        while (matched < node->prefixLength && node->prefix[matched] == byteAt(key, depth + matched))
+        {
+            ++matched;
+        }
+        if (matched < node->prefixLength)
+        {
+            std::unique_ptr<Node> split(new Node4());
+            split->prefixLength = static_cast<uint8_t>(matched);
+            std::memcpy(split->prefix, node->prefix, matched);
+            split->totals = node->totals;
+            uint8_t oldByte = node->prefix[matched];
+            node->prefixLength = static_cast<uint8_t>(node->prefixLength - matched - 1);
+            std::memmove(node->prefix, node->prefix + matched + 1, node->prefixLength);
+            insertChild(split.get(), oldByte, std::move(ref));
+            std::unique_ptr<Node> fresh;
+            insert(fresh, key, depth + matched + 1, id, quantity);
+            addTotals(split->totals, 1, quantity);
+            insertChild(split.get(), byteAt(key, depth + matched), std::move(fresh));
+            ref = std::move(split);
+            return;
+        }
+        addTotals(node->totals, 1, quantity);
+        depth += node->prefixLength;
+        std::unique_ptr<Node> *child = findChild(node, byteAt(key, depth));
+        if (child)
+        {
+            insert(*child, key, depth + 1, id, quantity);
+            return;
+        }
+        std::unique_ptr<Node> fresh;
+        insert(fresh, key, depth + 1, id, quantity);
+        addChild(ref, byteAt(key, depth), std::move(fresh));
+    }
+
+    /**
+     * @return True if the beer was found and removed.
+     */
+    bool remove(std::unique_ptr<Node> &ref, uint64_t key, size_t depth, int id, int quantity)
+    {
+        Node *node = ref.get();
+        if (!node)
+        {
+            return false;
+        }
+        if (node->kind == LEAF)
+        {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            auto position = std::lower_bound(leaf->beers.begin(), leaf->beers.end(), std::make_pair(id, INT_MIN));
+            if (leaf->key != key || position == leaf->beers.end() || position->first != id)
+            {
+                return false;
+            }
+            leaf->beers.erase(position);
+            addTotals(leaf->totals, -1, -quantity);
+            return true;
+        }
+        for (size_t i = 0; i < node->prefixLength; ++i)
+        {
+            if (node->prefix[i] != byteAt(key, depth + i))
+            {
+                return false;
+            }
+        }
+        depth += node->prefixLength;
+        uint8_t byte = byteAt(key, depth);
+        std::unique_ptr<Node> *child = findChild(node, byte);
+        if (!child || !remove(*child, key, depth + 1, id, quantity))
+        {
+            return false;
+        }
+        addTotals(node->totals, -1, -quantity);
+        if ((*child)->kind == LEAF && static_cast<Leaf *>(child->get())->beers.empty())
+        {
+            removeChild(ref, byte);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Walk the part of a subtree inside [low, high].
+     * @param path The key bytes fixed above the node (the first depth bytes).
+     * @param whole Called for subtrees entirely inside the range; may return
+     * false to descend into them anyway.
+     * @param leafVisitor Called for each leaf inside the range, in order.
+     */
+    static void walk(Node *node, uint64_t path, size_t depth, uint64_t low, uint64_t high,
+                     const std::function<bool(Node *)> &whole, const std::function<void(const Leaf &)> &leafVisitor)
+    {
+        if (node->kind == LEAF)
+        {
+            const Leaf *leaf = static_cast<const Leaf *>(node);
+            if (leaf->key >= low && leaf->key <= high)
+            {
+                leafVisitor(*leaf);
+            }
+            return;
+        }
+        for (size_t i = 0; i < node->prefixLength; ++i)
+        {
+            path |= static_cast<uint64_t>(node->prefix[i]) << (56 - 8 * (depth + i));
+        }
+        depth += node->prefixLength;
+        uint64_t nodeLow, nodeHigh;
+        span(path, depth, nodeLow, nodeHigh);
+        if (nodeHigh < low || nodeLow > high)
+        {
+            return;
+        }
+        if (nodeLow >= low && nodeHigh <= high && whole(node))
+        {
+            return;
+        }
+        forEachChild(node, [&](uint8_t byte, Node *child)
+                     { walk(child, path | (static_cast<uint64_t>(byte) << (56 - 8 * depth)), depth + 1, low, high, whole, leafVisitor); });
+    }
+
+public:
+    /**
+     * @brief Reflect a change to the inventory.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before)
+        {
+            remove(root, static_cast<uint64_t>(before->getBarcode().getValue()), 0, before->getId(), before->getQuantity());
+            if (root && root->kind == LEAF && static_cast<Leaf *>(root.get())->beers.empty())
+            {
+                root.reset();
+            }
+        }
+        if (after)
+        {
+            insert(root, static_cast<uint64_t>(after->getBarcode().getValue()), 0, after->getId(), after->getQuantity());
+        }
+    }
+
+    /**
+     * @brief Visit the barcodes in [low, high] in ascending order.
+     * @param visitor Called with each barcode and the (id, quantity) of its beers.
+     */
+    void scan(uint64_t low, uint64_t high, const std::function<void(uint64_t, const std::vector<std::pair<int, int>> &)> &visitor) const
+    {
+        if (root)
+        {
+            walk(root.get(), 0, 0, low, high, [](Node *)
+                 { return false; }, [&visitor](const Leaf &leaf)
+                 { visitor(leaf.key, leaf.beers); });
+        }
+    }
+
+    /**
+     * @brief Count the beers and bottles with barcodes in [low, high].
+     */
+    Totals total(uint64_t low, uint64_t high) const
+    {
+        Totals result;
+        if (root)
+        {
+            walk(root.get(), 0, 0, low, high, [&result](Node *node)
+                 {
+                     addTotals(result, node->totals.beers, node->totals.bottles);
+                     return true; }, [&result](const Leaf &leaf)
+                 { addTotals(result, leaf.totals.beers, leaf.totals.bottles); });
+        }
+        return result;
+    }
+
+    /**
+     * @brief Get the barcode range that starts with the given digits of a 12-digit UPC.
+     * @param digits One to twelve decimal digits, e.g. a GS1 company prefix.
+     * @param low Receives the first barcode of the range.
+     * @param high Receives the last barcode of the range.
+     * @return False if digits is not one to twelve decimal digits.
+     */
+    static bool prefixRange(const std::string &digits, uint64_t &low, uint64_t &high)
+    {
+        if (digits.empty() || digits.size() > 12 || !std::all_of(digits.begin(), digits.end(), ::isdigit))
+        {
+            return false;
+        }
+        uint64_t scale = 1;
+        for (size_t i = digits.size(); i < 12; ++i)
+        {
+            scale *= 10;
+        }
+        low = std::stoull(digits) * scale;
+        high = low + scale - 1;
+        return true;
+    }
+};
+
+/**
+ * @brief An ordered index of beers by the time they were last updated.
+ *
+ * Beer keeps its updated date as "YYYY-MM-DD HH:MM:SS" local time. The
+ * index keys each id by that date as seconds on a plain calendar (no time
+ * zone or daylight saving, so equal strings give equal keys), which keeps
+ * "changed since", "untouched for" and "most recent" queries to a seek and
+ * a walk over the rows they return.
+ */
+class UpdateTimeline
+{
+private:
+    std::set<std::pair<int64_t, int>> order; // (stamp, id)
+    std::unordered_map<int, int64_t> stamps; // id -> stamp
+
+    static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+    {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+        unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+    }
+
+public:
+    /**
+     * @brief Convert a date to the index's key.
+     * @param date "YYYY-MM-DD" or "YYYY-MM-DD HH:MM:SS".
+     * @return Seconds since 1970-01-01 00:00:00 on the calendar, or nothing if the date is malformed.
+     */
+    static std::optional<int64_t> parseStamp(const std::string &date)
+    {
+        int fields[6] = {0, 1, 1, 0, 0, 0};
+        static const size_t offsets[6] = {0, 5, 8, 11, 14, 17};
+        static const size_t widths[6] = {4, 2, 2, 2, 2, 2};
+        static const char separators[6] = {0, '-', '-', ' ', ':', ':'};
+        size_t count = date.size() == 10 ? 3 : date.size() == 19 ? 6 : 0;
+        if (count == 0)
+        {
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            const char *begin = date.data() + offsets[i];
+            if ((i > 0 && date[offsets[i] - 1] != separators[i]) || !std::isdigit(static_cast<unsigned char>(*begin)) ||
+                std::from_chars(begin, begin + widths[i], fields[i]).ptr != begin + widths[i])
+            {
+                return std::nullopt;
+            }
+        }
+        if (fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31 || fields[3] > 23 || fields[4] > 59 || fields[5] > 60)
+        {
+            return std::nullopt;
+        }
+        return daysFromCivil(fields[0], static_cast<unsigned>(fields[1]), static_cast<unsigned>(fields[2])) * 86400 +
+               fields[3] * 3600 + fields[4] * 60 + fields[5];
+    }
+
+    /**
+     * @brief Convert a point in time to the index's key, as Beer::updateDate would record it.
+     */
+    static int64_t localStamp(std::time_t time)
+    {
+        std::tm local = *std::localtime(&time);
+        return daysFromCivil(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1), static_cast<unsigned>(local.tm_mday)) * 86400 +
+               local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    }
+
+    /**
+     * @brief Reflect a change to the inventory.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before)
+        {
+            auto it = stamps.find(before->getId());
+            if (it != stamps.end())
+            {
+                order.erase(std::make_pair(it->second, it->first));
+                stamps.erase(it);
+            }
+        }
+        if (after)
+        {
+            // Beers without a readable date sort as the oldest.
+            int64_t stamp = parseStamp(after->getUpdatedDate()).value_or(INT64_MIN);
+            stamps[after->getId()] = stamp;
+            order.insert(std::make_pair(stamp, after->getId()));
+        }
+    }
+
+    /**
+     * @brief Visit the beers updated at or after a time, oldest first.
+     * @param stamp The time, as a key from parseStamp or localStamp.
+     * @param visitor Called with each id; returning false stops the walk.
+     */
+    void since(int64_t stamp, const std::function<bool(int)> &visitor) const
+    {
+        for (auto it = order.lower_bound(std::make_pair(stamp, INT_MIN)); it != order.end() && visitor(it->second); ++it)
+        {
+        }
+    }
+
+    /**
+     * @brief Visit the beers last updated before a time, oldest first.
+     * @param stamp The time, as a key from parseStamp or localStamp.
+     * @param visitor Called with each id; returning false stops the walk.
+     */
+    void before(int64_t stamp, const std::function<bool(int)> &visitor) const
+    {
+        auto end = order.lower_bound(std::make_pair(stamp, INT_MIN));
+        for (auto it = order.begin(); it != end && visitor(it->second); ++it)
+        {
+        }
+    }
+
+    /**
+     * @brief Visit the most recently updated beers, newest first.
+     * @param visitor Called with each id; returning false stops the walk.
+     */
+    void latest(const std::function<bool(int)> &visitor) const
+    {
+        for (auto it = order.rbegin(); it != order.rend() && visitor(it->second); ++it)
+        {
+        }
+    }
+};
+
+/**
+ * @brief The dated lots each beer's bottles were received in.
+ *
+ * Every lot of a beer is keyed by its best-before day and the order it was
+ * received in. Each beer keeps its keys in a min-heap, so the lot to sell
+ * first is always on top and consuming a lot costs O(log lots). All lots
+ * also sit in one map ordered by expiry, which answers "what expires in
+ * the next two weeks" with a seek and a walk over just those lots.
+ *
+ * A beer's quantity can exceed the bottles in its lots: stock added
+ * without a lot (or before lots were kept) is untracked, and is sold
+ * only once the lots run out.
+ */
+class LotLedger
+{
+public:
+    struct Lot
+    {
+        int id;             // the beer
+        int32_t received;   // days since 1970-01-01
+        int32_t bestBefore; // days since 1970-01-01
+        int quantity;
+    };
+
+private:
+    typedef std::pair<int32_t, uint64_t> Key; // (best-before day, receipt sequence)
+
+    std::map<Key, Lot> byExpiry;
+    std::unordered_map<int, std::vector<Key>> heaps; // id -> min-heap of its lots
+    uint64_t nextSequence = 0;
+
+public:
+    /**
+     * @brief Convert a "YYYY-MM-DD" date to a day number.
+     * @return The days since 1970-01-01, or nothing if the date is malformed.
+     */
+    static std::optional<int32_t> parseDay(const std::string &date)
+    {
+        if (date.size() != 10)
+        {
+            return std::nullopt;
+        }
+        std::optional<int64_t> stamp = UpdateTimeline::parseStamp(date);
+        return stamp ? std::optional<int32_t>(static_cast<int32_t>(*stamp / 86400)) : std::nullopt;
+    }
+
+    /**
+     * @brief Get today's day number in local time.
+     */
+    static int32_t today()
+    {
+        return static_cast<int32_t>(UpdateTimeline::localStamp(std::time(nullptr)) / 86400);
+    }
+
+    /**
+     * @brief Format a day number as "YYYY-MM-DD".
+     */
+    static std::string formatDay(int32_t day)
+    {
+        int64_t z = static_cast<int64_t>(day) + 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        unsigned dayOfEra = static_cast<unsigned>(z - era * 146097);
+        unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        unsigned shifted = (5 * dayOfYear + 2) / 153;
+        unsigned dayOfMonth = dayOfYear - (153 * shifted + 2) / 5 + 1;
+        unsigned month = shifted < 10 ? shifted + 3 : shifted - 9;
+        int64_t year = static_cast<int64_t>(yearOfEra) + era * 400 + (month <= 2);
+        return std::to_string(year) + (month < 10 ? "-0" : "-") + std::to_string(month) + (dayOfMonth < 10 ? "-0" : "-") +
+               std::to_string(dayOfMonth);
+    }
+
+    /**
+     * @brief Record a lot of a beer. The beer's quantity is the caller's to raise.
+     * @param lot The lot; lots with no bottles are ignored.
+     */
+    void receive(const Lot &lot)
+    {
+        if (lot.quantity <= 0)
+        {
+            return;
+        }
+        Key key(lot.bestBefore, nextSequence++);
+        byExpiry.emplace(key, lot);
+        std::vector<Key> &heap = heaps[lot.id];
+        heap.push_back(key);
+        std::push_heap(heap.begin(), heap.end(), std::greater<Key>());
+    }
+
+    /**
+     * @brief Take bottles from a beer's lots, soonest best-before first.
+     * @param id The beer.
+     * @param bottles The number of bottles sold or written off.
+     * @return The bottles taken from lots; the rest came from untracked stock.
+     */
+    int consume(int id, int bottles)
+    {
+        auto found = heaps.find(id);
+        if (found == heaps.end())
+        {
+            return 0;
+        }
+        std::vector<Key> &heap = found->second;
+        int taken = 0;
+        while (taken < bottles && !heap.empty())
+        {
+            auto lot = byExpiry.find(heap.front());
+            int used = std::min(bottles - taken, lot->second.quantity);
+            taken += used;
+            lot->second.quantity -= used;
+            if (lot->second.quantity == 0)
+            {
+                byExpiry.erase(lot);
+                std::pop_heap(heap.begin(), heap.end(), std::greater<Key>());
+                heap.pop_back();
+            }
+        }
+        if (heap.empty())
+        {
+            heaps.erase(found);
+        }
+        return taken;
+    }
+
+    /**
+     * @brief Forget every lot of a beer, as when it is removed.
+     */
+    void drop(int id)
+    {
+        auto found = heaps.find(id);
+        if (found == heaps.end())
+        {
+            return;
+        }
+        for (const Key &key : found->second)
+        {
+            byExpiry.erase(key);
+        }
+        heaps.erase(found);
+    }
+
+    /**
+     * @brief Reflect a change to the inventory: a lower quantity consumes lots,
+     * and a removed beer loses them.
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void apply(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before && !after)
+        {
+            drop(before->getId());
+        }
+        else if (before && after->getQuantity() < before->getQuantity())
+        {
+            consume(before->getId(), before->getQuantity() - after->getQuantity());
+        }
+    }
+
+    /**
+     * @brief Visit the lots whose best-before day is before a day, soonest first.
+     * @param day The first day not visited.
+     * @param visitor Called with each lot.
+     */
+    void expiringBefore(int32_t day, const std::function<void(const Lot &)> &visitor) const
+    {
+        auto end = byExpiry.lower_bound(Key(day, 0));
+        for (auto it = byExpiry.begin(); it != end; ++it)
+        {
+            visitor(it->second);
+        }
+    }
+
+    /**
+     * @brief Get a beer's lots, soonest best-before first.
+     */
+    std::vector<Lot> lotsOf(int id) const
+    {
+        std::vector<Lot> lots;
+        auto found = heaps.find(id);
+        if (found != heaps.end())
+        {
+            std::vector<Key> keys = found->second;
+            std::sort(keys.begin(), keys.end());
+            for (const Key &key : keys)
+            {
+                lots.push_back(byExpiry.at(key));
+            }
+        }
+        return lots;
+    }
+
+    /**
+     * @brief Visit every lot, soonest best-before first.
+     */
+    void forEach(const std::function<void(const Lot &)> &visitor) const
+    {
+        for (const auto &entry : byExpiry)
+        {
+            visitor(entry.second);
+        }
+    }
+
+    /**
+     * @brief Get the number of lots held.
+     */
+    size_t size() const
+    {
+        return byExpiry.size();
+    }
+};
+
+/**
+ * @brief A full-screen terminal canvas that only redraws what changed.
+ *
+ * The terminal is switched to raw mode and the alternate screen while the
+ * object lives. Callers draw lines into a back buffer; present() compares
+ * it with what is on screen and rewrites only the changed span of each
+ * changed line, in a single write, so a small stock change costs a few
+ * bytes even over a slow link. Only plain escape sequences understood by
+ * any VT100-compatible terminal are used.
+ */
+class TerminalScreen
+{
+public:
+    enum Key
+    {
+        NONE = -1, // the timeout passed
+        UP = 256,
+        DOWN,
+        PAGE_UP,
+        PAGE_DOWN,
+        HOME,
+        END
+    };
+
+private:
+    typedef std::vector<std::string> Cells; // one UTF-8 character per screen column
+
+    struct termios saved;
+    int width;
+    int height;
+    std::vector<Cells> front; // what the terminal shows
+    std::vector<Cells> back;  // what present() will show
+    std::vector<bool> frontInverse;
+    std::vector<bool> backInverse;
+    std::string output;
+
+    static bool readByte(int timeoutMillis, unsigned char &byte)
+    {
+        pollfd input = {STDIN_FILENO, POLLIN, 0};
+        return ::poll(&input, 1, timeoutMillis) > 0 && ::read(STDIN_FILENO, &byte, 1) == 1;
+    }
+
+    void writeAll(const std::string &text)
+    {
+        size_t written = 0;
+        while (written < text.size())
+        {
+            ssize_t n = ::write(STDOUT_FILENO, text.data() + written, text.size() - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return;
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    void moveTo(int row, int column)
+    {
+        output += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(column + 1) + "H";
+    }
+
+public:
+    /**
+     * @brief Check whether standard input and output are both terminals.
+     */
+    static bool isAvailable()
+    {
+        return ::isatty(STDIN_FILENO) && ::isatty(STDOUT_FILENO);
+    }
+
+    /**
+     * @brief Enter raw mode and the alternate screen.
+     * @throws std::runtime_error if the terminal cannot be switched to raw mode.
+     */
+    TerminalScreen() : width(0), height(0)
+    {
+        if (::tcgetattr(STDIN_FILENO, &saved) != 0)
+        {
+            throw std::runtime_error("standard input is not a terminal");
+        }
+        struct termios raw = saved;
+        // Without ISIG, Ctrl-C arrives as a key instead of killing the process with the terminal still raw.
+        raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (::tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0)
+        {
+            throw std::runtime_error("cannot switch the terminal to raw mode");
+        }
+        std::cout.flush();
+        writeAll("\x1b[?1049h\x1b[?25l\x1b[2J");
+        resize();
+    }
+
+    ~TerminalScreen()
+    {
+        writeAll("\x1b[0m\x1b[?25h\x1b[?1049l");
+        ::tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+    }
+
+    TerminalScreen(const TerminalScreen &) = delete;
+    TerminalScreen &operator=(const TerminalScreen &) = delete;
+
+    /**
+     * @brief Pick up a change in the terminal size.
+     * @return True if the size changed, in which case the next present() redraws everything.
+     */
+    bool resize()
+    {
+        struct winsize size;
+        int newWidth = 80, newHeight = 24;
+        if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0)
+        {
+            newWidth = size.ws_col;
+            newHeight = size.ws_row;
+        }
+        if (newWidth == width && newHeight == height)
+        {
+            return false;
+        }
+        width = newWidth;
+        height = newHeight;
+        front.assign(height, Cells());
+        frontInverse.assign(height, false);
+        back.assign(height, Cells(width, " "));
+        backInverse.assign(height, false);
+        output += "\x1b[0m\x1b[2J"; // front no longer matches the terminal
+        return true;
+    }
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    /**
+     * @brief Set a line of the back buffer, clipped or padded to the screen width.
+     *
+     * Each UTF-8 character takes one column and is never split; wide
+     * characters are not measured.
+     *
+     * @param row The screen line.
+     * @param text The UTF-8 text; control characters and malformed bytes are shown as '?'.
+     * @param inverse Whether to draw the line in reverse video.
+     */
+    void setLine(int row, const std::string &text, bool inverse = false)
+    {
+        if (row < 0 || row >= height)
+        {
+            return;
+        }
+        Cells &line = back[row];
+        size_t i = 0;
+        for (int column = 0; column < width; ++column)
+        {
+            if (i >= text.size())
+            {
+                line[column] = " ";
+                continue;
+            }
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            size_t length = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+            bool valid = length > 0 && i + length <= text.size() && c >= 0x20 && c != 0x7F;
+            for (size_t k = 1; valid && k < length; ++k)
+            {
+                valid = (static_cast<unsigned char>(text[i + k]) & 0xC0) == 0x80;
+            }
+            line[column] = valid ? text.substr(i, length) : "?";
+            i += valid ? length : 1;
+        }
+        backInverse[row] = inverse;
+    }
+
+    /**
+     * @brief Bring the terminal up to date with the back buffer.
+     */
+    void present()
+    {
+        for (int row = 0; row < height; ++row)
+        {
+            const Cells &want = back[row];
+            Cells &have = front[row];
+            int first = 0, last = width - 1;
+            if (have.size() == want.size() && frontInverse[row] == backInverse[row])
+            {
+                while (first < width && have[first] == want[first])
+                {
+                    ++first;
+                }
+                if (first == width)
+                {
+                    continue;
+                }
+                while (have[last] == want[last])
+                {
+                    --last;
+                }
+            }
+            moveTo(row, first);
+            output += backInverse[row] ? "\x1b[7m" : "\x1b[0m";
+            for (int column = first; column <= last; ++column)
+            {
+                output += want[column];
+            }
+            have = want;
+            frontInverse[row] = backInverse[row];
+        }
+        if (!output.empty())
+        {
+            writeAll(output);
+            output.clear();
+        }
+    }
+
+    /**
+     * @brief Wait for a key press.
+     * @param timeoutMillis How long to wait.
+     * @return The character, one of the Key values, or NONE if the timeout passed.
+     */
+    int readKey(int timeoutMillis)
+    {
+        unsigned char c;
+        if (!readByte(timeoutMillis, c))
+        {
+            return NONE;
+        }
+        if (c != 0x1B)
+        {
+            return c;
+        }
+        unsigned char kind, code;
+        if (!readByte(50, kind) || (kind != '[' && kind != 'O') || !readByte(50, code))
+        {
+            return 0x1B;
+        }
+        switch (code)
+        {
+        case 'A':
+            return UP;
+        case 'B':
+            return DOWN;
+        case 'H':
+            return HOME;
+        case 'F':
+            return END;
+        default:
+            break;
+        }
+        unsigned char tilde;
+        if (code >= '1' && code <= '8' && readByte(50, tilde) && tilde == '~')
+        {
+            switch (code)
+            {
+            case '1':
+            case '7':
+                return HOME;
+            case '4':
+            case '8':
+                return END;
+            case '5':
+                return PAGE_UP;
+            case '6':
+                return PAGE_DOWN;
+            }
+        }
+        return NONE;
+    }
+};
+
+/**
+ * @brief Represents a beer inventory management application.
+ */
+class BottleApp
+{
+private:
+private:
+    static constexpr char SNAPSHOT_MAGIC[8] = {'B', 'S', 'N', 'A', 'P', '0', '0', '1'};
+    static constexpr char LOTS_MAGIC[4] = {'L', 'O', 'T', 'S'}; // optional section after the blocks
+
+    bool isBreakageFlagged;
+    std::unique_ptr<BeerStore> beers;
+    std::map<std::string, int> beerCounts;
+    std::vector<std::pair<std::string, int>> flaggedBeers;
+    Breakage breakage;
+    int nextBeerId;
+    QueryCatalog catalog;
+    std::map<std::string, PreparedQuery> preparedQueries;
+    std::map<std::string, MaterializedView> views;
+    QueryResultCache resultCache;
+    WatchRegistry watches;
+    std::vector<WatchRegistry::Firing> firedWatches;
+    std::unique_ptr<DashboardFeed> dashboard;
+    ActivitySketch activity;
+    HotCache<long long, std::vector<Beer>> hotBarcodes;
+    HotCache<std::string, std::optional<Beer>> hotNames;
+    std::vector<Beer> barcodeLookup; // the answer of the last findByBarcode the cache missed
+    std::optional<Beer> nameLookup;  // the answer of the last findByName the cache missed
+    std::unique_ptr<BarcodeDirectory> barcodeDirectory; // when enabled, replaces the catalog's barcode index for lookups
+    BlockedBloomFilter knownNames;    // every key ever in beerCounts
+    BlockedBloomFilter knownBarcodes; // a superset of the stored barcodes
+    BarcodeRadixTree barcodePrefixes;
+    UpdateTimeline updateTimes;
+    LotLedger lots;
+    SharedScan reports;
+    std::ofstream journal;           // one line per bulk change, when open
+    bool inBulkChange = false;       // defer the upkeep a batch of changes needs only once
+    std::set<std::string> bulkNames; // names whose counts changed during the bulk change
+
+    /**
+     * @brief Keep the counts, indexes, caches and views in step with a change to the store,
+     * and report the watches it fires.
+     *
+     * Outside a bulk change the store is flushed, so the change survives the
+     * process being killed. Inside one the flush, the filter and
+     * barcode-directory rebuilds and the dashboard updates are left to
+     * endBulkChange, which does each once.
+     *
+     * @param before The beer before the change, or nothing if it was added.
+     * @param after The beer after the change, or nothing if it was removed.
+     */
+    void recordChange(const std::optional<Beer> &before, const std::optional<Beer> &after)
+    {
+        if (before)
+        {
+            beerCounts[before->getName()] -= before->getQuantity();
+            beerCounts["Total"] -= before->getQuantity();
+            hotBarcodes.invalidate(before->getBarcode().getValue());
+            hotNames.invalidate(before->getName());
+        }
+        if (after)
+        {
+            beerCounts[after->getName()] += after->getQuantity();
+            beerCounts["Total"] += after->getQuantity();
+            hotBarcodes.invalidate(after->getBarcode().getValue());
+            hotNames.invalidate(after->getName());
+            knownNames.insert(hashString(after->getName()));
+            knownBarcodes.insert(mixHash(static_cast<uint64_t>(after->getBarcode().getValue())));
+            if (!inBulkChange && (knownNames.isSaturated() || knownBarcodes.isSaturated()))
+            {
+                rebuildFilters();
+            }
+        }
+        catalog.apply(before, after);
+        barcodePrefixes.apply(before, after);
+        updateTimes.apply(before, after);
+        lots.apply(before, after);
+        if (barcodeDirectory)
+        {
+            barcodeDirectory->apply(before, after);
+            if (!inBulkChange && barcodeDirectory->needsRebuild())
+            {
+                barcodeDirectory->rebuild(*beers);
+            }
+        }
+        for (auto &view : views)
+        {
+            view.second.apply(before, after);
+        }
+        watches.apply(before, after, firedWatches);
+        for (const WatchRegistry::Firing &firing : firedWatches)
+        {
+            std::cout << "Watch " << firing.watch->id << " fired: " << firing.watch->describe() << " (now " << firing.value << ")." << std::endl;
+        }
+        if (dashboard && inBulkChange)
+        {
+            if (before)
+            {
+                bulkNames.insert(before->getName());
+            }
+            if (after)
+            {
+                bulkNames.insert(after->getName());
+            }
+        }
+        else if (dashboard)
+        {
+            if (before)
+            {
+                dashboard->publishCount(before->getName(), beerCounts[before->getName()]);
+            }
+            if (after)
+            {
+                dashboard->publishCount(after->getName(), beerCounts[after->getName()]);
+            }
+            dashboard->publishTotal(beerCounts["Total"]);
+        }
+        if (!inBulkChange)
+        {
+            beers->flush();
+        }
+    }
+
+    /**
+     * @brief Do the upkeep recordChange deferred during a bulk change.
+     */
+    void endBulkChange()
+    {
+        inBulkChange = false;
+        beers->flush();
+        if (knownNames.isSaturated() || knownBarcodes.isSaturated())
+        {
+            rebuildFilters();
+        }
+        if (barcodeDirectory && barcodeDirectory->needsRebuild())
+        {
+            barcodeDirectory->rebuild(*beers);
+        }
+        if (dashboard && !bulkNames.empty())
+        {
+            for (const std::string &name : bulkNames)
+            {
+                dashboard->publishCount(name, beerCounts[name]);
+            }
+            dashboard->publishTotal(beerCounts["Total"]);
+        }
+        bulkNames.clear();
+    }
+
+    /**
+     * @brief Append one journal line for a bulk change: the time, the statement,
+     * the number of beers and their ids as ranges, e.g. "4-9,12".
+     */
+    void journalBulkChange(const std::string &statement, std::vector<int> ids)
+    {
+        if (!journal.is_open())
+        {
+            return;
+        }
+        std::time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+        std::sort(ids.begin(), ids.end());
+        std::string line = std::string(stamp) + '\t' + statement + '\t' + std::to_string(ids.size()) + '\t';
+        for (size_t i = 0; i < ids.size();)
+        {
+            size_t last = i;
+            while (last + 1 < ids.size() && ids[last + 1] == ids[last] + 1)
+            {
+                ++last;
+            }
+            line += (i ? "," : "") + std::to_string(ids[i]) + (last > i ? "-" + std::to_string(ids[last]) : "");
+            i = last + 1;
+        }
+        journal << line << std::endl;
+    }
+
+    /**
+     * @brief Rebuild the name and barcode filters with room for twice the current keys.
+     */
+    void rebuildFilters()
+    {
+        knownNames = BlockedBloomFilter(2 * beerCounts.size());
+        for (const auto &count : beerCounts)
+        {
+            knownNames.insert(hashString(count.first));
+        }
+        knownBarcodes = BlockedBloomFilter(2 * beers->size());
+        beers->forEach([this](const Beer &beer)
+                       { knownBarcodes.insert(mixHash(static_cast<uint64_t>(beer.getBarcode().getValue()))); });
+    }
+
+    /**
+     * @brief Count the barcodes a query looks up by equality as activity on them.
+     */
+    void recordLookups(const Predicate &predicate)
+    {
+        if (predicate.kind == Predicate::AND)
+        {
+            for (const auto &child : predicate.children)
+            {
+                recordLookups(*child);
+            }
+        }
+        else if (predicate.kind == Predicate::COMPARE && predicate.column == BeerColumn::BARCODE && predicate.op == CompareOp::EQ &&
+                 predicate.literal.type == ColumnType::INT64)
+        {
+            activity.record(predicate.literal.intValue, std::time(nullptr));
+        }
+    }
+
+    /**
+     * @brief Record a beer added while breakage is flagged.
+     * @param name The beer's name.
+     * @param quantity The number of bottles.
+     */
+    void recordBreakage(const std::string &name, int quantity)
+    {
+        flaggedBeers.push_back(std::make_pair(name, quantity));
+        breakage.incrementTotalBreakage(quantity);
+        if (dashboard)
+        {
+            dashboard->publishFlagged(name, quantity);
+            dashboard->publishBreakageTotal(breakage.getTotalBreakage());
+        }
+    }
+
+public:
+    BottleApp() : BottleApp(std::unique_ptr<BeerStore>(new VectorBeerStore())) {}
+
+    /**
+     * @brief Constructor for BottleApp with an explicit storage backend.
+     * @param store The store holding the beer records; existing records are counted.
+     */
+    explicit BottleApp(std::unique_ptr<BeerStore> store) : isBreakageFlagged(false), beers(std::move(store)), nextBeerId(1),
+                                                          knownNames(2 * beers->size()), knownBarcodes(2 * beers->size())
+    {
+        knownNames.insert(hashString("Total"));
+        inBulkChange = true;
+        beers->forEach([this](const Beer &beer)
+                       {
+                           nextBeerId = std::max(nextBeerId, beer.getId() + 1);
+                           recordChange(std::nullopt, beer); });
+        endBulkChange();
+    }
+
+    void addBeer(Beer &beer)
+    {
+        if (beer.getQuantity() <= 0)
+        {
+            std::cout << "Invalid quantity. Please enter a positive value." << std::endl;
+            return;
+        }
+        beer.setId(nextBeerId++);
+        std::string beerName = beer.getName();
+        int quantity = beer.getQuantity();
+
+        if (beerExists(beerName))
+        {
+            std::cout << "Beer with the same name already exists. Please edit the existing entry." << std::endl;
+            return;
+        }
+
+        std::cout << quantity << " bottles of " << beerName << " added to stock." << std::endl;
+        beer.updateDate();
+        beers->insert(beer);
+        recordChange(std::nullopt, beer);
+        activity.record(beer.getBarcode().getValue(), std::time(nullptr));
+
+        if (isBreakageFlagged)
+        {
+            std::cout << "Breakage has been flagged while adding beer." << std::endl;
+            recordBreakage(beerName, quantity);
+        }
+    }
+
+    /**
+     * @brief Add a batch of beers, e.g. from a bulk import.
+     *
+     * Applies the same checks as addBeer (positive quantity, unique name) but
+     * reports one summary instead of a line per beer.
+     *
+     * @param batch The beers to add; accepted beers get their ids assigned.
+     * @return The number of beers added.
+     */
+    size_t addBeers(std::vector<Beer> &batch)
+    {
+        size_t added = 0, rejected = 0;
+        int flaggedQuantity = 0;
+        inBulkChange = true;
+        for (Beer &beer : batch)
+        {
+            if (beer.getQuantity() <= 0 || beerExists(beer.getName()))
+            {
+                ++rejected;
+                continue;
+            }
+            beer.setId(nextBeerId++);
+            beers->insert(beer);
+            recordChange(std::nullopt, beer);
+            activity.record(beer.getBarcode().getValue(), std::time(nullptr));
+            if (isBreakageFlagged)
+            {
+                recordBreakage(beer.getName(), beer.getQuantity());
+                flaggedQuantity += beer.getQuantity();
+            }
+            ++added;
+        }
+        endBulkChange();
+        std::cout << added << " beers added to stock";
+        if (rejected > 0)
+        {
+            std::cout << ", " << rejected << " skipped (invalid quantity or name already exists)";
+        }
+        std::cout << "." << std::endl;
+        if (flaggedQuantity > 0)
+        {
+            std::cout << "Breakage has been flagged while adding beer." << std::endl;
+        }
+        return added;
+    }
+
+    /**
+     * @brief Get a valid 12-digit barcode from the user.
+     * @return The valid barcode.
+     */
+    long long getValidBarcode()
+    {
+        std::string barcodeStr;
+        while (true)
+        {
+            std::cout << "Enter the barcode value (12 digits): ";
+            std::cin >> barcodeStr;
+            if (barcodeStr.length() == 12 && std::all_of(barcodeStr.begin(), barcodeStr.end(), ::isdigit))
+            {
+                try
+                {
+                    long long barcode = std::stoll(barcodeStr);
+                    return barcode;
+                }
+                catch (const std::out_of_range &e)
+                {
+                    std::cout << "Barcode value is too large. Please enter a valid 12-digit barcode." << std::endl;
+                }
+                catch (const std::invalid_argument &e)
+                {
+                    std::cout << "Invalid input. Please enter a valid 12-digit barcode." << std::endl;
+                }
+            }
+            else
+            {
+                std::cout << "Invalid barcode. Please enter exactly 12 digits." << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief Flag breakage while adding beer.
+     */
+    void flagBreakage()
+    {
+        isBreakageFlagged = true;
+        std::cout << "Breakage has been flagged." << std::endl;
+    }
+
+    /**
+     * @brief Remove beer from the stock.
+     * @param amount The amount of beer to remove.
+     */
+    // Modify the removeBeer method to prompt for the ID to remove
+    void removeBeer()
+    {
+        std::cout << "Select a beer to remove by entering its ID:" << std::endl;
+
+        // Display available beers with IDs
+        beers->forEach([](const Beer &beer)
+                       { std::cout << "ID: " << beer.getId() << " - " << beer.getName() << std::endl; });
+
+        int idToRemove;
+        std::cout << "Enter the ID of the beer to remove: ";
+        std::cin >> idToRemove;
+
+        std::optional<Beer> beer = beers->find(idToRemove);
+        if (beer)
+        {
+            beers->remove(idToRemove); // Remove the selected beer
+            recordChange(beer, std::nullopt);
+            activity.record(beer->getBarcode().getValue(), std::time(nullptr));
+            std::cout << "Beer with ID " << idToRemove << " removed from stock." << std::endl;
+        }
+        else
+        {
+            std::cout << "Beer with ID " << idToRemove << " not found in inventory." << std::endl;
+        }
+    }
+
+    /**
+     * @brief Change a beer's quantity by a delta, as an edit would.
+     * @param id The beer's id.
+     * @param delta The change in bottles.
+     * @return False if the beer is not stored or its quantity would drop below zero.
+     */
+    bool adjustQuantity(int id, int delta)
+    {
+        std::optional<Beer> found = beers->find(id);
+        if (!found || found->getQuantity() + delta < 0)
+        {
+            return false;
+        }
+        const Beer original = *found;
+        found->setQuantity(found->getQuantity() + delta);
+        found->updateDate();
+        if (!beers->update(*found))
+        {
+            return false;
+        }
+        recordChange(original, *found);
+        activity.record(found->getBarcode().getValue(), std::time(nullptr));
+        return true;
+    }
+
+    /**
+     * @brief Receive a dated lot of a beer, adding its bottles to the quantity.
+     * @param id The beer's id.
+     * @param quantity The bottles in the lot.
+     * @param bestBefore The lot's best-before day (see LotLedger::parseDay).
+     * @return False if the beer is not stored, the quantity is not positive or the total would overflow.
+     */
+    bool receiveLot(int id, int quantity, int32_t bestBefore)
+    {
+        std::optional<Beer> found = beers->find(id);
+        if (!found || quantity <= 0 || quantity > INT_MAX - found->getQuantity())
+        {
+            return false;
+        }
+        const Beer original = *found;
+        found->setQuantity(found->getQuantity() + quantity);
+        found->updateDate();
+        if (!beers->update(*found))
+        {
+            return false;
+        }
+        recordChange(original, *found);
+        lots.receive(LotLedger::Lot{id, LotLedger::today(), bestBefore, quantity});
+        activity.record(found->getBarcode().getValue(), std::time(nullptr));
+        return true;
+    }
+
+    /**
+     * @brief Browse the inventory in a full-screen grid.
+     *
+     * Only the rows in view are read from the store, so scrolling costs the
+     * same at any inventory size; the list of ids behind the scroll position
+     * is rebuilt only when beers are added or removed. The view is re-read
+     * twice a second, and TerminalScreen redraws only the cells that changed.
+     * Arrow keys, PgUp/PgDn and Home/End move the selection, "+" and "-"
+     * change its quantity by one and "q" leaves.
+     */
+    void browse()
+    {
+        if (!TerminalScreen::isAvailable())
+        {
+            std::cout << "Browsing needs an interactive terminal." << std::endl;
+            return;
+        }
+        static const int WIDTHS[] = {8, 28, 16, 7, 10, 9, 14};
+        auto gridLine = [](const std::vector<std::string> &cells)
+        {
+            std::string line;
+            for (size_t i = 0; i < cells.size(); ++i)
+            {
+                std::string cell = cells[i].substr(0, WIDTHS[i] - 1);
+                line += cell;
+                line.append(WIDTHS[i] - cell.size(), ' ');
+            }
+            return line;
+        };
+
+        TerminalScreen screen;
+        std::vector<int> ids;
+        uint64_t idsVersion = 0;
+        bool haveIds = false;
+        size_t top = 0, selected = 0;
+        std::string message;
+        while (true)
+        {
+            if (!haveIds || idsVersion != catalog.getRowVersion())
+            {
+                ids.clear();
+                ids.reserve(beers->size());
+                beers->forEach([&ids](const Beer &beer)
+                               { ids.push_back(beer.getId()); });
+                idsVersion = catalog.getRowVersion();
+                haveIds = true;
+            }
+            screen.resize();
+            size_t visible = static_cast<size_t>(std::max(1, screen.getHeight() - 2));
+            selected = ids.empty() ? 0 : std::min(selected, ids.size() - 1);
+            top = std::min(top, selected);
+            if (selected >= top + visible)
+            {
+                top = selected - visible + 1;
+            }
+
+            screen.setLine(0, gridLine({"ID", "Name", "Style", "ABV", "Size", "Quantity", "Barcode"}), true);
+            for (size_t row = 0; row < visible; ++row)
+            {
+                size_t index = top + row;
+                std::optional<Beer> beer = index < ids.size() ? beers->find(ids[index]) : std::nullopt;
+                if (!beer)
+                {
+                    screen.setLine(static_cast<int>(row) + 1, "");
+                    continue;
+                }
+                char abv[32];
+                std::string line = gridLine({std::to_string(beer->getId()), beer->getName(), beer->getStyle(),
+                                             std::string(abv, std::to_chars(abv, abv + sizeof(abv), beer->getAlcoholContent(), std::chars_format::fixed, 1).ptr),
+                                             beer->getContainerSize().getSizeWithUnits(), std::to_string(beer->getQuantity()),
+                                             std::to_string(beer->getBarcode().getValue())});
+                screen.setLine(static_cast<int>(row) + 1, line, index == selected);
+            }
+            std::string status = ids.empty() ? "No beers in inventory." : "Beer " + std::to_string(selected + 1) + " of " + std::to_string(ids.size());
+            status += "   Up/Down PgUp/PgDn Home/End: move   +/-: quantity   q: quit";
+            if (!message.empty())
+            {
+                status += "   " + message;
+            }
+            screen.setLine(screen.getHeight() - 1, status, true);
+            screen.present();
+
+            int key = screen.readKey(500);
+            if (key == TerminalScreen::NONE)
+            {
+                continue;
+            }
+            message.clear();
+            switch (key)
+            {
+            case 'q':
+            case 'Q':
+            case 0x03: // Ctrl-C, which raw mode delivers as a key
+            case 0x1B:
+                return;
+            case TerminalScreen::UP:
+            case 'k':
+                selected -= selected > 0 ? 1 : 0;
+                break;
+            case TerminalScreen::DOWN:
+            case 'j':
+                ++selected;
+                break;
+            case TerminalScreen::PAGE_UP:
+                selected -= std::min(selected, visible);
+                break;
+            case TerminalScreen::PAGE_DOWN:
+                selected += visible;
+                break;
+            case TerminalScreen::HOME:
+            case 'g':
+                selected = 0;
+                break;
+            case TerminalScreen::END:
+            case 'G':
+                selected = ids.empty() ? 0 : ids.size() - 1;
+                break;
+            case '+':
+            case '-':
+            {
+                if (ids.empty())
+                {
+                    break;
+                }
+                // Watch reports would scroll the screen; show the last one in the status line instead.
+                std::ostringstream reports;
+                std::streambuf *terminal = std::cout.rdbuf(reports.rdbuf());
+                bool adjusted = adjustQuantity(ids[selected], key == '+' ? 1 : -1);
+                std::cout.rdbuf(terminal);
+                std::string text = reports.str();
+                if (!adjusted)
+                {
+                    message = "Quantity cannot go below zero.";
+                }
+                else if (!text.empty())
+                {
+                    text.pop_back();
+                    message = text.substr(text.rfind('\n') == std::string::npos ? 0 : text.rfind('\n') + 1);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Display details of all added beers.
+     *
+     * The listing is sorted with parallelSort (id order needs no sort) and
+     * formatted on all cores by writeInOrder.
+     *
+     * @param sortBy The column to order the listing by.
+     * @param descending Whether to list the largest values first.
+     */
+    void displayAddedBeers(BeerColumn sortBy = BeerColumn::ID, bool descending = false) const
+    {
+        if (beers->empty())
+        {
+            std::cout << "No beers in inventory." << std::endl;
+            return;
+        }
+
+        std::vector<Beer> listed;
+        listed.reserve(beers->size());
+        beers->forEach([&listed](const Beer &beer)
+                       { listed.push_back(beer); });
+        std::vector<uint32_t> order = listingOrder(listed, sortBy, descending);
+
+        std::cout << "List of added beers:" << std::endl;
+        writeInOrder(std::cout, order.size(), [&](size_t begin, size_t end, std::string &text)
+                     {
+                         char number[32];
+                         auto append = [&](const char *label, const std::string &value, const char *suffix)
+                         {
+                             text += label;
+                             text += value;
+                             text += suffix;
+                         };
+                         for (size_t i = begin; i < end; ++i)
+                         {
+                             const Beer &beer = listed[order[i]];
+                             append("ID: ", std::string(number, std::to_chars(number, number + sizeof(number), beer.getId()).ptr), "\n");
+                             append("Name: ", beer.getName(), "\n");
+                             append("Style: ", beer.getStyle(), "\n");
+                             // Six significant digits, as std::cout prints a double.
+                             append("Alcohol Content: ",
+                                    std::string(number, std::to_chars(number, number + sizeof(number), beer.getAlcoholContent(), std::chars_format::general, 6).ptr),
+                                    "%\n");
+                             append("Container Size: ", beer.getContainerSize().getSizeWithUnits(), "\n");
+                             append("Quantity: ", std::string(number, std::to_chars(number, number + sizeof(number), beer.getQuantity()).ptr), " bottles\n");
+                             append("Barcode: ", std::string(number, std::to_chars(number, number + sizeof(number), beer.getBarcode().getValue()).ptr), "\n");
+                             append("Updated Date: ", beer.getUpdatedDate(), "\n");
+                             text += "-----------------------\n";
+                         } });
+    }
+
+    /**
+     * @brief Get the order to list beers in.
+     * @param listed The beers, in id order.
+     * @param sortBy The column to order by; ties keep id order.
+     * @param descending Whether the largest values come first.
+     * @return Positions in listed, in listing order.
+     */
+    static std::vector<uint32_t> listingOrder(const std::vector<Beer> &listed, BeerColumn sortBy, bool descending)
+    {
+        if (sortBy == BeerColumn::ID)
+        {
+            std::vector<uint32_t> order(listed.size());
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                order[i] = static_cast<uint32_t>(descending ? order.size() - 1 - i : i);
+            }
+            return order;
+        }
+        switch (beerColumnType(sortBy))
+        {
+        case ColumnType::INT64:
+            return sortedBy<int64_t>(listed, descending, [sortBy](const Beer &beer)
+                                     { return beerColumnValue(beer, sortBy).intValue; });
+        case ColumnType::DOUBLE:
+            return sortedBy<double>(listed, descending, [sortBy](const Beer &beer)
+                                    { return beerColumnValue(beer, sortBy).doubleValue; });
+        default:
+            return sortedBy<std::string>(listed, descending, [sortBy](const Beer &beer)
+                                         { return beerColumnValue(beer, sortBy).stringValue; });
+        }
+    }
+
+    template <typename Key>
+    static std::vector<uint32_t> sortedBy(const std::vector<Beer> &listed, bool descending, const std::function<Key(const Beer &)> &key)
+    {
+        std::vector<std::pair<Key, uint32_t>> keyed(listed.size());
+        parallelFor((listed.size() + 65535) / 65536, [&](size_t chunk)
+                    {
+                        size_t end = std::min(listed.size(), (chunk + 1) * 65536);
+                        for (size_t i = chunk * 65536; i < end; ++i)
+                        {
+                            keyed[i] = std::make_pair(key(listed[i]), static_cast<uint32_t>(i));
+                        } });
+        parallelSort(keyed, [descending](const std::pair<Key, uint32_t> &a, const std::pair<Key, uint32_t> &b)
+                     { return descending ? b.first < a.first : a.first < b.first; });
+        std::vector<uint32_t> order(keyed.size());
+        for (size_t i = 0; i < keyed.size(); ++i)
+        {
+            order[i] = keyed[i].second;
+        }
+        return order;
+    }
+
+    /**
+     * @brief Look up the beers with a barcode, through the hot-SKU cache.
+     * @param barcode The barcode to look up.
+     * @return The beers with that barcode, in id order, valid until the next lookup or change.
+     */
+    const std::vector<Beer> &findByBarcode(long long barcode)
+    {
+        if (!knownBarcodes.mayContain(mixHash(static_cast<uint64_t>(barcode))))
+        {
+            barcodeLookup.clear();
+            return barcodeLookup;
+        }
+        if (const std::vector<Beer> *cached = hotBarcodes.find(barcode))
+        {
+            return *cached;
+        }
+        std::vector<int> ids;
+        if (barcodeDirectory)
+        {
+            ids = barcodeDirectory->find(barcode);
+        }
+        else
+        {
+            AccessPath path;
+            path.kind = AccessPath::HASH_PROBE;
+            path.column = BeerColumn::BARCODE;
+            path.keys.push_back(QueryValue::ofInt(barcode));
+            ids = catalog.lookup(path);
+        }
+        std::vector<Beer> found;
+        for (int id : ids)
+        {
+            std::optional<Beer> beer = beers->find(id);
+            if (beer && beer->getBarcode().getValue() == barcode)
+            {
+                found.push_back(*beer);
+            }
+        }
+        hotBarcodes.offer(barcode, found);
+        barcodeLookup = std::move(found);
+        return barcodeLookup;
+    }
+
+    /**
+     * @brief Index barcodes with a minimal perfect hash (see BarcodeDirectory).
+     *
+     * The first build runs now; later ones are started in the background
+     * when a snapshot is saved or loaded and when the overlay grows.
+     */
+    void enableBarcodeDirectory()
+    {
+        barcodeDirectory.reset(new BarcodeDirectory());
+        barcodeDirectory->rebuild(*beers);
+        barcodeDirectory->waitForRebuild();
+        std::cout << "Barcode index: " << barcodeDirectory->describe() << "." << std::endl;
+    }
+
+    /**
+     * @brief Look up a beer by name, through the hot-SKU cache.
+     *
+     * Names are unique: addBeer, addBeers, editBeer and UPDATE all refuse a
+     * name another beer already has, so there is at most one match.
+     *
+     * @param name The name to look up.
+     * @return The beer, or nothing if no beer has that name; valid until the next lookup or change.
+     */
+    const std::optional<Beer> &findByName(const std::string &name)
+    {
+        if (const std::optional<Beer> *cached = hotNames.find(name))
+        {
+            return *cached;
+        }
+        AccessPath path;
+        path.kind = AccessPath::HASH_PROBE;
+        path.column = BeerColumn::NAME;
+        path.keys.push_back(QueryValue::ofString(name));
+        std::optional<Beer> found;
+        for (int id : catalog.lookup(path))
+        {
+            std::optional<Beer> beer = beers->find(id);
+            if (beer && beer->getName() == name)
+            {
+                found = beer;
+                break;
+            }
+        }
+        hotNames.offer(name, found);
+        nameLookup = std::move(found);
+        return nameLookup;
+    }
+
+    /**
+     * @brief Display the beers with a scanned barcode and count the scan.
+     * @param barcode The scanned barcode.
+     */
+    void scanBarcode(long long barcode)
+    {
+        activity.record(barcode, std::time(nullptr));
+        const std::vector<Beer> &found = findByBarcode(barcode);
+        if (found.empty())
+        {
+            std::cout << "No beer with barcode " << barcode << "." << std::endl;
+            return;
+        }
+        for (const Beer &beer : found)
+        {
+            std::cout << "ID: " << beer.getId() << " - " << beer.getName() << " (" << beer.getStyle() << ", "
+                      << beer.getContainerSize().getSizeWithUnits() << "): " << beer.getQuantity() << " bottles" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Display details of flagged beers.
+     */
+    void displayFlaggedBeers() const
+    {
+        if (flaggedBeers.empty())
+        {
+            std::cout << "No beers flagged for breakage." << std::endl;
+        }
+        else
+        {
+            std::cout << "List of flagged beers for breakage:" << std::endl;
+            for (const auto &flaggedBeer : flaggedBeers)
+            {
+                std::cout << "Name: " << flaggedBeer.first << std::endl;
+                std::cout << "Quantity: " << flaggedBeer.second << " bottles" << std::endl;
+                std::cout << "-----------------------" << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief Display the total count of each beer type.
+     */
+    void displayTotalCounts() const
+    {
+        std::cout << "Total counts of each beer type:" << std::endl;
+        for (const auto &entry : beerCounts){
+           if (entry.first  != "Total"){
+                std::cout << entry.first << ": " << entry.second << " bottles" << std::endl;
+           } 
+        }
+    }
+
+    /**
+     * @brief Edit beer details.
+     * @param beerName The name of the beer to edit.
+     */
+    void editBeer(const std::string &beerName)
+    {
+        std::optional<Beer> found = findByName(beerName);
+        if (!found)
+        {
+            std::cout << "Beer with name '" << beerName << "' not found." << std::endl;
+            return;
+        }
+
+        const Beer original = *found;
+        Beer &beer = *found;
+        std::string newName, newStyle;
+        double newAlcoholContent;
+        ContainerSize newContainerSize = beer.getContainerSize();
+        int newQuantity, newBarcode;
+
+        std::cout << "Enter new name for the beer (press Enter to keep it the same): ";
+        std::string temp;
+        std::getline(std::cin, temp);
+        if (!temp.empty() && temp != beerName && findByName(temp))
+        {
+            std::cout << "Beer with the same name already exists. Please choose another name." << std::endl;
+            return;
+        }
+        if (!temp.empty())
+        {
+            beer.setName(temp);
+        }
+
+        std::cout << "Enter new style for the beer (press Enter to keep it the same): ";
+        std::getline(std::cin, temp);
+        if (!temp.empty())
+        {
+            beer.setStyle(temp);
+        }
+
+        std::cout << "Enter new alcohol content for the beer (%): ";
+        std::cin >> newAlcoholContent;
+        beer.setAlcoholContent(newAlcoholContent);
+
+        std::cout << "Enter new container size for the beer (size in ml for metric, fl oz for non-metric): ";
+        int newSize;
+        std::cin >> newSize;
+        newContainerSize.setSize(newSize, newContainerSize.getIsMetric());
+
+        std::cout << "Is the new container size metric (1 for yes, 0 for no): ";
+        bool isMetric;
+        std::cin >> isMetric;
+        newContainerSize.setIsMetric(isMetric);
+
+        beer.setContainerSize(newContainerSize);
+
+        std::cout << "Enter new quantity for the beer: ";
+        std::cin >> newQuantity;
+        beer.setQuantity(newQuantity);
+        beer.updateDate();
+        if (beers->update(beer))
+        {
+            recordChange(original, beer);
+            activity.record(beer.getBarcode().getValue(), std::time(nullptr));
+        }
+
+        std::cout << "Beer details updated." << std::endl;
+    }
+
+    /**
+     * @brief Find the beers that satisfy a condition, through the cheapest index for it.
+     * @param condition A WHERE condition without parameters, e.g. "quantity = 0".
+     * @return A copy of each matching beer.
+     * @throws std::invalid_argument if the condition does not parse or is more than a condition.
+     */
+    std::vector<Beer> selectWhere(const std::string &condition)
+    {
+        PreparedQuery selection("SELECT * WHERE " + condition);
+        const Query &query = selection.getQuery();
+        if (!selection.isBound())
+        {
+            throw std::invalid_argument("parameters can only be used in prepared queries");
+        }
+        if (!query.groupBy.empty() || !query.orderBy.empty() || query.limit >= 0)
+        {
+            throw std::invalid_argument("expected only a condition after WHERE");
+        }
+        QueryPlan plan = QueryPlanner::plan(query, catalog, catalog.getStatistics(*beers), beers->size());
+        std::vector<Beer> matches;
+        QueryEngine::readPath(*beers, catalog, plan.access, [&](const Beer &beer)
+                              {
+                                  if (matchesPredicate(*query.where, beer))
+                                  {
+                                      matches.push_back(beer);
+                                  } });
+        return matches;
+    }
+
+    /**
+     * @brief Change every beer that satisfies a condition, e.g. restyle "IPA " to "IPA".
+     *
+     * The targets are found through the indexes before anything changes,
+     * every assignment is checked against all of them, and then the batch
+     * is applied with the once-per-batch upkeep done at the end (see
+     * recordChange). The whole change is one journal record.
+     *
+     * @param condition A WHERE condition without parameters.
+     * @param changes The new values; id, barcode and updated_date cannot be set.
+     * @return The number of beers changed.
+     * @throws std::invalid_argument if the condition or a change is invalid; nothing is changed.
+     */
+    size_t updateWhere(const std::string &condition, const std::vector<ColumnChange> &changes)
+    {
+        for (const ColumnChange &change : changes)
+        {
+            BeerColumn column = change.column;
+            if (column == BeerColumn::ID || column == BeerColumn::BARCODE || column == BeerColumn::UPDATED_DATE)
+            {
+                throw std::invalid_argument("cannot SET " + beerColumnName(column));
+            }
+            QueryParser::checkLiteral(column, change.value);
+            if (beerColumnType(column) == ColumnType::INT64 && change.value.type != ColumnType::INT64)
+            {
+                throw std::invalid_argument(beerColumnName(column) + " needs a whole number, not '" + change.value.toString() + "'");
+            }
+            // Quantity and size are stored as int.
+            if ((beerColumnType(column) == ColumnType::INT64 && change.value.intValue > INT_MAX) ||
+                (column == BeerColumn::QUANTITY && change.value.intValue < 0) || (column == BeerColumn::CONTAINER_SIZE && change.value.intValue <= 0) ||
+                (column == BeerColumn::IS_METRIC && change.value.intValue != 0 && change.value.intValue != 1) ||
+                (column == BeerColumn::ALCOHOL_CONTENT && change.value.asDouble() < 0))
+            {
+                throw std::invalid_argument("invalid " + beerColumnName(column) + " '" + change.value.toString() + "'");
+            }
+        }
+        std::vector<Beer> targets = selectWhere(condition);
+        for (const ColumnChange &change : changes)
+        {
+            if (change.column != BeerColumn::NAME || targets.empty())
+            {
+                continue;
+            }
+            const std::optional<Beer> &holder = findByName(change.value.stringValue);
+            if (targets.size() > 1 || (holder && holder->getId() != targets[0].getId()))
+            {
+                throw std::invalid_argument("beer names are unique; '" + change.value.stringValue + "' cannot be given to " +
+                                            (targets.size() > 1 ? std::to_string(targets.size()) + " beers" : "a second beer"));
+            }
+        }
+
+        std::vector<int> changed;
+        inBulkChange = true;
+        for (const Beer &before : targets)
+        {
+            Beer after = before;
+            for (const ColumnChange &change : changes)
+            {
+                ContainerSize container = after.getContainerSize();
+                switch (change.column)
+                {
+                case BeerColumn::NAME:
+                    after.setName(change.value.stringValue);
+                    break;
+                case BeerColumn::STYLE:
+                    after.setStyle(change.value.stringValue);
+                    break;
+                case BeerColumn::ALCOHOL_CONTENT:
+                    after.setAlcoholContent(change.value.asDouble());
+                    break;
+                case BeerColumn::CONTAINER_SIZE:
+                    container.setSize(static_cast<int>(change.value.intValue));
+                    after.setContainerSize(container);
+                    break;
+                case BeerColumn::IS_METRIC:
+                    container.setIsMetric(change.value.intValue != 0);
+                    after.setContainerSize(container);
+                    break;
+                default:
+                    after.setQuantity(static_cast<int>(change.value.intValue));
+                    break;
+                }
+            }
+            after.updateDate();
+            if (beers->update(after))
+            {
+                recordChange(before, after);
+                activity.record(after.getBarcode().getValue(), std::time(nullptr));
+                changed.push_back(after.getId());
+            }
+        }
+        endBulkChange();
+
+        std::string statement = "UPDATE SET ";
+        for (size_t i = 0; i < changes.size(); ++i)
+        {
+            const QueryValue &value = changes[i].value;
+            statement += (i ? ", " : "") + beerColumnName(changes[i].column) + " = " +
+                         (value.type == ColumnType::STRING ? "'" + value.stringValue + "'" : value.toString());
+        }
+        journalBulkChange(statement + " WHERE " + condition, changed);
+        return changed.size();
+    }
+
+    /**
+     * @brief Remove every beer that satisfies a condition, e.g. all zero-quantity SKUs.
+     *
+     * Like updateWhere, the targets are found through the indexes first and
+     * removed as one batch with one journal record.
+     *
+     * @param condition A WHERE condition without parameters.
+     * @return The number of beers removed.
+     * @throws std::invalid_argument if the condition is invalid; nothing is removed.
+     */
+    size_t removeWhere(const std::string &condition)
+    {
+        std::vector<Beer> targets = selectWhere(condition);
+        std::vector<int> removed;
+        inBulkChange = true;
+        for (const Beer &beer : targets)
+        {
+            if (beers->remove(beer.getId()))
+            {
+                recordChange(beer, std::nullopt);
+                activity.record(beer.getBarcode().getValue(), std::time(nullptr));
+                removed.push_back(beer.getId());
+            }
+        }
+        endBulkChange();
+        journalBulkChange("DELETE WHERE " + condition, removed);
+        return removed.size();
+    }
+
+    /**
+     * @brief Append bulk changes to a journal file, one line each.
+     * @param path The journal file; existing records are kept.
+     * @return True if the file is open for appending.
+     */
+    bool openJournal(const std::string &path)
+    {
+        journal.close();
+        journal.clear();
+        journal.open(path, std::ios::app);
+        return journal.is_open();
+    }
+
+    /**
+     * @brief Save the inventory and breakage state to a compressed snapshot.
+     * @param path The snapshot file to write.
+     * @return True if the snapshot was written.
+     */
+    bool saveSnapshot(const std::string &path) const
+    {
+        std::vector<std::vector<Beer>> blocks(1);
+        beers->forEach([&blocks](const Beer &beer)
+                       {
+                           if (blocks.back().size() == BeerSnapshotCodec::BLOCK_ROWS)
+                           {
+                               blocks.emplace_back();
+                           }
+                           blocks.back().push_back(beer); });
+        std::vector<std::string> compressed(blocks.size());
+        std::vector<uint32_t> rawSizes(blocks.size());
+        parallelFor(blocks.size(), [&](size_t i)
+                    {
+                        std::string raw = BeerSnapshotCodec::encodeBlock(blocks[i]);
+                        rawSizes[i] = static_cast<uint32_t>(raw.size());
+                        compressed[i] = lzCompress(raw); });
+
+        std::string header(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        appendPod<int32_t>(header, nextBeerId);
+        appendPod<uint8_t>(header, isBreakageFlagged ? 1 : 0);
+        appendPod<int32_t>(header, breakage.getTotalBreakage());
+        appendVarint(header, flaggedBeers.size());
+        for (const auto &flaggedBeer : flaggedBeers)
+        {
+            appendString(header, flaggedBeer.first);
+            appendVarint(header, zigzagEncode(flaggedBeer.second));
+        }
+        appendPod<uint32_t>(header, static_cast<uint32_t>(blocks.size()));
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            appendPod<uint32_t>(header, rawSizes[i]);
+            appendPod<uint32_t>(header, static_cast<uint32_t>(compressed[i].size()));
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(header.data(), header.size());
+        for (const std::string &block : compressed)
+        {
+            out.write(block.data(), block.size());
+        }
+        if (lots.size() > 0)
+        {
+            // Readers that predate lots stop after the blocks and never see this.
+            std::string section(LOTS_MAGIC, sizeof(LOTS_MAGIC));
+            appendVarint(section, lots.size());
+            lots.forEach([&section](const LotLedger::Lot &lot)
+                         {
+                             appendVarint(section, static_cast<uint64_t>(lot.id));
+                             appendVarint(section, zigzagEncode(lot.received));
+                             appendVarint(section, zigzagEncode(lot.bestBefore));
+                             appendVarint(section, static_cast<uint64_t>(lot.quantity)); });
+            out.write(section.data(), section.size());
+        }
+        if (!out)
+        {
+            std::cout << "Unable to write snapshot " << path << "." << std::endl;
+            return false;
+        }
+        std::cout << "Snapshot saved to " << path << "." << std::endl;
+        if (barcodeDirectory)
+        {
+            barcodeDirectory->rebuild(*beers);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Load a snapshot written by saveSnapshot into an empty inventory.
+     * @param path The snapshot file to read.
+     * @return True if the snapshot was loaded.
+     */
+    bool loadSnapshot(const std::string &path)
+    {
+        if (!beers->empty())
+        {
+            std::cout << "Snapshots can only be loaded into an empty inventory." << std::endl;
+            return false;
+        }
+        std::ifstream in(path, std::ios::binary);
+        std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const char *cursor = file.data();
+        const char *end = cursor + file.size();
+
+        int32_t storedNextId, totalBreakage;
+        uint8_t flagged;
+        uint64_t flaggedCount;
+        uint32_t blockCount;
+        std::vector<std::pair<std::string, int>> storedFlagged;
+        bool valid = file.compare(0, sizeof(SNAPSHOT_MAGIC), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+        cursor += sizeof(SNAPSHOT_MAGIC);
+        valid = valid && readPod(cursor, end, storedNextId) && readPod(cursor, end, flagged) &&
+                readPod(cursor, end, totalBreakage) && readVarint(cursor, end, flaggedCount);
+        for (uint64_t i = 0; valid && i < flaggedCount; ++i)
+        {
+            std::string name;
+            uint64_t quantity;
+            valid = readString(cursor, end, name) && readVarint(cursor, end, quantity);
+            storedFlagged.push_back(std::make_pair(name, static_cast<int>(zigzagDecode(quantity))));
+        }
+        valid = valid && readPod(cursor, end, blockCount);
+        std::vector<uint32_t> rawSizes, compressedSizes;
+        std::vector<const char *> payloads;
+        for (uint32_t i = 0; valid && i < blockCount; ++i)
+        {
+            uint32_t rawSize, compressedSize;
+            valid = readPod(cursor, end, rawSize) && readPod(cursor, end, compressedSize);
+            rawSizes.push_back(rawSize);
+            compressedSizes.push_back(compressedSize);
+        }
+        for (uint32_t i = 0; valid && i < blockCount; ++i)
+        {
+            valid = static_cast<size_t>(end - cursor) >= compressedSizes[i];
+            payloads.push_back(cursor);
+            cursor += valid ? compressedSizes[i] : 0;
+        }
+        std::vector<LotLedger::Lot> storedLots;
+        if (valid && static_cast<size_t>(end - cursor) >= sizeof(LOTS_MAGIC) && std::equal(LOTS_MAGIC, LOTS_MAGIC + sizeof(LOTS_MAGIC), cursor))
+        {
+            cursor += sizeof(LOTS_MAGIC);
+            uint64_t lotCount;
+            valid = readVarint(cursor, end, lotCount);
+            for (uint64_t i = 0; valid && i < lotCount; ++i)
+            {
+                uint64_t id, received, bestBefore, quantity;
+                valid = readVarint(cursor, end, id) && readVarint(cursor, end, received) && readVarint(cursor, end, bestBefore) &&
+                        readVarint(cursor, end, quantity);
+                storedLots.push_back(LotLedger::Lot{static_cast<int>(id), static_cast<int32_t>(zigzagDecode(received)),
+                                                    static_cast<int32_t>(zigzagDecode(bestBefore)), static_cast<int>(quantity)});
+            }
+        }
+        if (!valid)
+        {
+            std::cout << "File " << path << " is not a valid snapshot." << std::endl;
+            return false;
+        }
+
+        std::vector<std::vector<Beer>> blocks(blockCount);
+        std::atomic<bool> decoded(true);
+        parallelFor(blockCount, [&](size_t i)
+                    {
+                        std::string raw;
+                        if (!lzDecompress(payloads[i], compressedSizes[i], rawSizes[i], raw) ||
+                            !BeerSnapshotCodec::decodeBlock(raw, blocks[i]))
+                        {
+                            decoded = false;
+                        } });
+        if (!decoded)
+        {
+            std::cout << "Snapshot " << path << " is corrupt." << std::endl;
+            return false;
+        }
+
+        inBulkChange = true;
+        for (const std::vector<Beer> &block : blocks)
+        {
+            for (const Beer &beer : block)
+            {
+                beers->insert(beer);
+                recordChange(std::nullopt, beer);
+            }
+        }
+        endBulkChange();
+        for (const LotLedger::Lot &lot : storedLots)
+        {
+            lots.receive(lot);
+        }
+        nextBeerId = storedNextId;
+        isBreakageFlagged = flagged != 0;
+        breakage.setTotalBreakage(totalBreakage);
+        flaggedBeers = storedFlagged;
+        if (dashboard)
+        {
+            dashboard->publishBreakageTotal(totalBreakage);
+        }
+        std::cout << "Snapshot loaded from " << path << " (" << beers->size() << " beers)." << std::endl;
+        if (barcodeDirectory)
+        {
+            barcodeDirectory->rebuild(*beers);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Export the inventory as a columnar analytics file.
+     * @param path The file to write.
+     * @return True if the file was written.
+     */
+    bool exportColumnar(const std::string &path) const
+    {
+        if (!writeColumnarFile(*beers, path))
+        {
+            std::cout << "Unable to write columnar export " << path << "." << std::endl;
+            return false;
+        }
+        std::cout << beers->size() << " beers exported to " << path << "." << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Import the beers of a columnar file written by exportColumnar.
+     *
+     * Beers without stock would be rejected by addBeers anyway, so row groups
+     * whose quantity statistics show no stock are skipped without reading
+     * any of their chunks. Imported beers get new ids.
+     *
+     * @param path The file to read.
+     * @return The number of beers added.
+     */
+    size_t importColumnar(const std::string &path)
+    {
+        ColumnarReader reader(path);
+        const auto &schema = ColumnarFormat::schema();
+        std::vector<int> columns(schema.size());
+        for (size_t c = 0; c < schema.size() && reader.isValid(); ++c)
+        {
+            columns[c] = reader.columnIndex(schema[c].first);
+        }
+        if (!reader.isValid() || std::count(columns.begin(), columns.end(), -1) > 0)
+        {
+            std::cout << "File " << path << " is not a valid columnar export." << std::endl;
+            return 0;
+        }
+        std::vector<size_t> groups = reader.rowGroupsInRange(columns[static_cast<size_t>(BeerColumn::QUANTITY)], 1, INT_MAX);
+        std::vector<Beer> batch;
+        for (size_t group : groups)
+        {
+            std::vector<ColumnValues> values(schema.size());
+            for (size_t c = 0; c < schema.size(); ++c)
+            {
+                if (!reader.readChunk(group, columns[c], values[c]) || values[c].type != schema[c].second)
+                {
+                    std::cout << "File " << path << " is corrupt." << std::endl;
+                    return 0;
+                }
+            }
+            for (size_t row = 0; row < values[0].ints.size(); ++row)
+            {
+                Beer beer(values[2].strings[row], values[1].strings[row], values[3].doubles[row],
+                          ContainerSize(values[5].ints[row] != 0, static_cast<int>(values[4].ints[row])),
+                          static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(values[6].ints[row], INT_MAX))), values[7].ints[row]);
+                beer.setUpdatedDate(values[8].strings[row]);
+                batch.push_back(beer);
+            }
+        }
+        std::cout << "Read " << groups.size() << " of " << reader.getRowGroupCount() << " row groups (" << reader.getBytesRead() << " bytes)." << std::endl;
+        return addBeers(batch);
+    }
+
+    /**
+     * @brief Export the inventory as an Arrow IPC stream in a memory-mapped file.
+     * @param path The file to write, e.g. under /dev/shm.
+     * @return True if the file was written.
+     */
+    bool exportArrow(const std::string &path) const
+    {
+        if (!ArrowStreamWriter::writeShared(*beers, path))
+        {
+            std::cout << "Unable to write Arrow stream " << path << "." << std::endl;
+            return false;
+        }
+        std::cout << beers->size() << " beers exported to " << path << "." << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Import beers from a JSON Lines file, one object per line.
+     * @param path The file to read.
+     * @return The number of beers added.
+     */
+    size_t importJsonLines(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            std::cout << "Unable to open " << path << "." << std::endl;
+            return 0;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (text.size() > UINT32_MAX)
+        {
+            std::cout << "File " << path << " is too large to import in one pass." << std::endl;
+            return 0;
+        }
+        JsonLinesReader reader(text.data(), text.size());
+        std::vector<Beer> batch;
+        reader.readAll(batch);
+        for (const std::string &error : reader.getErrors())
+        {
+            std::cout << "Skipped " << error << std::endl;
+        }
+        return addBeers(batch);
+    }
+
+    /**
+     * @brief Serve the live dashboard feed (see DashboardFeed), starting from the current counts.
+     * @param port The TCP port to listen on, or 0 for any free port.
+     * @param intervalMillis The most often a display receives an event.
+     * @param bindAddress The IPv4 address to listen on.
+     * @param allowOrigin The origin allowed to read the feed cross-site, or empty for none.
+     * @return True if the feed is running.
+     */
+    bool startDashboard(int port, int intervalMillis, const std::string &bindAddress = "127.0.0.1",
+                        const std::string &allowOrigin = "")
+    {
+        try
+        {
+            dashboard.reset(new DashboardFeed(port, std::chrono::milliseconds(intervalMillis), bindAddress, allowOrigin));
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << e.what() << "." << std::endl;
+            return false;
+        }
+        for (const auto &count : beerCounts)
+        {
+            if (count.first != "Total")
+            {
+                dashboard->publishCount(count.first, count.second);
+            }
+        }
+        auto total = beerCounts.find("Total");
+        dashboard->publishTotal(total == beerCounts.end() ? 0 : total->second);
+        dashboard->publishBreakageTotal(breakage.getTotalBreakage());
+        std::cout << "Dashboard feed at http://" << bindAddress << ":" << dashboard->getPort() << "/events" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Export the inventory as JSON Lines.
+     * @param path The file to write.
+     * @return True if the file was written.
+     */
+    bool exportJsonLines(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        {
+            JsonLinesWriter writer(out);
+            beers->forEach([&writer](const Beer &beer)
+                           { writer.write(beer); });
+        }
+        if (!out)
+        {
+            std::cout << "Unable to write " << path << "." << std::endl;
+            return false;
+        }
+        std::cout << beers->size() << " beers exported to " << path << "." << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Run a query statement against the inventory and print the result.
+     *
+     * The planner picks the cheapest index for the WHERE clause; prefixing
+     * the query with EXPLAIN prints that plan, its estimated and actual row
+     * counts and timings instead of the rows. "PREPARE name AS query" keeps
+     * a query, whose literals may be "?" parameters, for
+     * "EXECUTE name (value, ...)" to run without parsing it again.
+     * "CREATE VIEW name AS query" registers an aggregate that every change
+     * to the inventory keeps current; "SHOW VIEW name" reads it without a
+     * scan, "SHOW VIEWS" lists the views and "DROP VIEW name" removes one.
+     * "WATCH BARCODE 123 BELOW 10" or "WATCH STYLE 'IPA' ABOVE 500"
+     * reports whenever that level crosses the threshold; "SHOW WATCHES"
+     * lists the watches and "UNWATCH id" removes one. "SHOW HOT" lists the
+     * most active barcodes, "SHOW DEAD" the beers with no recent activity
+     * and "SHOW ACTIVITY" the distinct barcodes active in each recent hour
+     * (see ActivitySketch). "SHOW PREFIX 012345" lists the beers whose
+     * barcodes start with those digits, in barcode order, and their totals;
+     * with TOTALS it prints only the totals (see BarcodeRadixTree).
+     * "SHOW CHANGED SINCE '2024-05-01'" lists the beers updated since then,
+     * "SHOW UNTOUCHED 30" those not updated for 30 days and "SHOW RECENT 10"
+     * the ten most recently updated (see UpdateTimeline).
+     * "CREATE REPORT name AS query" adds a query to the report set, which
+     * "RUN REPORTS" answers in a single pass over the inventory (see
+     * SharedScan); "SHOW REPORTS" lists it and "DROP REPORT name" removes one.
+     * "SHOW ABV BANDS 0.5" totals the beers and bottles in each half-percent
+     * alcohol band (one percent by default).
+     * "UPDATE SET style = 'IPA' WHERE style = 'IPA '" and
+     * "DELETE WHERE quantity = 0" change or remove every matching beer as
+     * one batch (see updateWhere and removeWhere).
+     * "RECEIVE 24 OF 7 BEST BEFORE '2024-09-30'" adds a dated lot to beer 7;
+     * sales then use its lots soonest best-before first. "SHOW EXPIRING 7"
+     * lists the lots past or within seven days of their best-before date
+     * (14 days by default) and "SHOW LOTS 7" the lots of beer 7 (see LotLedger).
+     *
+     * @param text The statement, e.g. "SELECT style, SUM(quantity) GROUP BY style".
+     * @return True if the statement ran.
+     */
+    bool runQuery(const std::string &text)
+    {
+        try
+        {
+            QueryStatement statement = QueryParser::parseStatement(text);
+            if (statement.kind == QueryStatement::PREPARE)
+            {
+                PreparedQuery prepared(statement.body);
+                std::cout << "Prepared " << statement.name << " with " << prepared.getParameterCount() << " parameters." << std::endl;
+                preparedQueries.erase(statement.name);
+                preparedQueries.emplace(statement.name, std::move(prepared));
+                return true;
+            }
+            if (statement.kind == QueryStatement::EXECUTE)
+            {
+                auto it = preparedQueries.find(statement.name);
+                if (it == preparedQueries.end())
+                {
+                    std::cout << "No prepared query named " << statement.name << "." << std::endl;
+                    return false;
+                }
+                it->second.bind(statement.arguments);
+                runPrepared(it->second);
+                return true;
+            }
+            if (statement.kind == QueryStatement::CREATE_VIEW)
             {
-                try
+                MaterializedView view(statement.body);
+                view.populate(*beers);
+                std::cout << "Created view " << statement.name << " with " << view.getGroupCount() << " groups." << std::endl;
+                views.erase(statement.name);
+                views.emplace(statement.name, std::move(view));
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_VIEWS)
+            {
+                for (const auto &view : views)
                 {
-                    long long barcode = std::stoll(barcodeStr);
-                    return barcode;
+                    std::cout << view.first << " (" << view.second.getGroupCount() << " groups)" << std::endl;
                 }
-                catch (const std::out_of_range &e)
+                std::cout << views.size() << " views." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_VIEW || statement.kind == QueryStatement::DROP_VIEW)
+            {
+                auto it = views.find(statement.name);
+                if (it == views.end())
                 {
-                    std::cout << "Barcode value is too large. Please enter a valid 12-digit barcode." << std::endl;
+                    std::cout << "No view named " << statement.name << "." << std::endl;
+                    return false;
                 }
-                catch (const std::invalid_argument &e)
+                if (statement.kind == QueryStatement::DROP_VIEW)
                 {
-                    std::cout << "Invalid input. Please enter a valid 12-digit barcode." << std::endl;
+                    views.erase(it);
+                    std::cout << "Dropped view " << statement.name << "." << std::endl;
+                }
+                else
+                {
+                    printQueryResult(it->second.read());
                 }
+                return true;
             }
-            else
+            if (statement.kind == QueryStatement::WATCH)
             {
-                std::cout << "Invalid barcode. Please enter exactly 12 digits." << std::endl;
+                const WatchRegistry::Watch &watch = watches.add(statement.name == "barcode" ? WatchRegistry::BARCODE_QUANTITY : WatchRegistry::STYLE_TOTAL,
+                                                                statement.arguments[0].toString(), statement.below, statement.arguments[1].intValue);
+                std::cout << "Watch " << watch.id << ": " << watch.describe() << " (now " << watches.getLevel(watch) << ")." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::UNWATCH)
+            {
+                if (!watches.remove(static_cast<int>(statement.arguments[0].intValue)))
+                {
+                    std::cout << "No watch with id " << statement.arguments[0].intValue << "." << std::endl;
+                    return false;
+                }
+                std::cout << "Removed watch " << statement.arguments[0].intValue << "." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_WATCHES)
+            {
+                watches.forEach([this](const WatchRegistry::Watch &watch)
+                                { std::cout << "Watch " << watch.id << ": " << watch.describe() << " (now " << watches.getLevel(watch) << ")" << std::endl; });
+                std::cout << watches.size() << " watches." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_HOT || statement.kind == QueryStatement::SHOW_DEAD ||
+                statement.kind == QueryStatement::SHOW_ACTIVITY)
+            {
+                printQueryResult(activityReport(statement));
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_PREFIX)
+            {
+                return showPrefix(statement);
+            }
+            if (statement.kind == QueryStatement::CREATE_REPORT)
+            {
+                reports.add(statement.name, statement.body);
+                std::cout << "Report " << statement.name << " added (" << reports.size() << " reports)." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::DROP_REPORT)
+            {
+                if (!reports.remove(statement.name))
+                {
+                    std::cout << "No report named " << statement.name << "." << std::endl;
+                    return false;
+                }
+                std::cout << "Dropped report " << statement.name << "." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_REPORTS)
+            {
+                reports.forEach([](const std::string &name, const std::string &text)
+                                { std::cout << name << ": " << text << std::endl; });
+                std::cout << reports.size() << " reports." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::RUN_REPORTS)
+            {
+                runReports();
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_ABV_BANDS)
+            {
+                printQueryResult(abvBands(statement.arguments.empty() ? 1.0 : statement.arguments[0].asDouble()));
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_CHANGED || statement.kind == QueryStatement::SHOW_UNTOUCHED ||
+                statement.kind == QueryStatement::SHOW_RECENT)
+            {
+                printQueryResult(updateReport(statement));
+                return true;
+            }
+            if (statement.kind == QueryStatement::SHOW_EXPIRING || statement.kind == QueryStatement::SHOW_LOTS)
+            {
+                printQueryResult(lotReport(statement));
+                return true;
+            }
+            if (statement.kind == QueryStatement::RECEIVE)
+            {
+                std::optional<int32_t> bestBefore = LotLedger::parseDay(statement.arguments[2].stringValue);
+                if (!bestBefore)
+                {
+                    throw std::invalid_argument("expected a date like '2024-05-01' near '" + statement.arguments[2].stringValue + "'");
+                }
+                int64_t quantity = statement.arguments[0].intValue;
+                int64_t id = statement.arguments[1].intValue;
+                if (quantity <= 0 || quantity > INT_MAX)
+                {
+                    throw std::invalid_argument("a lot needs a quantity from 1 to " + std::to_string(INT_MAX));
+                }
+                std::optional<Beer> beer = id >= 0 && id <= INT_MAX ? beers->find(static_cast<int>(id)) : std::nullopt;
+                if (!beer)
+                {
+                    std::cout << "No beer with id " << id << "." << std::endl;
+                    return false;
+                }
+                if (!receiveLot(static_cast<int>(id), static_cast<int>(quantity), *bestBefore))
+                {
+                    std::cout << "Beer " << id << " holds " << beer->getQuantity() << " bottles; " << quantity << " more would overflow its quantity." << std::endl;
+                    return false;
+                }
+                std::cout << "Received " << quantity << " bottles of beer " << id << ", best before " << LotLedger::formatDay(*bestBefore) << "." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::UPDATE)
+            {
+                size_t updated = updateWhere(statement.body, statement.changes);
+                std::cout << "Updated " << updated << " beers." << std::endl;
+                return true;
+            }
+            if (statement.kind == QueryStatement::DELETE)
+            {
+                size_t removed = removeWhere(statement.body);
+                std::cout << "Removed " << removed << " beers." << std::endl;
+                return true;
+            }
+            PreparedQuery adHoc(statement.body);
+            if (!adHoc.isBound())
+            {
+                std::cout << "Query error: parameters can only be used in prepared queries" << std::endl;
+                return false;
             }
+            runPrepared(adHoc);
+            return true;
+        }
+        catch (const std::invalid_argument &e)
+        {
+            std::cout << "Query error: " << e.what() << std::endl;
+            return false;
         }
     }
 
     /**
-     * @brief Flag breakage while adding beer.
+     * @brief Total the beers and bottles in each alcohol-content band.
+     *
+     * The inventory is grouped by exact ABV (in parallel on a large
+     * in-memory store; see QueryEngine::execute), and the few resulting
+     * groups are then folded into bands.
+     *
+     * @param width The band width in percentage points.
+     * @return One row per non-empty band, lowest first.
      */
-    void flagBreakage()
+    QueryResult abvBands(double width) const
     {
-        isBreakageFlagged = true;
-        std::cout << "Breakage has been flagged." << std::endl;
+        Query query = QueryParser::parse("SELECT abv, COUNT(*), SUM(quantity) GROUP BY abv");
+        QueryResult byAbv = QueryEngine::execute(query, *beers, catalog, AccessPath());
+        std::map<int64_t, std::pair<int64_t, int64_t>> bands; // band number -> (beers, bottles)
+        for (const std::vector<QueryValue> &row : byAbv.rows)
+        {
+            // The small offset keeps values on a boundary, such as 4.5 in 0.1-wide bands, from falling below it.
+            std::pair<int64_t, int64_t> &band = bands[static_cast<int64_t>(std::floor(row[0].doubleValue / width + 1e-9))];
+            band.first += row[1].intValue;
+            band.second += row[2].intValue;
+        }
+        QueryResult result;
+        result.columns = {"abv_band", "beers", "bottles"};
+        for (const auto &band : bands)
+        {
+            char buffer[64];
+            char *end = std::to_chars(buffer, buffer + 24, band.first * width, std::chars_format::fixed, 2).ptr;
+            *end++ = '-';
+            end = std::to_chars(end, buffer + sizeof(buffer), (band.first + 1) * width, std::chars_format::fixed, 2).ptr;
+            result.rows.push_back({QueryValue::ofString(std::string(buffer, end)), QueryValue::ofInt(band.second.first),
+                                   QueryValue::ofInt(band.second.second)});
+        }
+        return result;
     }
 
     /**
-     * @brief Remove beer from the stock.
-     * @param amount The amount of beer to remove.
+     * @brief Run the report set in one pass and print each report under its name.
      */
-    // Modify the removeBeer method to prompt for the ID to remove
-    void removeBeer()
+    void runReports() const
     {
-        std::cout << "Select a beer to remove by entering its ID:" << std::endl;
-
-        // Display available beers with IDs
-        for (const Beer &beer : beers)
-        {
-            std::cout << "ID: " << beer.getId() << " - " << beer.getName() << std::endl;
-        }
-
-        int idToRemove;
-        std::cout << "Enter the ID of the beer to remove: ";
-        std::cin >> idToRemove;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<QueryResult> results = reports.run(*beers);
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t r = 0;
+        reports.forEach([&](const std::string &name, const std::string &)
+                        {
+                            std::cout << "== " << name << " ==" << std::endl;
+                            printQueryResult(results[r++]); });
+        std::cout << results.size() << " reports from one scan of " << beers->size() << " beers in " << millis << " ms." << std::endl;
+    }
 
-        bool found = false;
-        for (auto it = beers.begin(); it != beers.end(); ++it)
+    /**
+     * @brief Print the beers under a barcode prefix and their totals.
+     * @param statement A SHOW PREFIX statement.
+     * @return False if the prefix is not one to twelve digits.
+     */
+    bool showPrefix(const QueryStatement &statement) const
+    {
+        uint64_t low, high;
+        if (!BarcodeRadixTree::prefixRange(statement.name, low, high))
         {
-            if (it->getId() == idToRemove)
-            {
-                beerCounts[it->getName()] -= it->getQuantity();
-                beerCounts["Total"] -= it->getQuantity();
-                it = beers.erase(it); // Remove the selected beer
-                std::cout << "Beer with ID " << idToRemove << " removed from stock." << std::endl;
-                found = true;
-                break;
-            }
+            std::cout << "Query error: a barcode prefix is one to twelve digits" << std::endl;
+            return false;
         }
-
-        if (!found)
+        if (!statement.totalsOnly)
         {
-            std::cout << "Beer with ID " << idToRemove << " not found in inventory." << std::endl;
+            QueryResult result;
+            result.columns = {"barcode", "name", "style", "quantity"};
+            barcodePrefixes.scan(low, high, [&](uint64_t barcode, const std::vector<std::pair<int, int>> &entries)
+                                 {
+                                     for (const auto &entry : entries)
+                                     {
+                                         std::optional<Beer> beer = beers->find(entry.first);
+                                         if (beer)
+                                         {
+                                             result.rows.push_back({QueryValue::ofInt(static_cast<int64_t>(barcode)), QueryValue::ofString(beer->getName()),
+                                                                    QueryValue::ofString(beer->getStyle()), QueryValue::ofInt(beer->getQuantity())});
+                                         }
+                                     } });
+            printQueryResult(result);
         }
+        BarcodeRadixTree::Totals totals = barcodePrefixes.total(low, high);
+        std::cout << totals.beers << " beers, " << totals.bottles << " bottles under prefix " << statement.name << "." << std::endl;
+        return true;
     }
 
     /**
-     * @brief Display details of all added beers.
+     * @brief Build the result of SHOW EXPIRING or SHOW LOTS.
+     * @param statement The statement; SHOW EXPIRING may carry a number of days, SHOW LOTS carries a beer id.
+     * @return The lots, soonest best-before first.
      */
-    void displayAddedBeers() const
+    QueryResult lotReport(const QueryStatement &statement) const
     {
-        if (beers.empty())
+        QueryResult result;
+        result.columns = {"best_before", "days_left", "id", "name", "quantity", "received"};
+        int32_t today = LotLedger::today();
+        auto addRow = [this, &result, today](const LotLedger::Lot &lot)
         {
-            std::cout << "No beers in inventory." << std::endl;
-            return;
+            std::optional<Beer> beer = beers->find(lot.id);
+            result.rows.push_back({QueryValue::ofString(LotLedger::formatDay(lot.bestBefore)), QueryValue::ofInt(lot.bestBefore - today),
+                                   QueryValue::ofInt(lot.id), QueryValue::ofString(beer ? beer->getName() : std::string()),
+                                   QueryValue::ofInt(lot.quantity), QueryValue::ofString(LotLedger::formatDay(lot.received))});
+        };
+        if (statement.kind == QueryStatement::SHOW_EXPIRING)
+        {
+            int64_t days = statement.arguments.empty() ? 14 : statement.arguments[0].intValue;
+            lots.expiringBefore(static_cast<int32_t>(std::min<int64_t>(today + days + 1, INT32_MAX)), addRow);
         }
-
-        std::cout << "List of added beers:" << std::endl;
-        for (const Beer &beer : beers)
+        else if (statement.arguments[0].intValue >= 0 && statement.arguments[0].intValue <= INT_MAX)
         {
-            std::cout << "ID: " << beer.getId() << std::endl;
-            std::cout << "Name: " << beer.getName() << std::endl;
-            std::cout << "Style: " << beer.getStyle() << std::endl;
-            std::cout << "Alcohol Content: " << beer.getAlcoholContent() << "%" << std::endl;
-            std::cout << "Container Size: " << beer.getContainerSize().getSizeWithUnits() << std::endl;
-            std::cout << "Quantity: " << beer.getQuantity() << " bottles" << std::endl;
-            std::cout << "Barcode: " << beer.getBarcode().getValue() << std::endl;
-            std::cout << "Updated Date: " << beer.getUpdatedDate() << std::endl;
-            std::cout << "-----------------------" << std::endl;
+            for (const LotLedger::Lot &lot : lots.lotsOf(static_cast<int>(statement.arguments[0].intValue)))
+            {
+                addRow(lot);
+            }
         }
+        return result;
     }
 
     /**
-     * @brief Display details of flagged beers.
+     * @brief Build the result of SHOW CHANGED, SHOW UNTOUCHED or SHOW RECENT.
+     * @param statement The statement; a SHOW RECENT may carry a row limit.
+     * @return The report as a query result.
+     * @throws std::invalid_argument if a SHOW CHANGED date is malformed.
      */
-    void displayFlaggedBeers() const
+    QueryResult updateReport(const QueryStatement &statement) const
     {
-        if (flaggedBeers.empty())
+        QueryResult result;
+        result.columns = {"id", "name", "barcode", "quantity", "updated"};
+        auto addRow = [this, &result](int id)
         {
-            std::cout << "No beers flagged for breakage." << std::endl;
-        }
-        else
+            std::optional<Beer> beer = beers->find(id);
+            if (beer)
+            {
+                result.rows.push_back({QueryValue::ofInt(id), QueryValue::ofString(beer->getName()), QueryValue::ofInt(beer->getBarcode().getValue()),
+                                       QueryValue::ofInt(beer->getQuantity()), QueryValue::ofString(beer->getUpdatedDate())});
+            }
+            return true;
+        };
+        if (statement.kind == QueryStatement::SHOW_CHANGED)
         {
-            std::cout << "List of flagged beers for breakage:" << std::endl;
-            for (const auto &flaggedBeer : flaggedBeers)
+            std::optional<int64_t> stamp = UpdateTimeline::parseStamp(statement.arguments[0].stringValue);
+            if (!stamp)
             {
-                std::cout << "Name: " << flaggedBeer.first << std::endl;
-                std::cout << "Quantity: " << flaggedBeer.second << " bottles" << std::endl;
-                std::cout << "-----------------------" << std::endl;
+                throw std::invalid_argument("expected a date like '2024-05-01' or '2024-05-01 13:30:00' near '" + statement.arguments[0].stringValue + "'");
             }
+            updateTimes.since(*stamp, addRow);
+        }
+        else if (statement.kind == QueryStatement::SHOW_UNTOUCHED)
+        {
+            updateTimes.before(UpdateTimeline::localStamp(std::time(nullptr)) - statement.arguments[0].intValue * 86400, addRow);
+        }
+        else
+        {
+            size_t limit = statement.arguments.empty() ? 20 : static_cast<size_t>(std::max<int64_t>(0, statement.arguments[0].intValue));
+            updateTimes.latest([&](int id)
+                               { return result.rows.size() < limit && addRow(id); });
         }
+        return result;
     }
 
     /**
-     * @brief Display the total count of each beer type.
+     * @brief Build the result of SHOW HOT, SHOW DEAD or SHOW ACTIVITY.
+     * @param statement The statement; a SHOW HOT or SHOW DEAD may carry a row limit.
+     * @return The report as a query result.
      */
-    void displayTotalCounts() const
+    QueryResult activityReport(const QueryStatement &statement) const
     {
-        std::cout << "Total counts of each beer type:" << std::endl;
-        for (const auto &entry : beerCounts){
-           if (entry.first  != "Total"){
-                std::cout << entry.first << ": " << entry.second << " bottles" << std::endl;
-           } 
+        QueryResult result;
+        size_t limit = statement.arguments.empty() ? 20 : static_cast<size_t>(std::max<int64_t>(0, statement.arguments[0].intValue));
+        if (statement.kind == QueryStatement::SHOW_ACTIVITY)
+        {
+            result.columns = {"hour", "distinct_barcodes"};
+            for (const auto &hour : activity.hourlyDistinct(std::time(nullptr)))
+            {
+                char buffer[32];
+                std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:00", std::localtime(&hour.first));
+                result.rows.push_back({QueryValue::ofString(buffer), QueryValue::ofInt(std::llround(hour.second))});
+            }
+            return result;
         }
+        if (statement.kind == QueryStatement::SHOW_HOT)
+        {
+            std::vector<ActivitySketch::HeavyHitter> hot = activity.topBarcodes(limit);
+            std::unordered_map<long long, std::string> names;
+            for (const ActivitySketch::HeavyHitter &entry : hot)
+            {
+                names[entry.barcode];
+            }
+            beers->forEach([&names](const Beer &beer)
+                           {
+                               auto it = names.find(beer.getBarcode().getValue());
+                               if (it != names.end() && it->second.empty())
+                               {
+                                   it->second = beer.getName();
+                               } });
+            result.columns = {"barcode", "name", "operations", "overcount"};
+            for (const ActivitySketch::HeavyHitter &entry : hot)
+            {
+                result.rows.push_back({QueryValue::ofInt(entry.barcode), QueryValue::ofString(names[entry.barcode]),
+                                       QueryValue::ofInt(static_cast<int64_t>(entry.count)), QueryValue::ofInt(static_cast<int64_t>(entry.error))});
+            }
+            return result;
+        }
+        result.columns = {"barcode", "name", "quantity"};
+        beers->forEach([&](const Beer &beer)
+                       {
+                           if (result.rows.size() < limit && activity.estimate(beer.getBarcode().getValue()) == 0)
+                           {
+                               result.rows.push_back({QueryValue::ofInt(beer.getBarcode().getValue()), QueryValue::ofString(beer.getName()),
+                                                      QueryValue::ofInt(beer.getQuantity())});
+                           } });
+        return result;
     }
 
     /**
-     * @brief Edit beer details.
-     * @param beerName The name of the beer to edit.
+     * @brief Plan and run a query with bound parameters and print the result.
+     *
+     * A result stays cached until a column it reads is edited or a beer is
+     * added or removed, so repeating a query is a hash probe until then.
+     *
+     * @param prepared The query to run.
      */
-    void editBeer(const std::string &beerName)
+    void runPrepared(const PreparedQuery &prepared)
     {
-        std::vector<std::string> availableBeerNames;
-        for (const Beer &beer : beers)
+        const Query &query = prepared.getQuery();
+        if (query.where)
         {
-            availableBeerNames.push_back(beer.getName());
+            recordLookups(*query.where);
         }
-
-        bool beerExists = false;
-        for (Beer &beer : beers)
+        std::string key;
+        if (!query.explain)
         {
-            if (beer.getName() == beerName)
+            key = QueryResultCache::normalize(query);
+            if (const QueryResult *cached = resultCache.find(key, catalog))
             {
-                beerExists = true;
-                std::string newName, newStyle;
-                double newAlcoholContent;
-                ContainerSize newContainerSize = beer.getContainerSize();
-                int newQuantity, newBarcode;
-
-                std::cout << "Enter new name for the beer (press Enter to keep it the same): ";
-                std::string temp;
-                std::getline(std::cin, temp);
-                if (!temp.empty())
+                std::vector<std::string> labels;
+                for (const SelectItem &item : query.items)
                 {
-                    beer.setName(temp);
+                    labels.push_back(item.label);
                 }
-
-                std::cout << "Enter new style for the beer (press Enter to keep it the same): ";
-                std::getline(std::cin, temp);
-                if (!temp.empty())
-                {
-                    beer.setStyle(temp);
-                }
-
-                std::cout << "Enter new alcohol content for the beer (%): ";
-                std::cin >> newAlcoholContent;
-                beer.setAlcoholContent(newAlcoholContent);
-
-                std::cout << "Enter new container size for the beer (size in ml for metric, fl oz for non-metric): ";
-                int newSize;
-                std::cin >> newSize;
-                newContainerSize.setSize(newSize, newContainerSize.getIsMetric());
-
-                std::cout << "Is the new container size metric (1 for yes, 0 for no): ";
-                bool isMetric;
-                std::cin >> isMetric;
-                newContainerSize.setIsMetric(isMetric);
-
-                beer.setContainerSize(newContainerSize);
-
-                std::cout << "Enter new quantity for the beer: ";
-                std::cin >> newQuantity;
-                beer.setQuantity(newQuantity);
-
-                std::cout << "Beer details updated." << std::endl;
+                printQueryResult(*cached, labels);
                 return;
             }
         }
-
-        if (!beerExists)
+        auto started = std::chrono::steady_clock::now();
+        QueryPlan plan = QueryPlanner::plan(query, catalog, catalog.getStatistics(*beers), beers->size());
+        auto planned = std::chrono::steady_clock::now();
+        QueryResult result = QueryEngine::execute(query, *beers, catalog, plan.access, prepared.getKernel());
+        auto finished = std::chrono::steady_clock::now();
+        if (query.explain)
         {
-            std::cout << "Beer with name '" << beerName << "' not found." << std::endl;
+            printQueryPlan(plan, prepared, result, std::chrono::duration<double, std::milli>(planned - started).count(),
+                           std::chrono::duration<double, std::milli>(finished - planned).count());
+        }
+        else
+        {
+            printQueryResult(result);
+            resultCache.store(key, query, catalog, std::move(result));
         }
     }
 
@@ -610,6 +13135,10 @@ public:
      */
     bool beerExists(const std::string &beerName) const
     {
+        if (!knownNames.mayContain(hashString(beerName)))
+        {
+            return false; // most new names during an import stop here
+        }
         return beerCounts.find(beerName) != beerCounts.end();
     }
 };
@@ -632,15 +13161,189 @@ int displayMenuAndGetOption()
     std::cout << "6. Display Total Counts" << std::endl;
     std::cout << "7. Edit Beer" << std::endl;
     std::cout << "8. Exit" << std::endl;
+    // Options added since the first release come after Exit, so the original numbers stay put.
+    std::cout << "9. Save Snapshot" << std::endl;
+    std::cout << "10. Load Snapshot" << std::endl;
+    std::cout << "11. Export Columnar" << std::endl;
+    std::cout << "12. Export Arrow Stream" << std::endl;
+    std::cout << "13. Import JSON Lines" << std::endl;
+    std::cout << "14. Export JSON Lines" << std::endl;
+    std::cout << "15. Run Query" << std::endl;
+    std::cout << "16. Scan Barcode" << std::endl;
+    std::cout << "17. Browse Inventory" << std::endl;
+    std::cout << "18. Display Sorted Beers" << std::endl;
+    std::cout << "19. Import Columnar" << std::endl;
     std::cout << "Enter option: ";
     std::cin >> option;
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear input buffer
     return option;
 }
 
-int main()
+/**
+ * @brief Command-line options other than the storage backend.
+ *
+ * "--dashboard <port>" serves the live dashboard feed on that port, sending
+ * at most one event per "--dashboard-interval <ms>". The feed listens on
+ * 127.0.0.1 unless "--dashboard-bind <addr>" names another address (such as
+ * 0.0.0.0 to accept displays on the network), and browsers on other origins
+ * may read it only if "--dashboard-origin <origin>" names theirs. "--barcode-mph" looks
+ * barcodes up through a minimal perfect hash rebuilt at snapshot time.
+ * "--journal <file>" appends a record of each UPDATE and DELETE to the file.
+ */
+struct AppOptions
+{
+    int dashboardPort = -1; // no dashboard
+    int dashboardInterval = 1000;
+    std::string dashboardBind = "127.0.0.1";
+    std::string dashboardOrigin; // no cross-origin access
+    bool barcodeDirectory = false;
+    std::string journalPath; // no journal
+};
+
+/**
+ * @brief Build the storage backend selected on the command line.
+ *
+ * With no arguments beers are kept in memory. "--btree <file>" keeps them in
+ * an on-disk B+tree store, and "--pool-pages <n>" sizes its buffer pool.
+ * Only the beers move to disk: the per-name counts, the query indexes, the
+ * Bloom filters and the barcode-prefix and update-time indexes (and with
+ * --barcode-mph the barcode directory) are rebuilt in memory at startup, so
+ * the process still needs memory in proportion to the inventory.
+ * "--tiered <file>" keeps only the hot fields resident and spills cold
+ * strings to the given file, holding at most "--cold-resident <n>" of them.
+ * The other options are returned in options (see AppOptions).
+ *
+ * @param argc The argument count.
+ * @param argv The arguments.
+ * @param options Receives the options that are not about storage.
+ * @return The store, or nullptr if the arguments are invalid or the store cannot be opened.
+ */
+std::unique_ptr<BeerStore> createStoreFromArgs(int argc, char *argv[], AppOptions &options)
+{
+    std::string btreePath, spillPath;
+    size_t poolPages = 1024;
+    size_t residentCold = 100000;
+    auto usage = [&]()
+    {
+        std::cout << "Usage: " << argv[0] << " [--btree <file>] [--pool-pages <n>]"
+                  << " [--tiered <spill file>] [--cold-resident <n>]"
+                  << " [--dashboard <port>] [--dashboard-interval <ms>] [--dashboard-bind <addr>]"
+                  << " [--dashboard-origin <origin>] [--barcode-mph] [--journal <file>]" << std::endl;
+    };
+    // The whole argument must be a number in range; std::stoul would take "-1" and "12abc".
+    auto number = [](const std::string &flag, const char *text, long long low, long long high)
+    {
+        long long value = 0;
+        const char *end = text + std::strlen(text);
+        auto result = std::from_chars(text, end, value);
+        if (result.ec != std::errc() || result.ptr != end || value < low || value > high)
+        {
+            throw std::invalid_argument(flag + " expects a number from " + std::to_string(low) + " to " +
+                                        std::to_string(high) + ", not '" + text + "'");
+        }
+        return value;
+    };
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--btree" && i + 1 < argc)
+            {
+                btreePath = argv[++i];
+            }
+            else if (arg == "--pool-pages" && i + 1 < argc)
+            {
+                poolPages = static_cast<size_t>(number(arg, argv[++i], 1, INT_MAX));
+            }
+            else if (arg == "--tiered" && i + 1 < argc)
+            {
+                spillPath = argv[++i];
+            }
+            else if (arg == "--cold-resident" && i + 1 < argc)
+            {
+                residentCold = static_cast<size_t>(number(arg, argv[++i], 0, LLONG_MAX));
+            }
+            else if (arg == "--dashboard" && i + 1 < argc)
+            {
+                options.dashboardPort = static_cast<int>(number(arg, argv[++i], 0, 65535));
+            }
+            else if (arg == "--dashboard-interval" && i + 1 < argc)
+            {
+                options.dashboardInterval = static_cast<int>(number(arg, argv[++i], 1, INT_MAX));
+            }
+            else if (arg == "--dashboard-bind" && i + 1 < argc)
+            {
+                options.dashboardBind = argv[++i];
+            }
+            else if (arg == "--dashboard-origin" && i + 1 < argc)
+            {
+                options.dashboardOrigin = argv[++i];
+            }
+            else if (arg == "--barcode-mph")
+            {
+                options.barcodeDirectory = true;
+            }
+            else if (arg == "--journal" && i + 1 < argc)
+            {
+                options.journalPath = argv[++i];
+            }
+            else
+            {
+                usage();
+                return nullptr;
+            }
+        }
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cout << e.what() << "." << std::endl;
+        usage();
+        return nullptr;
+    }
+    try
+    {
+        if (!spillPath.empty())
+        {
+            return std::unique_ptr<BeerStore>(new TieredBeerStore(spillPath, residentCold));
+        }
+        if (btreePath.empty())
+        {
+            return std::unique_ptr<BeerStore>(new VectorBeerStore());
+        }
+        return std::unique_ptr<BeerStore>(new BTreeBeerStore(btreePath, poolPages));
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << e.what() << "." << std::endl;
+        usage();
+        return nullptr;
+    }
+}
+
+int main(int argc, char *argv[])
 {
-    BottleApp bottleApp;
+    AppOptions options;
+    std::unique_ptr<BeerStore> store = createStoreFromArgs(argc, argv, options);
+    if (!store)
+    {
+        return 1;
+    }
+    BottleApp bottleApp(std::move(store));
+    if (options.dashboardPort >= 0)
+    {
+        bottleApp.startDashboard(options.dashboardPort, options.dashboardInterval, options.dashboardBind,
+                                 options.dashboardOrigin);
+    }
+    if (options.barcodeDirectory)
+    {
+        bottleApp.enableBarcodeDirectory();
+    }
+    if (!options.journalPath.empty() && !bottleApp.openJournal(options.journalPath))
+    {
+        std::cout << "Cannot open journal " << options.journalPath << "." << std::endl;
+        return 1;
+    }
 
     int option;
     bool exit = false;
@@ -655,7 +13358,8 @@ int main()
         {
             std::string style, name;
             double alcoholContent;
-            int containerSize, quantity, barcodeValue;
+            int containerSize, quantity;
+            long long barcodeValue;
             bool isMetric; // Added isMetric variable
 
             //                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the input buffer
@@ -732,6 +13436,110 @@ int main()
             exit = true;
             break;
         }
+        case 9:
+        {
+            std::string path;
+            std::cout << "Enter the snapshot file to save: ";
+            std::getline(std::cin, path);
+            bottleApp.saveSnapshot(path);
+            break;
+        }
+        case 10:
+        {
+            std::string path;
+            std::cout << "Enter the snapshot file to load: ";
+            std::getline(std::cin, path);
+            bottleApp.loadSnapshot(path);
+            break;
+        }
+        case 11:
+        {
+            std::string path;
+            std::cout << "Enter the columnar file to write: ";
+            std::getline(std::cin, path);
+            bottleApp.exportColumnar(path);
+            break;
+        }
+        case 12:
+        {
+            std::string path;
+            std::cout << "Enter the Arrow stream file to write (e.g. /dev/shm/inventory.arrows): ";
+            std::getline(std::cin, path);
+            bottleApp.exportArrow(path);
+            break;
+        }
+        case 13:
+        {
+            std::string path;
+            std::cout << "Enter the JSON Lines file to import: ";
+            std::getline(std::cin, path);
+            bottleApp.importJsonLines(path);
+            break;
+        }
+        case 14:
+        {
+            std::string path;
+            std::cout << "Enter the JSON Lines file to write: ";
+            std::getline(std::cin, path);
+            bottleApp.exportJsonLines(path);
+            break;
+        }
+        case 15:
+        {
+            std::string text;
+            std::cout << "Enter query: ";
+            std::getline(std::cin, text);
+            bottleApp.runQuery(text);
+            break;
+        }
+        case 16:
+        {
+            long long barcode;
+            std::cout << "Enter the barcode to scan: ";
+            std::cin >> barcode;
+            bottleApp.scanBarcode(barcode);
+            break;
+        }
+        case 17:
+        {
+            bottleApp.browse();
+            break;
+        }
+        case 18:
+        {
+            std::string sortText;
+            std::cout << "Sort by column, optionally followed by DESC (press Enter for id order): ";
+            std::getline(std::cin, sortText);
+            std::transform(sortText.begin(), sortText.end(), sortText.begin(), ::tolower);
+            std::string columnName, direction;
+            size_t start = sortText.find_first_not_of(' ');
+            if (start != std::string::npos)
+            {
+                size_t end = sortText.find(' ', start);
+                columnName = sortText.substr(start, end - start);
+                if (end != std::string::npos)
+                {
+                    direction = sortText.substr(end);
+                    direction.erase(std::remove(direction.begin(), direction.end(), ' '), direction.end());
+                }
+            }
+            BeerColumn sortBy = BeerColumn::ID;
+            if (!columnName.empty() && !findBeerColumn(columnName, sortBy))
+            {
+                std::cout << "Unknown column '" << columnName << "'." << std::endl;
+                break;
+            }
+            bottleApp.displayAddedBeers(sortBy, direction == "desc");
+            break;
+        }
+        case 19:
+        {
+            std::string path;
+            std::cout << "Enter the columnar file to import: ";
+            std::getline(std::cin, path);
+            bottleApp.importColumnar(path);
+            break;
+        }
         default:
         {
             std::cout << "Invalid option. Please select a valid option from the menu." << std::endl;